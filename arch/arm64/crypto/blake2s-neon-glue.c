@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0 OR MIT
+/*
+ * BLAKE2s compression function using NEON instructions
+ */
+
+#include <crypto/internal/blake2s.h>
+#include <crypto/internal/simd.h>
+
+#include <linux/jump_label.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sizes.h>
+
+#include <asm/hwcap.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+
+asmlinkage void blake2s_compress_neon(struct blake2s_state *state,
+				      const u8 *block, size_t nblocks,
+				      u32 inc);
+
+static __ro_after_init DEFINE_STATIC_KEY_FALSE(have_neon);
+
+void blake2s_compress(struct blake2s_state *state, const u8 *block,
+		      size_t nblocks, const u32 inc)
+{
+	if (!static_branch_likely(&have_neon) || !crypto_simd_usable()) {
+		blake2s_compress_generic(state, block, nblocks, inc);
+		return;
+	}
+
+	/* NEON disables preemption, so relax after processing each page. */
+	do {
+		const size_t blocks = min_t(size_t, nblocks,
+					    SZ_4K / BLAKE2S_BLOCK_SIZE);
+
+		kernel_neon_begin();
+		blake2s_compress_neon(state, block, blocks, inc);
+		kernel_neon_end();
+
+		nblocks -= blocks;
+		block += blocks * BLAKE2S_BLOCK_SIZE;
+	} while (nblocks);
+}
+EXPORT_SYMBOL(blake2s_compress);
+
+static int __init blake2s_neon_mod_init(void)
+{
+	if (cpu_have_named_feature(ASIMD))
+		static_branch_enable(&have_neon);
+	return 0;
+}
+
+/* Runs before the library's selftest in lib/crypto/blake2s.c */
+subsys_initcall(blake2s_neon_mod_init);
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0 OR MIT
+/*
+ * Curve25519 scalar multiplication for arm64
+ *
+ * Field elements are kept in four 64-bit limbs and only partially reduced
+ * (below 2^256), using 2^256 = 38 (mod 2^255 - 19) to fold carries.  The
+ * 64x64->128 bit multiplies this needs map onto mul/umulh pairs, which on
+ * arm64 beats both the 51-bit limb generic code and a 32-bit NEON
+ * formulation as used on 32-bit ARM.
+ */
+
+#include <crypto/curve25519.h>
+#include <crypto/internal/kpp.h>
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+
+#include <asm/unaligned.h>
+
+typedef u64 fe[4];
+
+static __always_inline void fe_frombytes(fe h, const u8 s[CURVE25519_KEY_SIZE])
+{
+	h[0] = get_unaligned_le64(s);
+	h[1] = get_unaligned_le64(s + 8);
+	h[2] = get_unaligned_le64(s + 16);
+	h[3] = get_unaligned_le64(s + 24) & ~(1ULL << 63);
+}
+
+/* Add c * 38 to h, c being a carry out of bit 256 */
+static __always_inline void fe_fold(fe h, u64 c)
+{
+	u128 t;
+
+	t = (u128)h[0] + c * 38;
+	h[0] = t;
+	t = (u128)h[1] + (u64)(t >> 64);
+	h[1] = t;
+	t = (u128)h[2] + (u64)(t >> 64);
+	h[2] = t;
+	t = (u128)h[3] + (u64)(t >> 64);
+	h[3] = t;
+	/* Only wraps if h[1..3] were all ones, so h[0] is tiny now */
+	h[0] += (u64)(t >> 64) * 38;
+}
+
+static __always_inline void fe_add(fe h, const fe f, const fe g)
+{
+	u128 t = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		t = (u128)f[i] + g[i] + (u64)(t >> 64);
+		h[i] = t;
+	}
+	fe_fold(h, t >> 64);
+}
+
+static __always_inline void fe_sub(fe h, const fe f, const fe g)
+{
+	u64 borrow = 0;
+	u128 t;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		t = (u128)f[i] - g[i] - borrow;
+		h[i] = t;
+		borrow = (u64)(t >> 64) & 1;
+	}
+
+	/* Wrapped around 2^256, so take away another 38 */
+	t = (u128)h[0] - borrow * 38;
+	h[0] = t;
+	for (i = 1; i < 4; i++) {
+		t = (u128)h[i] - ((u64)(t >> 64) & 1);
+		h[i] = t;
+	}
+	h[0] -= ((u64)(t >> 64) & 1) * 38;
+}
+
+static void fe_mul(fe h, const fe f, const fe g)
+{
+	u64 t[8] = { 0 };
+	u128 acc;
+	u64 c;
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		c = 0;
+		for (j = 0; j < 4; j++) {
+			acc = (u128)f[i] * g[j] + t[i + j] + c;
+			t[i + j] = acc;
+			c = acc >> 64;
+		}
+		t[i + 4] = c;
+	}
+
+	c = 0;
+	for (i = 0; i < 4; i++) {
+		acc = (u128)t[i + 4] * 38 + t[i] + c;
+		h[i] = acc;
+		c = acc >> 64;
+	}
+	fe_fold(h, c);
+}
+
+static __always_inline void fe_sq(fe h, const fe f)
+{
+	fe_mul(h, f, f);
+}
+
+static void fe_sq_times(fe h, const fe f, int n)
+{
+	fe_sq(h, f);
+	while (--n)
+		fe_sq(h, h);
+}
+
+static __always_inline void fe_mul121665(fe h, const fe f)
+{
+	u128 t = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		t = (u128)f[i] * 121665 + (u64)(t >> 64);
+		h[i] = t;
+	}
+	fe_fold(h, t >> 64);
+}
+
+/* h = z^(p - 2) = z^(2^255 - 21) */
+static void fe_invert(fe h, const fe z)
+{
+	fe t0, t1, t2, t3;
+
+	fe_sq(t0, z);			/* 2 */
+	fe_sq_times(t1, t0, 2);		/* 8 */
+	fe_mul(t1, z, t1);		/* 9 */
+	fe_mul(t0, t0, t1);		/* 11 */
+	fe_sq(t2, t0);			/* 22 */
+	fe_mul(t1, t1, t2);		/* 2^5 - 1 */
+	fe_sq_times(t2, t1, 5);
+	fe_mul(t1, t2, t1);		/* 2^10 - 1 */
+	fe_sq_times(t2, t1, 10);
+	fe_mul(t2, t2, t1);		/* 2^20 - 1 */
+	fe_sq_times(t3, t2, 20);
+	fe_mul(t2, t3, t2);		/* 2^40 - 1 */
+	fe_sq_times(t2, t2, 10);
+	fe_mul(t1, t2, t1);		/* 2^50 - 1 */
+	fe_sq_times(t2, t1, 50);
+	fe_mul(t2, t2, t1);		/* 2^100 - 1 */
+	fe_sq_times(t3, t2, 100);
+	fe_mul(t2, t3, t2);		/* 2^200 - 1 */
+	fe_sq_times(t2, t2, 50);
+	fe_mul(t1, t2, t1);		/* 2^250 - 1 */
+	fe_sq_times(t1, t1, 5);		/* 2^255 - 32 */
+	fe_mul(h, t1, t0);		/* 2^255 - 21 */
+
+	memzero_explicit(t0, sizeof(t0));
+	memzero_explicit(t1, sizeof(t1));
+	memzero_explicit(t2, sizeof(t2));
+	memzero_explicit(t3, sizeof(t3));
+}
+
+static void fe_tobytes(u8 s[CURVE25519_KEY_SIZE], const fe f)
+{
+	u64 t[4], u[4], mask;
+	u128 c;
+	int i, j;
+
+	memcpy(t, f, sizeof(t));
+
+	/* Twice fold bit 255 back in as 19, which leaves t < 2^255 */
+	for (j = 0; j < 2; j++) {
+		c = (u128)(t[3] >> 63) * 19;
+		t[3] &= ~(1ULL << 63);
+		for (i = 0; i < 4; i++) {
+			c += t[i];
+			t[i] = c;
+			c >>= 64;
+		}
+	}
+
+	/* t >= p iff t + 19 >= 2^255, in which case the result is t - p */
+	c = 19;
+	for (i = 0; i < 4; i++) {
+		c += t[i];
+		u[i] = c;
+		c >>= 64;
+	}
+	mask = -(u[3] >> 63);
+	u[3] &= ~(1ULL << 63);
+
+	for (i = 0; i < 4; i++)
+		put_unaligned_le64((u[i] & mask) | (t[i] & ~mask), s + 8 * i);
+
+	memzero_explicit(t, sizeof(t));
+	memzero_explicit(u, sizeof(u));
+}
+
+static __always_inline void fe_cswap(fe f, fe g, u64 b)
+{
+	u64 mask = -b, x;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		x = mask & (f[i] ^ g[i]);
+		f[i] ^= x;
+		g[i] ^= x;
+	}
+}
+
+/* Montgomery ladder as in RFC 7748, section 5 */
+static void curve25519_arm64(u8 out[CURVE25519_KEY_SIZE],
+			     const u8 scalar[CURVE25519_KEY_SIZE],
+			     const u8 point[CURVE25519_KEY_SIZE])
+{
+	struct {
+		u8 e[CURVE25519_KEY_SIZE];
+		fe x1, x2, z2, x3, z3;
+		fe a, aa, b, bb, e_, c, d, da, cb;
+	} s;
+	u64 swap = 0, bit;
+	int pos;
+
+	memcpy(s.e, scalar, CURVE25519_KEY_SIZE);
+	curve25519_clamp_secret(s.e);
+
+	fe_frombytes(s.x1, point);
+	memset(s.x2, 0, sizeof(s.x2));
+	s.x2[0] = 1;
+	memset(s.z2, 0, sizeof(s.z2));
+	memcpy(s.x3, s.x1, sizeof(s.x3));
+	memset(s.z3, 0, sizeof(s.z3));
+	s.z3[0] = 1;
+
+	for (pos = 254; pos >= 0; --pos) {
+		bit = (s.e[pos / 8] >> (pos & 7)) & 1;
+		swap ^= bit;
+		fe_cswap(s.x2, s.x3, swap);
+		fe_cswap(s.z2, s.z3, swap);
+		swap = bit;
+
+		fe_add(s.a, s.x2, s.z2);
+		fe_sq(s.aa, s.a);
+		fe_sub(s.b, s.x2, s.z2);
+		fe_sq(s.bb, s.b);
+		fe_sub(s.e_, s.aa, s.bb);
+		fe_add(s.c, s.x3, s.z3);
+		fe_sub(s.d, s.x3, s.z3);
+		fe_mul(s.da, s.d, s.a);
+		fe_mul(s.cb, s.c, s.b);
+
+		fe_add(s.x3, s.da, s.cb);
+		fe_sq(s.x3, s.x3);
+		fe_sub(s.z3, s.da, s.cb);
+		fe_sq(s.z3, s.z3);
+		fe_mul(s.z3, s.z3, s.x1);
+		fe_mul(s.x2, s.aa, s.bb);
+		fe_mul121665(s.z2, s.e_);
+		fe_add(s.z2, s.z2, s.aa);
+		fe_mul(s.z2, s.z2, s.e_);
+	}
+	fe_cswap(s.x2, s.x3, swap);
+	fe_cswap(s.z2, s.z3, swap);
+
+	fe_invert(s.z2, s.z2);
+	fe_mul(s.x2, s.x2, s.z2);
+	fe_tobytes(out, s.x2);
+
+	memzero_explicit(&s, sizeof(s));
+}
+
+void curve25519_arch(u8 mypublic[CURVE25519_KEY_SIZE],
+		     const u8 secret[CURVE25519_KEY_SIZE],
+		     const u8 basepoint[CURVE25519_KEY_SIZE])
+{
+	curve25519_arm64(mypublic, secret, basepoint);
+}
+EXPORT_SYMBOL(curve25519_arch);
+
+void curve25519_base_arch(u8 pub[CURVE25519_KEY_SIZE],
+			  const u8 secret[CURVE25519_KEY_SIZE])
+{
+	curve25519_arm64(pub, secret, curve25519_base_point);
+}
+EXPORT_SYMBOL(curve25519_base_arch);
+
+static int curve25519_set_secret(struct crypto_kpp *tfm, const void *buf,
+				 unsigned int len)
+{
+	u8 *secret = kpp_tfm_ctx(tfm);
+
+	if (!len)
+		curve25519_generate_secret(secret);
+	else if (len == CURVE25519_KEY_SIZE &&
+		 crypto_memneq(buf, curve25519_null_point, CURVE25519_KEY_SIZE))
+		memcpy(secret, buf, CURVE25519_KEY_SIZE);
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static int curve25519_compute_value(struct kpp_request *req)
+{
+	struct crypto_kpp *tfm = crypto_kpp_reqtfm(req);
+	const u8 *secret = kpp_tfm_ctx(tfm);
+	u8 public_key[CURVE25519_KEY_SIZE];
+	u8 buf[CURVE25519_KEY_SIZE];
+	int copied, nbytes;
+	u8 const *bp;
+
+	if (req->src) {
+		copied = sg_copy_to_buffer(req->src,
+					   sg_nents_for_len(req->src,
+							    CURVE25519_KEY_SIZE),
+					   public_key, CURVE25519_KEY_SIZE);
+		if (copied != CURVE25519_KEY_SIZE)
+			return -EINVAL;
+		bp = public_key;
+	} else {
+		bp = curve25519_base_point;
+	}
+
+	curve25519_arm64(buf, secret, bp);
+
+	/* might want less than we've got */
+	nbytes = min_t(size_t, CURVE25519_KEY_SIZE, req->dst_len);
+	copied = sg_copy_from_buffer(req->dst, sg_nents_for_len(req->dst,
+								nbytes),
+				     buf, nbytes);
+	if (copied != nbytes)
+		return -EINVAL;
+	return 0;
+}
+
+static unsigned int curve25519_max_size(struct crypto_kpp *tfm)
+{
+	return CURVE25519_KEY_SIZE;
+}
+
+static struct kpp_alg curve25519_alg = {
+	.base.cra_name		= "curve25519",
+	.base.cra_driver_name	= "curve25519-arm64",
+	.base.cra_priority	= 200,
+	.base.cra_module	= THIS_MODULE,
+	.base.cra_ctxsize	= CURVE25519_KEY_SIZE,
+
+	.set_secret		= curve25519_set_secret,
+	.generate_public_key	= curve25519_compute_value,
+	.compute_shared_secret	= curve25519_compute_value,
+	.max_size		= curve25519_max_size,
+};
+
+static int __init curve25519_mod_init(void)
+{
+	return IS_REACHABLE(CONFIG_CRYPTO_KPP) ?
+		crypto_register_kpp(&curve25519_alg) : 0;
+}
+
+static void __exit curve25519_mod_exit(void)
+{
+	if (IS_REACHABLE(CONFIG_CRYPTO_KPP))
+		crypto_unregister_kpp(&curve25519_alg);
+}
+
+module_init(curve25519_mod_init);
+module_exit(curve25519_mod_exit);
+
+MODULE_ALIAS_CRYPTO("curve25519");
+MODULE_ALIAS_CRYPTO("curve25519-arm64");
+MODULE_LICENSE("GPL v2");
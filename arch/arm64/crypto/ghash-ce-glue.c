@@ -30,6 +30,13 @@ MODULE_ALIAS_CRYPTO("ghash");
 #define GHASH_DIGEST_SIZE	16
 #define GCM_IV_SIZE		12
 
+/*
+ * Associated data up to this size is hashed in the same NEON section as the
+ * payload, which is what keeps small packets (e.g., ESP with an 8 or 12
+ * byte AAD) from paying for a separate scatterwalk and NEON section.
+ */
+#define GCM_AAD_INLINE_SIZE	(4 * GHASH_BLOCK_SIZE)
+
 struct ghash_key {
 	be128			k;
 	u64			h[][2];
@@ -338,6 +345,15 @@ static void gcm_calculate_auth_mac(struct aead_request *req, u64 dg[])
 	}
 }
 
+static int gcm_load_small_aad(struct aead_request *req, u8 aad[])
+{
+	unsigned int len = req->assoclen;
+
+	scatterwalk_map_and_copy(aad, req->src, 0, len, 0);
+	memset(aad + len, 0, round_up(len, GHASH_BLOCK_SIZE) - len);
+	return DIV_ROUND_UP(len, GHASH_BLOCK_SIZE);
+}
+
 static int gcm_encrypt(struct aead_request *req)
 {
 	struct crypto_aead *aead = crypto_aead_reqtfm(req);
@@ -346,6 +362,9 @@ static int gcm_encrypt(struct aead_request *req)
 	struct skcipher_walk walk;
 	u8 buf[AES_BLOCK_SIZE];
 	u8 iv[AES_BLOCK_SIZE];
+	u8 aad[GCM_AAD_INLINE_SIZE];
+	bool simd = crypto_simd_usable();
+	int aad_blocks = 0;
 	u64 dg[2] = {};
 	be128 lengths;
 	u8 *tag;
@@ -354,7 +373,9 @@ static int gcm_encrypt(struct aead_request *req)
 	lengths.a = cpu_to_be64(req->assoclen * 8);
 	lengths.b = cpu_to_be64(req->cryptlen * 8);
 
-	if (req->assoclen)
+	if (simd && req->assoclen && req->assoclen <= GCM_AAD_INLINE_SIZE)
+		aad_blocks = gcm_load_small_aad(req, aad);
+	else if (req->assoclen)
 		gcm_calculate_auth_mac(req, dg);
 
 	memcpy(iv, req->iv, GCM_IV_SIZE);
@@ -362,7 +383,7 @@ static int gcm_encrypt(struct aead_request *req)
 
 	err = skcipher_walk_aead_encrypt(&walk, req, false);
 
-	if (likely(crypto_simd_usable())) {
+	if (likely(simd)) {
 		do {
 			const u8 *src = walk.src.virt.addr;
 			u8 *dst = walk.dst.virt.addr;
@@ -379,6 +400,11 @@ static int gcm_encrypt(struct aead_request *req)
 			}
 
 			kernel_neon_begin();
+			if (aad_blocks) {
+				pmull_ghash_update_p64(aad_blocks, dg, aad,
+						       ctx->ghash_key.h, NULL);
+				aad_blocks = 0;
+			}
 			pmull_gcm_encrypt(nbytes, dst, src, ctx->ghash_key.h,
 					  dg, iv, ctx->aes_key.key_enc, nrounds,
 					  tag);
@@ -460,6 +486,9 @@ static int gcm_decrypt(struct aead_request *req)
 	struct skcipher_walk walk;
 	u8 buf[AES_BLOCK_SIZE];
 	u8 iv[AES_BLOCK_SIZE];
+	u8 aad[GCM_AAD_INLINE_SIZE];
+	bool simd = crypto_simd_usable();
+	int aad_blocks = 0;
 	u64 dg[2] = {};
 	be128 lengths;
 	u8 *tag;
@@ -468,7 +497,9 @@ static int gcm_decrypt(struct aead_request *req)
 	lengths.a = cpu_to_be64(req->assoclen * 8);
 	lengths.b = cpu_to_be64((req->cryptlen - authsize) * 8);
 
-	if (req->assoclen)
+	if (simd && req->assoclen && req->assoclen <= GCM_AAD_INLINE_SIZE)
+		aad_blocks = gcm_load_small_aad(req, aad);
+	else if (req->assoclen)
 		gcm_calculate_auth_mac(req, dg);
 
 	memcpy(iv, req->iv, GCM_IV_SIZE);
@@ -476,7 +507,7 @@ static int gcm_decrypt(struct aead_request *req)
 
 	err = skcipher_walk_aead_decrypt(&walk, req, false);
 
-	if (likely(crypto_simd_usable())) {
+	if (likely(simd)) {
 		do {
 			const u8 *src = walk.src.virt.addr;
 			u8 *dst = walk.dst.virt.addr;
@@ -493,6 +524,11 @@ static int gcm_decrypt(struct aead_request *req)
 			}
 
 			kernel_neon_begin();
+			if (aad_blocks) {
+				pmull_ghash_update_p64(aad_blocks, dg, aad,
+						       ctx->ghash_key.h, NULL);
+				aad_blocks = 0;
+			}
 			pmull_gcm_decrypt(nbytes, dst, src, ctx->ghash_key.h,
 					  dg, iv, ctx->aes_key.key_enc, nrounds,
 					  tag);
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * POLYVAL using ARMv8 PMULL instructions, for use by HCTR2.
+ */
+
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+#include <crypto/algapi.h>
+#include <crypto/internal/hash.h>
+#include <crypto/internal/simd.h>
+#include <crypto/polyval.h>
+#include <linux/cpufeature.h>
+#include <linux/crypto.h>
+#include <linux/module.h>
+
+MODULE_DESCRIPTION("POLYVAL using ARMv8 Crypto Extensions");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("polyval");
+
+#define NUM_KEY_POWERS	4
+
+struct polyval_tfm_ctx {
+	/* H^4, H^3, H^2 and H, the order pmull_polyval_update() wants */
+	u8 key_powers[NUM_KEY_POWERS][POLYVAL_BLOCK_SIZE];
+};
+
+struct polyval_desc_ctx {
+	u8 buffer[POLYVAL_BLOCK_SIZE];
+	u32 bytes;
+};
+
+asmlinkage void pmull_polyval_mul(u8 *op1, const u8 *op2);
+asmlinkage void pmull_polyval_update(const struct polyval_tfm_ctx *keys,
+				     const u8 *in, size_t nblocks,
+				     u8 *accumulator);
+
+/* Constant time 64x64 -> 128 bit carryless multiply, for the fallback */
+static void clmul64(u64 a, u64 b, u64 *lo, u64 *hi)
+{
+	u64 l = a & -(b & 1), h = 0;
+	int i;
+
+	for (i = 1; i < 64; i++) {
+		u64 mask = -((b >> i) & 1);
+
+		l ^= (a << i) & mask;
+		h ^= (a >> (64 - i)) & mask;
+	}
+	*lo = l;
+	*hi = h;
+}
+
+/* op1 = dot(op1, op2), the same computation as pmull_polyval_mul() */
+static void polyval_mul_generic(u8 *op1, const u8 *op2)
+{
+	u64 a0 = get_unaligned_le64(op1), a1 = get_unaligned_le64(op1 + 8);
+	u64 b0 = get_unaligned_le64(op2), b1 = get_unaligned_le64(op2 + 8);
+	const u64 gstar = 0xc200000000000000ULL;
+	u64 p0, p1, p2, p3, lo, hi;
+
+	clmul64(a0, b0, &p0, &p1);
+	clmul64(a1, b1, &p2, &p3);
+	clmul64(a0, b1, &lo, &hi);
+	p1 ^= lo;
+	p2 ^= hi;
+	clmul64(a1, b0, &lo, &hi);
+	p1 ^= lo;
+	p2 ^= hi;
+
+	/* Montgomery reduction, see polyval-ce-core.S */
+	clmul64(p0, gstar, &lo, &hi);
+	p1 ^= lo;
+	p2 ^= p0 ^ hi;
+	clmul64(p1, gstar, &lo, &hi);
+	p2 ^= lo;
+	p3 ^= p1 ^ hi;
+
+	put_unaligned_le64(p2, op1);
+	put_unaligned_le64(p3, op1 + 8);
+}
+
+static void internal_polyval_update(const struct polyval_tfm_ctx *keys,
+				    const u8 *in, size_t nblocks,
+				    u8 *accumulator)
+{
+	if (likely(crypto_simd_usable())) {
+		kernel_neon_begin();
+		pmull_polyval_update(keys, in, nblocks, accumulator);
+		kernel_neon_end();
+		return;
+	}
+
+	while (nblocks--) {
+		crypto_xor(accumulator, in, POLYVAL_BLOCK_SIZE);
+		polyval_mul_generic(accumulator,
+				    keys->key_powers[NUM_KEY_POWERS - 1]);
+		in += POLYVAL_BLOCK_SIZE;
+	}
+}
+
+static void internal_polyval_mul(u8 *op1, const u8 *op2)
+{
+	if (likely(crypto_simd_usable())) {
+		kernel_neon_begin();
+		pmull_polyval_mul(op1, op2);
+		kernel_neon_end();
+	} else {
+		polyval_mul_generic(op1, op2);
+	}
+}
+
+static int polyval_arm64_setkey(struct crypto_shash *tfm,
+				const u8 *key, unsigned int keylen)
+{
+	struct polyval_tfm_ctx *tctx = crypto_shash_ctx(tfm);
+	int i;
+
+	if (keylen != POLYVAL_BLOCK_SIZE)
+		return -EINVAL;
+
+	memcpy(tctx->key_powers[NUM_KEY_POWERS - 1], key, POLYVAL_BLOCK_SIZE);
+
+	for (i = NUM_KEY_POWERS - 2; i >= 0; i--) {
+		memcpy(tctx->key_powers[i], key, POLYVAL_BLOCK_SIZE);
+		internal_polyval_mul(tctx->key_powers[i],
+				     tctx->key_powers[i + 1]);
+	}
+
+	return 0;
+}
+
+static int polyval_arm64_init(struct shash_desc *desc)
+{
+	struct polyval_desc_ctx *dctx = shash_desc_ctx(desc);
+
+	memset(dctx, 0, sizeof(*dctx));
+
+	return 0;
+}
+
+static int polyval_arm64_update(struct shash_desc *desc,
+				const u8 *src, unsigned int srclen)
+{
+	struct polyval_desc_ctx *dctx = shash_desc_ctx(desc);
+	const struct polyval_tfm_ctx *tctx = crypto_shash_ctx(desc->tfm);
+	unsigned int nblocks;
+	unsigned int n;
+
+	/* The buffer holds the accumulator with any partial block xored in */
+	if (dctx->bytes) {
+		n = min(srclen, POLYVAL_BLOCK_SIZE - dctx->bytes);
+		crypto_xor(dctx->buffer + dctx->bytes, src, n);
+		dctx->bytes += n;
+		src += n;
+		srclen -= n;
+
+		if (dctx->bytes < POLYVAL_BLOCK_SIZE)
+			return 0;
+
+		internal_polyval_mul(dctx->buffer,
+				     tctx->key_powers[NUM_KEY_POWERS - 1]);
+		dctx->bytes = 0;
+	}
+
+	while (srclen >= POLYVAL_BLOCK_SIZE) {
+		/* Allow rescheduling every 4K bytes. */
+		nblocks = min(srclen, 4096U) / POLYVAL_BLOCK_SIZE;
+		internal_polyval_update(tctx, src, nblocks, dctx->buffer);
+		srclen -= nblocks * POLYVAL_BLOCK_SIZE;
+		src += nblocks * POLYVAL_BLOCK_SIZE;
+	}
+
+	if (srclen) {
+		crypto_xor(dctx->buffer, src, srclen);
+		dctx->bytes = srclen;
+	}
+
+	return 0;
+}
+
+static int polyval_arm64_final(struct shash_desc *desc, u8 *dst)
+{
+	struct polyval_desc_ctx *dctx = shash_desc_ctx(desc);
+	const struct polyval_tfm_ctx *tctx = crypto_shash_ctx(desc->tfm);
+
+	/* A trailing partial block is implicitly zero padded */
+	if (dctx->bytes)
+		internal_polyval_mul(dctx->buffer,
+				     tctx->key_powers[NUM_KEY_POWERS - 1]);
+
+	memcpy(dst, dctx->buffer, POLYVAL_BLOCK_SIZE);
+
+	return 0;
+}
+
+static struct shash_alg polyval_alg = {
+	.digestsize	= POLYVAL_DIGEST_SIZE,
+	.init		= polyval_arm64_init,
+	.update		= polyval_arm64_update,
+	.final		= polyval_arm64_final,
+	.setkey		= polyval_arm64_setkey,
+	.descsize	= sizeof(struct polyval_desc_ctx),
+	.base		= {
+		.cra_name		= "polyval",
+		.cra_driver_name	= "polyval-ce",
+		.cra_priority		= 200,
+		.cra_blocksize		= POLYVAL_BLOCK_SIZE,
+		.cra_ctxsize		= sizeof(struct polyval_tfm_ctx),
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static int __init polyval_ce_mod_init(void)
+{
+	return crypto_register_shash(&polyval_alg);
+}
+
+static void __exit polyval_ce_mod_exit(void)
+{
+	crypto_unregister_shash(&polyval_alg);
+}
+
+module_cpu_feature_match(PMULL, polyval_ce_mod_init);
+module_exit(polyval_ce_mod_exit);
@@ -1234,6 +1234,45 @@ static bool has_no_hw_prefetch(const struct arm64_cpu_capabilities *entry, int _
 		MIDR_CPU_VAR_REV(1, MIDR_REVISION_MASK));
 }
 
+/*
+ * In-order cores get little help from the hardware prefetcher on the
+ * ldp/stp streams generated by memcpy() and the uaccess copy routines,
+ * so patch in an explicit PRFM a few cache lines ahead for them. The
+ * copy routines are shared by all CPUs, so on big.LITTLE parts (e.g.
+ * A53 + A72) the little cluster decides: the big cores retire the extra
+ * hint alongside the loads, while the little ones stall without it.
+ */
+static const struct midr_range copy_prefetch_cpus[] = {
+	MIDR_ALL_VERSIONS(MIDR_CORTEX_A35),
+	MIDR_ALL_VERSIONS(MIDR_CORTEX_A53),
+	MIDR_ALL_VERSIONS(MIDR_CORTEX_A55),
+	{},
+};
+
+static int __copy_prefetch_forced; /* 0: not forced, >0: forced on, <0: forced off */
+
+static bool has_copy_prefetch(const struct arm64_cpu_capabilities *entry,
+			      int __unused)
+{
+	if (__copy_prefetch_forced)
+		return __copy_prefetch_forced > 0;
+
+	return is_midr_in_range_list(read_cpuid_id(), copy_prefetch_cpus);
+}
+
+static int __init parse_copy_prefetch(char *str)
+{
+	bool enabled;
+	int ret = strtobool(str, &enabled);
+
+	if (ret)
+		return ret;
+
+	__copy_prefetch_forced = enabled ? 1 : -1;
+	return 0;
+}
+early_param("arm64.copy_prefetch", parse_copy_prefetch);
+
 static bool has_no_fpsimd(const struct arm64_cpu_capabilities *entry, int __unused)
 {
 	u64 pfr0 = read_sanitised_ftr_reg(SYS_ID_AA64PFR0_EL1);
@@ -1791,6 +1830,13 @@ static const struct arm64_cpu_capabilities arm64_features[] = {
 		.type = ARM64_CPUCAP_WEAK_LOCAL_CPU_FEATURE,
 		.matches = has_no_hw_prefetch,
 	},
+	{
+		.desc = "Software prefetching in memcpy/uaccess routines",
+		.capability = ARM64_HAS_COPY_PREFETCH,
+		/* Enabled if any CPU wants it, a tuning choice for late CPUs */
+		.type = ARM64_CPUCAP_WEAK_LOCAL_CPU_FEATURE,
+		.matches = has_copy_prefetch,
+	},
 #ifdef CONFIG_ARM64_UAO
 	{
 		.desc = "User Access Override",
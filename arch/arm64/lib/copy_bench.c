@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Throughput benchmark for the arm64 memcpy(), copy_page() and uaccess
+ * copy routines.
+ *
+ * Loading the module runs the benchmark once in the context of the
+ * loading process (a user buffer is mapped into its address space for
+ * the uaccess copies) and reports MB/s per copy size, together with the
+ * copy variant that was patched in at boot. Comparing variants is done
+ * by booting with arm64.copy_prefetch=on/off. On big.LITTLE systems, pin
+ * the loading process to one cluster (e.g. taskset -c 0 insmod ...) to
+ * measure that cluster's cores.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+
+#include <asm/cpufeature.h>
+#include <asm/cputype.h>
+#include <asm/page.h>
+
+#define COPY_BENCH_ORDER	8
+#define COPY_BENCH_BUF_SIZE	(PAGE_SIZE << COPY_BENCH_ORDER)
+
+static unsigned int total_mb = 256;
+module_param(total_mb, uint, 0444);
+MODULE_PARM_DESC(total_mb, "Megabytes copied per measurement (default: 256)");
+
+static const size_t copy_bench_sizes[] = {
+	16, 64, 128, 256, 1024, 4096, 16384, 65536, 262144, COPY_BENCH_BUF_SIZE,
+};
+
+static u64 copy_bench_rate(u64 bytes, u64 ns)
+{
+	/* bytes/ns * 1000 == MB/s */
+	return ns ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static u64 copy_bench_iters(size_t size)
+{
+	return max_t(u64, 1, ((u64)total_mb << 20) / size);
+}
+
+static u64 bench_memcpy(void *dst, const void *src, size_t size)
+{
+	u64 i, n = copy_bench_iters(size);
+	u64 t0, t1;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		memcpy(dst, src, size);
+		barrier();
+	}
+	t1 = ktime_get_ns();
+
+	return copy_bench_rate(n * size, t1 - t0);
+}
+
+static u64 bench_to_user(void __user *dst, const void *src, size_t size)
+{
+	u64 i, n = copy_bench_iters(size);
+	u64 t0, t1;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < n; i++)
+		if (copy_to_user(dst, src, size))
+			return 0;
+	t1 = ktime_get_ns();
+
+	return copy_bench_rate(n * size, t1 - t0);
+}
+
+static u64 bench_from_user(void *dst, const void __user *src, size_t size)
+{
+	u64 i, n = copy_bench_iters(size);
+	u64 t0, t1;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < n; i++)
+		if (copy_from_user(dst, src, size))
+			return 0;
+	t1 = ktime_get_ns();
+
+	return copy_bench_rate(n * size, t1 - t0);
+}
+
+static u64 bench_copy_page(void *dst, const void *src)
+{
+	u64 i, n = copy_bench_iters(PAGE_SIZE);
+	unsigned int nr = 1U << COPY_BENCH_ORDER;
+	u64 t0, t1;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		unsigned long off = (i % nr) * PAGE_SIZE;
+
+		copy_page(dst + off, src + off);
+	}
+	t1 = ktime_get_ns();
+
+	return copy_bench_rate(n * PAGE_SIZE, t1 - t0);
+}
+
+static int __init copy_bench_init(void)
+{
+	struct page *src_pages, *dst_pages;
+	unsigned long user_addr;
+	void __user *ubuf;
+	void *src, *dst;
+	int i, ret = 0;
+
+	src_pages = alloc_pages(GFP_KERNEL, COPY_BENCH_ORDER);
+	dst_pages = alloc_pages(GFP_KERNEL, COPY_BENCH_ORDER);
+	if (!src_pages || !dst_pages) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	src = page_address(src_pages);
+	dst = page_address(dst_pages);
+	memset(src, 0x5a, COPY_BENCH_BUF_SIZE);
+	memset(dst, 0, COPY_BENCH_BUF_SIZE);
+
+	user_addr = vm_mmap(NULL, 0, COPY_BENCH_BUF_SIZE,
+			    PROT_READ | PROT_WRITE,
+			    MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (user_addr >= (unsigned long)(TASK_SIZE)) {
+		pr_warn("failed to allocate user memory\n");
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	ubuf = (void __user *)user_addr;
+
+	/* Fault the user buffer in so that the loops only measure copying. */
+	if (copy_to_user(ubuf, src, COPY_BENCH_BUF_SIZE)) {
+		ret = -EFAULT;
+		goto out_unmap;
+	}
+
+	pr_info("variant: %s, cpu %d (MIDR %08x)\n",
+		cpus_have_const_cap(ARM64_HAS_COPY_PREFETCH) ?
+		"ldp/stp + prfm" : "ldp/stp",
+		raw_smp_processor_id(), read_cpuid_id());
+	pr_info("copy_page: %llu MB/s\n", bench_copy_page(dst, src));
+
+	for (i = 0; i < ARRAY_SIZE(copy_bench_sizes); i++) {
+		size_t size = copy_bench_sizes[i];
+
+		pr_info("%8zu bytes: memcpy %llu MB/s, copy_to_user %llu MB/s, copy_from_user %llu MB/s\n",
+			size, bench_memcpy(dst, src, size),
+			bench_to_user(ubuf, src, size),
+			bench_from_user(dst, ubuf, size));
+		cond_resched();
+	}
+
+out_unmap:
+	vm_munmap(user_addr, COPY_BENCH_BUF_SIZE);
+out_free:
+	if (dst_pages)
+		__free_pages(dst_pages, COPY_BENCH_ORDER);
+	if (src_pages)
+		__free_pages(src_pages, COPY_BENCH_ORDER);
+
+	return ret;
+}
+
+static void __exit copy_bench_exit(void)
+{
+}
+
+module_init(copy_bench_init);
+module_exit(copy_bench_exit);
+
+MODULE_DESCRIPTION("arm64 memcpy/copy_page/uaccess throughput benchmark");
+MODULE_LICENSE("GPL");
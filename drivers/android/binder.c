@@ -46,6 +46,7 @@
 #include <linux/file.h>
 #include <linux/freezer.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
@@ -190,6 +191,30 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	atomic_inc(&binder_stats.obj_created[type]);
 }
 
+/*
+ * Latency histograms in log2 buckets of microseconds: bucket 0 counts the
+ * latencies below 1us, bucket i those in [2^(i-1), 2^i) us and the last
+ * bucket all the longer ones.
+ */
+#define BINDER_LAT_BUCKETS 16
+
+struct binder_lat_hist {
+	atomic_t count[BINDER_LAT_BUCKETS];
+};
+
+/* Allocation of the buffer of a transaction in the target process */
+static struct binder_lat_hist binder_alloc_lat;
+/* From sending a transaction until a thread reads it */
+static struct binder_lat_hist binder_txn_lat;
+
+static inline void binder_lat_hist_add(struct binder_lat_hist *hist,
+				       u64 start_ns)
+{
+	u64 us = div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC);
+
+	atomic_inc(&hist->count[min_t(int, fls64(us), BINDER_LAT_BUCKETS - 1)]);
+}
+
 struct binder_transaction_log binder_transaction_log;
 struct binder_transaction_log binder_transaction_log_failed;
 
@@ -588,6 +613,7 @@ struct binder_transaction {
 	kuid_t	sender_euid;
 	struct list_head fd_fixups;
 	binder_uintptr_t security_ctx;
+	u64	start_ns;
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -2862,6 +2888,7 @@ static void binder_transaction(struct binder_proc *proc,
 	int t_debug_id = atomic_inc_return(&binder_last_id);
 	char *secctx = NULL;
 	u32 secctx_sz = 0;
+	u64 alloc_start_ns;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->debug_id = t_debug_id;
@@ -3065,6 +3092,7 @@ static void binder_transaction(struct binder_proc *proc,
 		return_error_line = __LINE__;
 		goto err_alloc_t_failed;
 	}
+	t->start_ns = ktime_get_ns();
 	INIT_LIST_HEAD(&t->fd_fixups);
 	binder_stats_created(BINDER_STAT_TRANSACTION);
 	spin_lock_init(&t->lock);
@@ -3135,9 +3163,11 @@ static void binder_transaction(struct binder_proc *proc,
 
 	trace_binder_transaction(reply, t, target_node);
 
+	alloc_start_ns = ktime_get_ns();
 	t->buffer = binder_alloc_new_buf(&target_proc->alloc, tr->data_size,
 		tr->offsets_size, extra_buffers_size,
 		!reply && (t->flags & TF_ONE_WAY), current->tgid);
+	binder_lat_hist_add(&binder_alloc_lat, alloc_start_ns);
 	if (IS_ERR(t->buffer)) {
 		/*
 		 * -ESRCH indicates VMA cleared. The target is dying.
@@ -4537,6 +4567,7 @@ static int binder_thread_read(struct binder_proc *proc,
 		ptr += trsize;
 
 		trace_binder_transaction_received(t);
+		binder_lat_hist_add(&binder_txn_lat, t->start_ns);
 		binder_stat_br(proc, thread, cmd);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "%d:%d %s %d %d:%d, cmd %d size %zd-%zd ptr %016llx-%016llx\n",
@@ -5875,6 +5906,25 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	}
 }
 
+static void print_binder_lat_hist(struct seq_file *m, const char *name,
+				  struct binder_lat_hist *hist)
+{
+	int i;
+
+	seq_printf(m, "%s:\n", name);
+	for (i = 0; i < BINDER_LAT_BUCKETS; i++) {
+		int count = atomic_read(&hist->count[i]);
+
+		if (!count)
+			continue;
+		if (i < BINDER_LAT_BUCKETS - 1)
+			seq_printf(m, "  <%lluus: %d\n", 1ULL << i, count);
+		else
+			seq_printf(m, "  >=%lluus: %d\n", 1ULL << (i - 1),
+				   count);
+	}
+}
+
 static void print_binder_proc_stats(struct seq_file *m,
 				    struct binder_proc *proc)
 {
@@ -5986,6 +6036,8 @@ int binder_stats_show(struct seq_file *m, void *unused)
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	print_binder_lat_hist(m, "alloc latency", &binder_alloc_lat);
+	print_binder_lat_hist(m, "transaction latency", &binder_txn_lat);
 
 	mutex_lock(&binder_procs_lock);
 	hlist_for_each_entry(proc, &binder_procs, proc_node)
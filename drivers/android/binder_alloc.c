@@ -123,6 +123,79 @@ static void binder_insert_allocated_buffer_locked(
 	rb_insert_color(&new_buffer->rb_node, &alloc->allocated_buffers);
 }
 
+static void binder_merge_free_buffer(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer);
+
+static int binder_alloc_size_class(size_t size)
+{
+	if (size > BINDER_ALLOC_CLASS_MAX)
+		return -1;
+	if (size <= BINDER_ALLOC_CLASS_MIN)
+		return 0;
+	return fls_long((size - 1) / BINDER_ALLOC_CLASS_MIN);
+}
+
+static size_t binder_alloc_class_size(int class)
+{
+	return BINDER_ALLOC_CLASS_MIN << class;
+}
+
+/*
+ * Keep a freed buffer of a class size on the free list of its class. It
+ * keeps the pages it shares with its neighbours, and it is not merged with
+ * free neighbours until the free lists get flushed.
+ */
+static bool binder_alloc_class_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer,
+				   size_t buffer_size)
+{
+	int class = binder_alloc_size_class(buffer_size);
+
+	if (class < 0 || buffer_size != binder_alloc_class_size(class) ||
+	    alloc->class_count[class] >= BINDER_ALLOC_CLASS_CACHED)
+		return false;
+
+	buffer->cached = 1;
+	list_add(&buffer->class_entry, &alloc->class_free[class]);
+	alloc->class_count[class]++;
+	return true;
+}
+
+static struct binder_buffer *binder_alloc_class_get(struct binder_alloc *alloc,
+						    int class)
+{
+	struct binder_buffer *buffer;
+
+	buffer = list_first_entry_or_null(&alloc->class_free[class],
+					  struct binder_buffer, class_entry);
+	if (!buffer)
+		return NULL;
+
+	list_del(&buffer->class_entry);
+	alloc->class_count[class]--;
+	buffer->cached = 0;
+	return buffer;
+}
+
+/*
+ * Return the buffers on the size class free lists to the free space.
+ * Returns %true if there were any.
+ */
+static bool binder_alloc_class_flush(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer;
+	bool flushed = false;
+	int class;
+
+	for (class = 0; class < BINDER_ALLOC_CLASSES; class++) {
+		while ((buffer = binder_alloc_class_get(alloc, class))) {
+			binder_merge_free_buffer(alloc, buffer);
+			flushed = true;
+		}
+	}
+	return flushed;
+}
+
 static struct binder_buffer *binder_alloc_prepare_to_free_locked(
 		struct binder_alloc *alloc,
 		uintptr_t user_ptr)
@@ -178,6 +251,22 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+/*
+ * Drop the new pages from index @first on that could not be mapped. Returns
+ * the address of the first page dropped.
+ */
+static void __user *binder_drop_new_pages(struct binder_alloc *alloc,
+					  size_t first, size_t nr_pages)
+{
+	size_t index;
+
+	for (index = first; index < first + nr_pages; index++) {
+		__free_page(alloc->pages[index].page_ptr);
+		alloc->pages[index].page_ptr = NULL;
+	}
+	return alloc->buffer + first * PAGE_SIZE;
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void __user *start, void __user *end)
 {
@@ -186,6 +275,9 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	struct binder_lru_page *page;
 	struct vm_area_struct *vma = NULL;
 	struct mm_struct *mm = NULL;
+	struct page *new_pages[BINDER_MAP_PAGES_BATCH];
+	unsigned long nr_new = 0;
+	size_t first_new = 0;
 	bool need_mm = false;
 
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -251,23 +343,37 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		if (!page->page_ptr) {
 			pr_err("%d: binder_alloc_buf failed for page at %pK\n",
 				alloc->pid, page_addr);
+			if (nr_new)
+				page_addr = binder_drop_new_pages(alloc,
+							first_new, nr_new);
 			goto err_alloc_page_failed;
 		}
 		page->alloc = alloc;
 		INIT_LIST_HEAD(&page->lru);
+		trace_binder_alloc_page_end(alloc, index);
 
-		user_page_addr = (uintptr_t)page_addr;
-		ret = vm_insert_page(vma, user_page_addr, page[0].page_ptr);
+		/* Map runs of consecutive new pages in one go. */
+		if (!nr_new)
+			first_new = index;
+		new_pages[nr_new++] = page->page_ptr;
+		if (nr_new < BINDER_MAP_PAGES_BATCH &&
+		    page_addr + PAGE_SIZE < end && !page[1].page_ptr)
+			continue;
+
+		user_page_addr = (uintptr_t)alloc->buffer +
+				 first_new * PAGE_SIZE;
+		ret = vm_insert_pages(vma, user_page_addr, new_pages, &nr_new);
 		if (ret) {
 			pr_err("%d: binder_alloc_buf failed to map page at %lx in userspace\n",
 			       alloc->pid, user_page_addr);
+			/* @nr_new is now the number of pages left unmapped */
+			page_addr = binder_drop_new_pages(alloc,
+					index + 1 - nr_new, nr_new);
 			goto err_vm_insert_page_failed;
 		}
 
 		if (index + 1 > alloc->pages_high)
 			alloc->pages_high = index + 1;
-
-		trace_binder_alloc_page_end(alloc, index);
 	}
 	if (mm) {
 		mmap_read_unlock(mm);
@@ -294,8 +400,6 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		continue;
 
 err_vm_insert_page_failed:
-		__free_page(page->page_ptr);
-		page->page_ptr = NULL;
 err_alloc_page_failed:
 err_page_ptr_cleared:
 		if (page_addr == start)
@@ -383,13 +487,14 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				int is_async,
 				int pid)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	struct rb_node *best_fit = NULL;
 	void __user *has_page_addr;
 	void __user *end_page_addr;
 	size_t size, data_offsets_size;
+	int class;
 	int ret;
 
 	if (!binder_alloc_get_vma(alloc)) {
@@ -415,6 +520,15 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				alloc->pid, extra_buffers_size);
 		return ERR_PTR(-EINVAL);
 	}
+
+	/* Pad 0-size buffers so they get assigned unique addresses */
+	size = max(size, sizeof(void *));
+
+	/* Round small buffers up to their size class so they can be cached */
+	class = binder_alloc_size_class(size);
+	if (class >= 0)
+		size = binder_alloc_class_size(class);
+
 	if (is_async &&
 	    alloc->free_async_space < size + sizeof(struct binder_buffer)) {
 		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -423,9 +537,18 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		return ERR_PTR(-ENOSPC);
 	}
 
-	/* Pad 0-size buffers so they get assigned unique addresses */
-	size = max(size, sizeof(void *));
+	if (class >= 0) {
+		buffer = binder_alloc_class_get(alloc, class);
+		if (buffer) {
+			binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+				     "%d: binder_alloc_buf size %zd got cached %pK\n",
+				      alloc->pid, size, buffer);
+			goto out_buffer;
+		}
+	}
 
+retry:
+	n = alloc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -441,6 +564,9 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			break;
 		}
 	}
+	/* Merge the cached buffers back into the free space and try again. */
+	if (best_fit == NULL && binder_alloc_class_flush(alloc))
+		goto retry;
 	if (best_fit == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
@@ -514,6 +640,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	}
 
 	rb_erase(best_fit, &alloc->free_buffers);
+out_buffer:
 	buffer->free = 0;
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
@@ -675,6 +802,14 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 			  buffer->user_data + buffer_size) & PAGE_MASK));
 
 	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
+	if (binder_alloc_class_put(alloc, buffer, buffer_size))
+		return;
+	binder_merge_free_buffer(alloc, buffer);
+}
+
+static void binder_merge_free_buffer(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer)
+{
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &alloc->buffers)) {
 		struct binder_buffer *next = binder_buffer_next(buffer);
@@ -725,6 +860,20 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 	mutex_unlock(&alloc->mutex);
 }
 
+/**
+ * binder_alloc_flush_cached() - merge cached buffers into the free space
+ * @alloc:	binder_alloc for this proc
+ *
+ * Return the buffers kept on the size class free lists to the free space,
+ * releasing the pages they no longer share with allocated buffers.
+ */
+void binder_alloc_flush_cached(struct binder_alloc *alloc)
+{
+	mutex_lock(&alloc->mutex);
+	binder_alloc_class_flush(alloc);
+	mutex_unlock(&alloc->mutex);
+}
+
 /**
  * binder_alloc_mmap_handler() - map virtual address space for proc
  * @alloc:	alloc structure for this proc
@@ -823,6 +972,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		binder_free_buf_locked(alloc, buffer);
 		buffers++;
 	}
+	binder_alloc_class_flush(alloc);
 
 	while (!list_empty(&alloc->buffers)) {
 		buffer = list_first_entry(&alloc->buffers,
@@ -1069,9 +1219,13 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	int class;
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (class = 0; class < BINDER_ALLOC_CLASSES; class++)
+		INIT_LIST_HEAD(&alloc->class_free[class]);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -18,15 +18,32 @@
 extern struct list_lru binder_alloc_lru;
 struct binder_transaction;
 
+/*
+ * Small buffers are allocated in power of two size classes, from
+ * BINDER_ALLOC_CLASS_MIN up to BINDER_ALLOC_CLASS_MAX. Up to
+ * BINDER_ALLOC_CLASS_CACHED freed buffers of each class are kept on a free
+ * list instead of being merged back into the free space.
+ */
+#define BINDER_ALLOC_CLASS_MIN		32
+#define BINDER_ALLOC_CLASSES		4
+#define BINDER_ALLOC_CLASS_MAX \
+	(BINDER_ALLOC_CLASS_MIN << (BINDER_ALLOC_CLASSES - 1))
+#define BINDER_ALLOC_CLASS_CACHED	32
+
+/* Maximum number of new pages mapped by a single vm_insert_pages() call */
+#define BINDER_MAP_PAGES_BATCH		16
+
 /**
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @class_entry:        entry in a size class free list (if @cached)
  * @free:               %true if buffer is free
  * @clear_on_free:      %true if buffer must be zeroed after use
  * @allow_user_free:    %true if user is allowed to free buffer
  * @async_transaction:  %true if buffer is in use for an async txn
  * @debug_id:           unique ID for debugging
+ * @cached:             %true if buffer is on a size class free list
  * @transaction:        pointer to associated struct binder_transaction
  * @target_node:        struct binder_node associated with this buffer
  * @data_size:          size of @transaction data
@@ -39,13 +56,17 @@ struct binder_transaction;
  */
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head class_entry;
+	};
 	unsigned free:1;
 	unsigned clear_on_free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
 	unsigned debug_id:28;
+	unsigned cached:1;
 
 	struct binder_transaction *transaction;
 
@@ -81,6 +102,8 @@ struct binder_lru_page {
  * @free_buffers:       rb tree of buffers available for allocation
  *                      sorted by size
  * @allocated_buffers:  rb tree of allocated buffers sorted by address
+ * @class_free:         free lists of cached buffers, by size class
+ * @class_count:        number of buffers on each of @class_free
  * @free_async_space:   VA space available for async buffers. This is
  *                      initialized at mmap time to 1/2 the full VA space
  * @pages:              array of binder_lru_page
@@ -101,6 +124,8 @@ struct binder_alloc {
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
+	struct list_head class_free[BINDER_ALLOC_CLASSES];
+	unsigned int class_count[BINDER_ALLOC_CLASSES];
 	size_t free_async_space;
 	struct binder_lru_page *pages;
 	size_t buffer_size;
@@ -131,6 +156,7 @@ binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
 extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 				  struct binder_buffer *buffer);
+extern void binder_alloc_flush_cached(struct binder_alloc *alloc);
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
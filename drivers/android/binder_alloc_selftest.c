@@ -89,16 +89,15 @@ static void pr_err_size_seq(size_t *sizes, int *seq)
 	pr_cont("\n");
 }
 
-static bool check_buffer_pages_allocated(struct binder_alloc *alloc,
-					 struct binder_buffer *buffer,
-					 size_t size)
+static bool check_pages_allocated(struct binder_alloc *alloc,
+				  void __user *user_data, size_t size)
 {
 	void __user *page_addr;
 	void __user *end;
 	int page_index;
 
-	end = (void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data + size);
-	page_addr = buffer->user_data;
+	end = (void __user *)PAGE_ALIGN((uintptr_t)user_data + size);
+	page_addr = user_data;
 	for (; page_addr < end; page_addr += PAGE_SIZE) {
 		page_index = (page_addr - alloc->buffer) / PAGE_SIZE;
 		if (!alloc->pages[page_index].page_ptr ||
@@ -112,6 +111,23 @@ static bool check_buffer_pages_allocated(struct binder_alloc *alloc,
 	return true;
 }
 
+static bool check_buffer_pages_allocated(struct binder_alloc *alloc,
+					 struct binder_buffer *buffer,
+					 size_t size)
+{
+	return check_pages_allocated(alloc, buffer->user_data, size);
+}
+
+static size_t binder_selftest_cached(struct binder_alloc *alloc)
+{
+	size_t count = 0;
+	int class;
+
+	for (class = 0; class < BINDER_ALLOC_CLASSES; class++)
+		count += alloc->class_count[class];
+	return count;
+}
+
 static void binder_selftest_alloc_buf(struct binder_alloc *alloc,
 				      struct binder_buffer *buffers[],
 				      size_t *sizes, int *seq)
@@ -129,15 +145,11 @@ static void binder_selftest_alloc_buf(struct binder_alloc *alloc,
 	}
 }
 
-static void binder_selftest_free_buf(struct binder_alloc *alloc,
-				     struct binder_buffer *buffers[],
-				     size_t *sizes, int *seq, size_t end)
+static void binder_selftest_check_lru(struct binder_alloc *alloc,
+				      size_t *sizes, int *seq, size_t end)
 {
 	int i;
 
-	for (i = 0; i < BUFFER_NUM; i++)
-		binder_alloc_free_buf(alloc, buffers[seq[i]]);
-
 	for (i = 0; i < end / PAGE_SIZE; i++) {
 		/**
 		 * Error message on a free page can be false positive
@@ -153,15 +165,33 @@ static void binder_selftest_free_buf(struct binder_alloc *alloc,
 	}
 }
 
-static void binder_selftest_free_page(struct binder_alloc *alloc)
+static void binder_selftest_free_buf(struct binder_alloc *alloc,
+				     struct binder_buffer *buffers[],
+				     size_t *sizes, int *seq, size_t end)
 {
 	int i;
+
+	for (i = 0; i < BUFFER_NUM; i++)
+		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+
+	binder_selftest_check_lru(alloc, sizes, seq, end);
+}
+
+static void binder_selftest_free_lru(void)
+{
 	unsigned long count;
 
 	while ((count = list_lru_count(&binder_alloc_lru))) {
 		list_lru_walk(&binder_alloc_lru, binder_alloc_free_page,
 			      NULL, count);
 	}
+}
+
+static void binder_selftest_free_page(struct binder_alloc *alloc)
+{
+	int i;
+
+	binder_selftest_free_lru();
 
 	for (i = 0; i < (alloc->buffer_size / PAGE_SIZE); i++) {
 		if (alloc->pages[i].page_ptr) {
@@ -271,6 +301,162 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/*
+ * Free the buffers in @seq order twice. The first time, the buffers of a
+ * class size are kept on their free lists with their pages and are handed
+ * back by the next allocation of the same size. The second time, they are
+ * flushed, which must leave the pages as if they had been freed directly.
+ */
+static void binder_selftest_class_alloc_free(struct binder_alloc *alloc,
+					     size_t *sizes, int *seq,
+					     size_t end)
+{
+	struct binder_buffer *buffers[BUFFER_NUM];
+	void __user *user_data[BUFFER_NUM];
+	size_t nr_cached = 0;
+	int i;
+
+	binder_selftest_alloc_buf(alloc, buffers, sizes, seq);
+	for (i = 0; i < BUFFER_NUM; i++) {
+		user_data[i] = buffers[i]->user_data;
+		if (sizes[i] <= BINDER_ALLOC_CLASS_MAX)
+			nr_cached++;
+	}
+	for (i = 0; i < BUFFER_NUM; i++)
+		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+
+	if (binder_selftest_cached(alloc) != nr_cached) {
+		pr_err_size_seq(sizes, seq);
+		pr_err("expect %zu cached buffers but are %zu\n", nr_cached,
+		       binder_selftest_cached(alloc));
+		binder_selftest_failures++;
+	}
+	for (i = 0; i < BUFFER_NUM; i++) {
+		if (sizes[i] <= BINDER_ALLOC_CLASS_MAX &&
+		    !check_pages_allocated(alloc, user_data[i], sizes[i])) {
+			pr_err_size_seq(sizes, seq);
+			binder_selftest_failures++;
+		}
+	}
+
+	binder_selftest_alloc_buf(alloc, buffers, sizes, seq);
+	for (i = 0; i < BUFFER_NUM; i++) {
+		if (sizes[i] <= BINDER_ALLOC_CLASS_MAX &&
+		    buffers[i]->user_data != user_data[i]) {
+			pr_err_size_seq(sizes, seq);
+			pr_err("expect cached buffer for size %zu\n", sizes[i]);
+			binder_selftest_failures++;
+		}
+	}
+
+	for (i = 0; i < BUFFER_NUM; i++)
+		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+	binder_alloc_flush_cached(alloc);
+	binder_selftest_check_lru(alloc, sizes, seq, end);
+	binder_selftest_free_page(alloc);
+}
+
+static void binder_selftest_class_free_seq(struct binder_alloc *alloc,
+					   size_t *sizes, int *seq,
+					   int index, size_t end)
+{
+	int i;
+
+	if (index == BUFFER_NUM) {
+		binder_selftest_class_alloc_free(alloc, sizes, seq, end);
+		return;
+	}
+	for (i = 0; i < BUFFER_NUM; i++) {
+		if (is_dup(seq, index, i))
+			continue;
+		seq[index] = i;
+		binder_selftest_class_free_seq(alloc, sizes, seq, index + 1,
+					       end);
+	}
+}
+
+/* Room left by one buffer of each size class. */
+#define CLASS_FILL(pages) ((pages) * PAGE_SIZE - (32 + 64 + 128 + 256))
+
+/*
+ * Allocate one buffer of each size class next to one that is too big to
+ * be cached, ending on a page boundary, and free them in all orders.
+ */
+static void binder_selftest_class(struct binder_alloc *alloc)
+{
+	size_t sizes[][BUFFER_NUM] = {
+		{ CLASS_FILL(1), 32, 64, 128, 256 },
+		{ 32, 64, CLASS_FILL(2), 128, 256 },
+		{ 32, 64, 128, 256, CLASS_FILL(2) },
+		{ 24, 40, 72, 200, CLASS_FILL(1) },
+	};
+	int seq[BUFFER_NUM] = {0};
+	size_t end;
+	int i, j;
+
+	BUILD_BUG_ON(BINDER_ALLOC_CLASS_MIN != 32 ||
+		     BINDER_ALLOC_CLASS_MAX != 256);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		end = 0;
+		for (j = 0; j < BUFFER_NUM; j++)
+			end += sizes[i][j];
+		binder_selftest_class_free_seq(alloc, sizes[i], seq, 0,
+					       PAGE_ALIGN(end));
+	}
+}
+
+/*
+ * Map a buffer of more than BINDER_MAP_PAGES_BATCH new pages around a page
+ * still on the lru, so that its runs of new pages are split both by the
+ * batch size and by the page already present.
+ */
+static void binder_selftest_map_pages(struct binder_alloc *alloc)
+{
+	size_t lru_index = BINDER_MAP_PAGES_BATCH + 1;
+	size_t size = (lru_index + 3) * PAGE_SIZE;
+	struct binder_buffer *buffers[3];
+	struct page *lru_page;
+
+	if (alloc->buffer_size < size)
+		return;
+
+	buffers[0] = binder_alloc_new_buf(alloc, lru_index * PAGE_SIZE, 0, 0,
+					  0, 0);
+	buffers[1] = binder_alloc_new_buf(alloc, PAGE_SIZE, 0, 0, 0, 0);
+	buffers[2] = binder_alloc_new_buf(alloc, 2 * PAGE_SIZE, 0, 0, 0, 0);
+	if (IS_ERR(buffers[0]) || IS_ERR(buffers[1]) || IS_ERR(buffers[2])) {
+		pr_err("map pages alloc failed\n");
+		binder_selftest_failures++;
+		return;
+	}
+
+	/* Free all pages but the one of the middle buffer, then lru it. */
+	binder_alloc_free_buf(alloc, buffers[0]);
+	binder_alloc_free_buf(alloc, buffers[2]);
+	binder_selftest_free_lru();
+	binder_alloc_free_buf(alloc, buffers[1]);
+	lru_page = alloc->pages[lru_index].page_ptr;
+	if (!lru_page || list_empty(&alloc->pages[lru_index].lru)) {
+		pr_err("expect lru at page index %zu\n", lru_index);
+		binder_selftest_failures++;
+	}
+
+	buffers[0] = binder_alloc_new_buf(alloc, size, 0, 0, 0, 0);
+	if (IS_ERR(buffers[0])) {
+		pr_err("map pages alloc of %zu failed\n", size);
+		binder_selftest_failures++;
+		return;
+	}
+	if (!check_buffer_pages_allocated(alloc, buffers[0], size) ||
+	    alloc->pages[lru_index].page_ptr != lru_page) {
+		pr_err("map pages of %zu failed\n", size);
+		binder_selftest_failures++;
+	}
+	binder_alloc_free_buf(alloc, buffers[0]);
+	binder_selftest_free_page(alloc);
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -278,7 +464,8 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
  * Allocate BUFFER_NUM buffers to cover all page alignment cases,
  * then free them in all orders possible. Check that pages are
  * correctly allocated, put onto lru when buffers are freed, and
- * are freed when binder_alloc_free_page is called.
+ * are freed when binder_alloc_free_page is called. Then check
+ * the size class caches and the batched mapping of new pages.
  */
 void binder_selftest_alloc(struct binder_alloc *alloc)
 {
@@ -291,6 +478,8 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 		goto done;
 	pr_info("STARTED\n");
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	binder_selftest_class(alloc);
+	binder_selftest_map_pages(alloc);
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
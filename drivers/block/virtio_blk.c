@@ -15,12 +15,16 @@
 #include <linux/blk-mq.h>
 #include <linux/blk-mq-virtio.h>
 #include <linux/numa.h>
+#include <linux/dim.h>
 #include <uapi/linux/virtio_ring.h>
 
 #define PART_BITS 4
 #define VQ_NAME_LEN 16
 #define MAX_DISCARD_SEGMENTS 256u
 
+/* Completions detached from the virtqueue at a time */
+#define VIRTBLK_DONE_BATCH 16
+
 static int major;
 static DEFINE_IDA(vd_index_ida);
 
@@ -30,6 +34,14 @@ struct virtio_blk_vq {
 	struct virtqueue *vq;
 	spinlock_t lock;
 	char name[VQ_NAME_LEN];
+
+	/* Completion moderation, under lock */
+	struct dim dim;
+	u16 dim_events;
+	u32 dim_comps;
+	u32 dim_lat_us;
+	/* Ask for the callback once this many buffers are used */
+	unsigned int cb_comps;
 } ____cacheline_aligned_in_smp;
 
 struct virtio_blk {
@@ -171,33 +183,98 @@ static inline void virtblk_request_done(struct request *req)
 	blk_mq_end_request(req, virtblk_result(vbr));
 }
 
+static bool virtblk_dim_enabled = true;
+module_param_named(dim, virtblk_dim_enabled, bool, 0444);
+MODULE_PARM_DESC(dim, "Adapt completion interrupt moderation to the load");
+
+static void virtblk_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct virtio_blk_vq *vbq = container_of(dim, struct virtio_blk_vq, dim);
+	struct dim_cq_moder moder = blk_dim_get_moderation(dim->profile_ix);
+	unsigned long flags;
+
+	/*
+	 * There is no device side coalescing to program, only the used
+	 * event index: the profile's completion count becomes the number of
+	 * used buffers the callback waits for. Neither the device nor the
+	 * profile has a timer; the wait is bounded only by the requests in
+	 * flight (see virtqueue_enable_cb_after()).
+	 */
+	spin_lock_irqsave(&vbq->lock, flags);
+	vbq->cb_comps = max_t(u16, moder.comps, 1);
+	dim->state = DIM_START_MEASURE;
+	spin_unlock_irqrestore(&vbq->lock, flags);
+}
+
+static void virtblk_dim_sample(struct virtio_blk_vq *vbq, unsigned int comps,
+			       u64 lat_ns)
+{
+	struct dim_sample sample = {};
+
+	vbq->dim_events++;
+	vbq->dim_comps += comps;
+	vbq->dim_lat_us += div_u64(lat_ns, NSEC_PER_USEC);
+
+	blk_dim_update_sample(vbq->dim_events, vbq->dim_comps,
+			      vbq->dim_lat_us, &sample);
+	blk_dim(&vbq->dim, sample);
+}
+
 static void virtblk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
 	bool req_done = false;
 	int qid = vq->index;
-	struct virtblk_req *vbr;
+	struct virtio_blk_vq *vbq = &vblk->vqs[qid];
+	void *vbrs[VIRTBLK_DONE_BATCH];
 	unsigned long flags;
-	unsigned int len;
+	unsigned int i, n;
+	unsigned int comps = 0;
+	u64 now = 0, lat_ns = 0;
 
-	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
+	if (virtblk_dim_enabled)
+		now = ktime_get_ns();
+
+	spin_lock_irqsave(&vbq->lock, flags);
 	do {
 		virtqueue_disable_cb(vq);
-		while ((vbr = virtqueue_get_buf(vblk->vqs[qid].vq, &len)) != NULL) {
-			struct request *req = blk_mq_rq_from_pdu(vbr);
-
-			if (likely(!blk_should_fake_timeout(req->q)))
-				blk_mq_complete_request(req);
+		while ((n = virtqueue_get_bufs(vbq->vq, vbrs, NULL,
+					       ARRAY_SIZE(vbrs)))) {
+			for (i = 0; i < n; i++) {
+				struct request *req = blk_mq_rq_from_pdu(vbrs[i]);
+
+				/* zero unless the queue keeps I/O statistics */
+				if (now && req->start_time_ns)
+					lat_ns += now - req->start_time_ns;
+
+				if (likely(!blk_should_fake_timeout(req->q)))
+					blk_mq_complete_request(req);
+			}
+			comps += n;
 			req_done = true;
 		}
 		if (unlikely(virtqueue_is_broken(vq)))
 			break;
-	} while (!virtqueue_enable_cb(vq));
+	} while (!(vbq->cb_comps > 1 ?
+		   virtqueue_enable_cb_after(vq, vbq->cb_comps) :
+		   virtqueue_enable_cb(vq)));
+
+	if (virtblk_dim_enabled && comps)
+		virtblk_dim_sample(vbq, comps, lat_ns);
 
 	/* In case queue is stopped waiting for more buffers. */
 	if (req_done)
 		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
-	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
+	spin_unlock_irqrestore(&vbq->lock, flags);
+}
+
+static void virtblk_cancel_dim(struct virtio_blk *vblk)
+{
+	int i;
+
+	for (i = 0; i < vblk->num_vqs; i++)
+		cancel_work_sync(&vblk->vqs[i].dim.work);
 }
 
 static void virtio_commit_rqs(struct blk_mq_hw_ctx *hctx)
@@ -507,7 +584,7 @@ static int init_vq(struct virtio_blk *vblk)
 
 	num_vqs = min_t(unsigned int, nr_cpu_ids, num_vqs);
 
-	vblk->vqs = kmalloc_array(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
+	vblk->vqs = kcalloc(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
 	if (!vblk->vqs)
 		return -ENOMEM;
 
@@ -533,6 +610,10 @@ static int init_vq(struct virtio_blk *vblk)
 	for (i = 0; i < num_vqs; i++) {
 		spin_lock_init(&vblk->vqs[i].lock);
 		vblk->vqs[i].vq = vqs[i];
+		vblk->vqs[i].dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+		vblk->vqs[i].dim.profile_ix = BLK_DIM_START_PROFILE;
+		vblk->vqs[i].cb_comps = 1;
+		INIT_WORK(&vblk->vqs[i].dim.work, virtblk_dim_work);
 	}
 	vblk->num_vqs = num_vqs;
 
@@ -909,6 +990,7 @@ static int virtblk_probe(struct virtio_device *vdev)
 	put_disk(vblk->disk);
 out_free_vq:
 	vdev->config->del_vqs(vdev);
+	virtblk_cancel_dim(vblk);
 	kfree(vblk->vqs);
 out_free_vblk:
 	kfree(vblk);
@@ -940,6 +1022,7 @@ static void virtblk_remove(struct virtio_device *vdev)
 
 	put_disk(vblk->disk);
 	vdev->config->del_vqs(vdev);
+	virtblk_cancel_dim(vblk);
 	kfree(vblk->vqs);
 
 	mutex_unlock(&vblk->vdev_mutex);
@@ -961,6 +1044,7 @@ static int virtblk_freeze(struct virtio_device *vdev)
 	blk_mq_quiesce_queue(vblk->disk->queue);
 
 	vdev->config->del_vqs(vdev);
+	virtblk_cancel_dim(vblk);
 	kfree(vblk->vqs);
 
 	return 0;
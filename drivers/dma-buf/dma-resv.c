@@ -187,7 +187,7 @@ EXPORT_SYMBOL(dma_resv_fini);
 int dma_resv_reserve_shared(struct dma_resv *obj, unsigned int num_fences)
 {
 	struct dma_resv_list *old, *new;
-	unsigned int i, j, k, max;
+	unsigned int i, j, k, max, live;
 
 	dma_resv_assert_held(obj);
 
@@ -196,9 +196,24 @@ int dma_resv_reserve_shared(struct dma_resv *obj, unsigned int num_fences)
 	if (old && old->shared_max) {
 		if ((old->shared_count + num_fences) <= old->shared_max)
 			return 0;
+
+		/*
+		 * Signaled fences are dropped from the new list below, so only
+		 * grow it if the unsignaled ones don't leave enough room.
+		 */
+		for (i = 0, live = 0; i < old->shared_count; ++i) {
+			struct dma_fence *fence;
+
+			fence = rcu_dereference_protected(old->shared[i],
+							  dma_resv_held(obj));
+			if (!dma_fence_is_signaled(fence))
+				++live;
+		}
+
+		if ((live + num_fences) <= old->shared_max)
+			max = old->shared_max;
 		else
-			max = max(old->shared_count + num_fences,
-				  old->shared_max * 2);
+			max = max(live + num_fences, old->shared_max * 2);
 	} else {
 		max = max(4ul, roundup_pow_of_two(num_fences));
 	}
@@ -226,14 +241,16 @@ int dma_resv_reserve_shared(struct dma_resv *obj, unsigned int num_fences)
 	new->shared_count = j;
 
 	/*
-	 * We are not changing the effective set of fences here so can
-	 * merely update the pointer to the new array; both existing
-	 * readers and new readers will see exactly the same set of
-	 * active (unsignaled) shared fences. Individual fences and the
-	 * old array are protected by RCU and so will not vanish under
-	 * the gaze of the rcu_read_lock() readers.
+	 * The signaled fences are dropped from the effective set, so bump the
+	 * sequence count to make rcu_read_lock() readers that are walking the
+	 * old array retry instead of mixing the two lists. Individual fences
+	 * and the old array are protected by RCU and so will not vanish under
+	 * their gaze.
 	 */
-	rcu_assign_pointer(obj->fence, new);
+	write_seqcount_begin(&obj->seq);
+	/* write_seqcount_begin provides the necessary memory barrier */
+	RCU_INIT_POINTER(obj->fence, new);
+	write_seqcount_end(&obj->seq);
 
 	if (!old)
 		return 0;
@@ -259,12 +276,15 @@ EXPORT_SYMBOL(dma_resv_reserve_shared);
  *
  * Add a fence to a shared slot, obj->lock must be held, and
  * dma_resv_reserve_shared() has been called.
+ *
+ * The fence replaces one from the same context or a signaled one, and
+ * signaled fences at the end of the list are dropped.
  */
 void dma_resv_add_shared_fence(struct dma_resv *obj, struct dma_fence *fence)
 {
 	struct dma_resv_list *fobj;
 	struct dma_fence *old;
-	unsigned int i, count;
+	unsigned int i, count, trimmed;
 
 	dma_fence_get(fence);
 
@@ -290,10 +310,26 @@ void dma_resv_add_shared_fence(struct dma_resv *obj, struct dma_fence *fence)
 
 replace:
 	RCU_INIT_POINTER(fobj->shared[i], fence);
+
+	/*
+	 * Trimming signaled fences from the end doesn't move any of the
+	 * others, so readers racing with us at worst still see a few
+	 * signaled fences.
+	 */
+	trimmed = count;
+	while (count && dma_fence_is_signaled(
+			rcu_dereference_protected(fobj->shared[count - 1],
+						  dma_resv_held(obj))))
+		--count;
+
 	/* pointer update must be visible before we extend the shared_count */
 	smp_store_mb(fobj->shared_count, count);
 
 	write_seqcount_end(&obj->seq);
+
+	while (trimmed > count)
+		dma_fence_put(rcu_dereference_protected(fobj->shared[--trimmed],
+							dma_resv_held(obj)));
 	dma_fence_put(old);
 }
 EXPORT_SYMBOL(dma_resv_add_shared_fence);
@@ -336,6 +372,123 @@ void dma_resv_add_excl_fence(struct dma_resv *obj, struct dma_fence *fence)
 }
 EXPORT_SYMBOL(dma_resv_add_excl_fence);
 
+/**
+ * dma_resv_iter_restart_unlocked - restart the unlocked iteration
+ * @cursor: the cursor with the current position
+ *
+ * Start again from the exclusive fence with a fresh snapshot of the shared
+ * fence list. Must be called with the RCU read side lock held.
+ */
+static void dma_resv_iter_restart_unlocked(struct dma_resv_iter *cursor)
+{
+	cursor->seq = read_seqcount_begin(&cursor->obj->seq);
+	cursor->index = -1;
+	cursor->shared_count = 0;
+	if (cursor->all_fences) {
+		cursor->fences = rcu_dereference(cursor->obj->fence);
+		if (cursor->fences)
+			cursor->shared_count = cursor->fences->shared_count;
+	} else {
+		cursor->fences = NULL;
+	}
+	cursor->is_restarted = true;
+}
+
+/**
+ * dma_resv_iter_walk_unlocked - walk to the next unsignaled fence
+ * @cursor: the cursor with the current position
+ *
+ * Drop the reference to the current fence and move on to the next one which
+ * isn't signaled yet. Fences with the signaled bit set are skipped without
+ * touching their reference count. Must be called with the RCU read side
+ * lock held.
+ */
+static void dma_resv_iter_walk_unlocked(struct dma_resv_iter *cursor)
+{
+	struct dma_fence *fence;
+
+	dma_fence_put(cursor->fence);
+	cursor->fence = NULL;
+
+	do {
+		if (cursor->index == -1) {
+			fence = rcu_dereference(cursor->obj->fence_excl);
+			cursor->index++;
+		} else if (cursor->fences &&
+			   cursor->index < cursor->shared_count) {
+			fence = rcu_dereference(
+				cursor->fences->shared[cursor->index++]);
+		} else {
+			return;
+		}
+
+		if (!fence ||
+		    test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags))
+			continue;
+
+		fence = dma_fence_get_rcu(fence);
+		if (!fence)
+			continue;
+
+		if (!dma_fence_is_signaled(fence)) {
+			cursor->fence = fence;
+			return;
+		}
+		dma_fence_put(fence);
+	} while (true);
+}
+
+/**
+ * dma_resv_iter_first_unlocked - first unsignaled fence from an unlocked
+ * dma_resv
+ * @cursor: the cursor with the current position
+ *
+ * Returns the first unsignaled fence with a reference held, or NULL if there
+ * is none. Subsequent fences are returned by dma_resv_iter_next_unlocked().
+ */
+struct dma_fence *dma_resv_iter_first_unlocked(struct dma_resv_iter *cursor)
+{
+	rcu_read_lock();
+	do {
+		dma_resv_iter_restart_unlocked(cursor);
+		dma_resv_iter_walk_unlocked(cursor);
+	} while (read_seqcount_retry(&cursor->obj->seq, cursor->seq));
+	rcu_read_unlock();
+
+	return cursor->fence;
+}
+EXPORT_SYMBOL(dma_resv_iter_first_unlocked);
+
+/**
+ * dma_resv_iter_next_unlocked - next unsignaled fence from an unlocked
+ * dma_resv
+ * @cursor: the cursor with the current position
+ *
+ * Returns the next unsignaled fence with a reference held, or NULL when the
+ * iteration is done. If the dma_resv was modified since the last fence was
+ * returned the iteration restarts from the beginning, which
+ * dma_resv_iter_is_restarted() reports. Fences waited on before the restart
+ * are signaled by then and skipped cheaply.
+ */
+struct dma_fence *dma_resv_iter_next_unlocked(struct dma_resv_iter *cursor)
+{
+	bool restart;
+
+	rcu_read_lock();
+	cursor->is_restarted = false;
+	restart = read_seqcount_retry(&cursor->obj->seq, cursor->seq);
+	do {
+		if (restart)
+			dma_resv_iter_restart_unlocked(cursor);
+		dma_resv_iter_walk_unlocked(cursor);
+		restart = true;
+	} while (read_seqcount_retry(&cursor->obj->seq, cursor->seq));
+	rcu_read_unlock();
+
+	return cursor->fence;
+}
+EXPORT_SYMBOL(dma_resv_iter_next_unlocked);
+
 /**
 * dma_resv_copy_fences - Copy all fences from src to dst.
 * @dst: the destination reservation object
@@ -533,94 +686,22 @@ long dma_resv_wait_timeout_rcu(struct dma_resv *obj,
 			       bool wait_all, bool intr,
 			       unsigned long timeout)
 {
-	struct dma_fence *fence;
-	unsigned seq, shared_count;
 	long ret = timeout ? timeout : 1;
-	int i;
-
-retry:
-	shared_count = 0;
-	seq = read_seqcount_begin(&obj->seq);
-	rcu_read_lock();
-	i = -1;
-
-	fence = rcu_dereference(obj->fence_excl);
-	if (fence && !test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags)) {
-		if (!dma_fence_get_rcu(fence))
-			goto unlock_retry;
-
-		if (dma_fence_is_signaled(fence)) {
-			dma_fence_put(fence);
-			fence = NULL;
-		}
-
-	} else {
-		fence = NULL;
-	}
-
-	if (wait_all) {
-		struct dma_resv_list *fobj = rcu_dereference(obj->fence);
-
-		if (fobj)
-			shared_count = fobj->shared_count;
-
-		for (i = 0; !fence && i < shared_count; ++i) {
-			struct dma_fence *lfence = rcu_dereference(fobj->shared[i]);
-
-			if (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT,
-				     &lfence->flags))
-				continue;
-
-			if (!dma_fence_get_rcu(lfence))
-				goto unlock_retry;
-
-			if (dma_fence_is_signaled(lfence)) {
-				dma_fence_put(lfence);
-				continue;
-			}
+	struct dma_resv_iter cursor;
+	struct dma_fence *fence;
 
-			fence = lfence;
+	dma_resv_iter_begin(&cursor, obj, wait_all);
+	dma_resv_for_each_fence_unlocked(&cursor, fence) {
+		ret = dma_fence_wait_timeout(fence, intr, ret);
+		if (ret <= 0)
 			break;
-		}
 	}
+	dma_resv_iter_end(&cursor);
 
-	rcu_read_unlock();
-	if (fence) {
-		if (read_seqcount_retry(&obj->seq, seq)) {
-			dma_fence_put(fence);
-			goto retry;
-		}
-
-		ret = dma_fence_wait_timeout(fence, intr, ret);
-		dma_fence_put(fence);
-		if (ret > 0 && wait_all && (i + 1 < shared_count))
-			goto retry;
-	}
 	return ret;
-
-unlock_retry:
-	rcu_read_unlock();
-	goto retry;
 }
 EXPORT_SYMBOL_GPL(dma_resv_wait_timeout_rcu);
 
-
-static inline int dma_resv_test_signaled_single(struct dma_fence *passed_fence)
-{
-	struct dma_fence *fence, *lfence = passed_fence;
-	int ret = 1;
-
-	if (!test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &lfence->flags)) {
-		fence = dma_fence_get_rcu(lfence);
-		if (!fence)
-			return -1;
-
-		ret = !!dma_fence_is_signaled(fence);
-		dma_fence_put(fence);
-	}
-	return ret;
-}
-
 /**
  * dma_resv_test_signaled_rcu - Test if a reservation object's
  * fences have been signaled.
@@ -633,51 +714,16 @@ static inline int dma_resv_test_signaled_single(struct dma_fence *passed_fence)
  */
 bool dma_resv_test_signaled_rcu(struct dma_resv *obj, bool test_all)
 {
-	unsigned seq, shared_count;
-	int ret;
-
-	rcu_read_lock();
-retry:
-	ret = true;
-	shared_count = 0;
-	seq = read_seqcount_begin(&obj->seq);
-
-	if (test_all) {
-		unsigned i;
-
-		struct dma_resv_list *fobj = rcu_dereference(obj->fence);
-
-		if (fobj)
-			shared_count = fobj->shared_count;
-
-		for (i = 0; i < shared_count; ++i) {
-			struct dma_fence *fence = rcu_dereference(fobj->shared[i]);
-
-			ret = dma_resv_test_signaled_single(fence);
-			if (ret < 0)
-				goto retry;
-			else if (!ret)
-				break;
-		}
-
-		if (read_seqcount_retry(&obj->seq, seq))
-			goto retry;
-	}
-
-	if (!shared_count) {
-		struct dma_fence *fence_excl = rcu_dereference(obj->fence_excl);
-
-		if (fence_excl) {
-			ret = dma_resv_test_signaled_single(fence_excl);
-			if (ret < 0)
-				goto retry;
+	struct dma_resv_iter cursor;
+	struct dma_fence *fence;
 
-			if (read_seqcount_retry(&obj->seq, seq))
-				goto retry;
-		}
+	dma_resv_iter_begin(&cursor, obj, test_all);
+	dma_resv_for_each_fence_unlocked(&cursor, fence) {
+		dma_resv_iter_end(&cursor);
+		return false;
 	}
+	dma_resv_iter_end(&cursor);
 
-	rcu_read_unlock();
-	return ret;
+	return true;
 }
 EXPORT_SYMBOL_GPL(dma_resv_test_signaled_rcu);
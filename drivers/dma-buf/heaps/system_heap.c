@@ -10,37 +10,285 @@
 #include <linux/dma-mapping.h>
 #include <linux/dma-heap.h>
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/highmem.h>
+#include <linux/kthread.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/scatterlist.h>
+#include <linux/shrinker.h>
 #include <linux/slab.h>
 #include <linux/sched/signal.h>
+#include <linux/spinlock.h>
+#include <linux/vmstat.h>
+#include <linux/wait.h>
 #include <asm/page.h>
 
 #include "heap-helpers.h"
 
 struct dma_heap *sys_heap;
 
+/*
+ * Buffers are built from chunks of the orders below, largest first. A chunk
+ * is a split high-order page, so that every page in it can be mapped and
+ * refcounted on its own, with the order kept in page_private() of its first
+ * page.
+ *
+ * Freed chunks are zeroed by a background thread and kept in a per-order
+ * pool, so allocating from the pool needs neither the buddy allocator nor
+ * zeroing. The pools and the chunks waiting to be zeroed are given back
+ * under memory pressure by a shrinker.
+ */
+#define HIGH_ORDER_GFP  (((GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN \
+				| __GFP_NORETRY) & ~__GFP_RECLAIM))
+#define LOW_ORDER_GFP (GFP_HIGHUSER | __GFP_ZERO)
+static const gfp_t order_flags[] = {HIGH_ORDER_GFP, HIGH_ORDER_GFP, LOW_ORDER_GFP};
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+/**
+ * struct system_heap_pool - zeroed chunks of one order
+ * @lock:	protects @chunks and @count
+ * @chunks:	first pages of the chunks, linked through page->lru
+ * @count:	number of chunks in the pool
+ */
+struct system_heap_pool {
+	spinlock_t lock;
+	struct list_head chunks;
+	unsigned long count;
+};
+
+static struct system_heap_pool pools[NUM_ORDERS];
+
+/* Chunks of freed buffers waiting to be zeroed */
+static DEFINE_SPINLOCK(deferred_lock);
+static LIST_HEAD(deferred_chunks);
+static unsigned long deferred_pages;
+static DECLARE_WAIT_QUEUE_HEAD(deferred_wait);
+
+static unsigned int order_index(unsigned int order)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_ORDERS - 1; i++) {
+		if (orders[i] == order)
+			break;
+	}
+	return i;
+}
+
+static void system_heap_pool_add(struct page *page)
+{
+	unsigned int order = page_private(page);
+	struct system_heap_pool *pool = &pools[order_index(order)];
+
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->chunks);
+	pool->count++;
+	spin_unlock(&pool->lock);
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    1 << order);
+}
+
+static struct page *system_heap_pool_remove(unsigned int index)
+{
+	struct system_heap_pool *pool = &pools[index];
+	struct page *page;
+
+	spin_lock(&pool->lock);
+	page = list_first_entry_or_null(&pool->chunks, struct page, lru);
+	if (page) {
+		list_del(&page->lru);
+		pool->count--;
+	}
+	spin_unlock(&pool->lock);
+
+	if (page)
+		mod_node_page_state(page_pgdat(page),
+				    NR_KERNEL_MISC_RECLAIMABLE,
+				    -(1 << orders[index]));
+	return page;
+}
+
+static void system_heap_free_chunk(struct page *page)
+{
+	unsigned int i, order = page_private(page);
+
+	set_page_private(page, 0);
+	for (i = 0; i < (1 << order); i++)
+		__free_page(page + i);
+}
+
+/*
+ * A chunk can only be reused if the heap holds the last reference to each of
+ * its pages. Anybody still holding one, for example through a pinned user
+ * mapping, could otherwise observe the next buffer built from it.
+ */
+static bool system_heap_chunk_reusable(struct page *page)
+{
+	unsigned int i, order = page_private(page);
+
+	for (i = 0; i < (1 << order); i++) {
+		if (page_ref_count(page + i) != 1)
+			return false;
+	}
+	return true;
+}
+
+static struct page *alloc_largest_available(unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	unsigned int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = system_heap_pool_remove(i);
+		if (!page) {
+			page = alloc_pages(order_flags[i], orders[i]);
+			if (!page)
+				continue;
+			if (orders[i])
+				split_page(page, orders[i]);
+			set_page_private(page, orders[i]);
+		}
+		return page;
+	}
+	return NULL;
+}
+
+static int system_heap_zero_thread(void *data)
+{
+	struct page *page;
+	unsigned int i, order;
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(deferred_wait,
+				     READ_ONCE(deferred_pages) > 0 ||
+				     kthread_should_stop());
+
+		spin_lock(&deferred_lock);
+		page = list_first_entry_or_null(&deferred_chunks, struct page,
+						lru);
+		if (page) {
+			list_del(&page->lru);
+			deferred_pages -= 1 << page_private(page);
+		}
+		spin_unlock(&deferred_lock);
+
+		if (!page)
+			continue;
+
+		order = page_private(page);
+		for (i = 0; i < (1 << order); i++)
+			clear_highpage(page + i);
+		system_heap_pool_add(page);
+		cond_resched();
+	}
+
+	return 0;
+}
+
 static void system_heap_free(struct heap_helper_buffer *buffer)
 {
-	pgoff_t pg;
+	unsigned long nr_pages = 0;
+	LIST_HEAD(chunks);
+	struct page *page;
+	pgoff_t pg = 0;
+
+	while (pg < buffer->pagecount) {
+		page = buffer->pages[pg];
+		pg += 1 << page_private(page);
+		if (!system_heap_chunk_reusable(page)) {
+			system_heap_free_chunk(page);
+			continue;
+		}
+		list_add_tail(&page->lru, &chunks);
+		nr_pages += 1 << page_private(page);
+	}
+
+	spin_lock(&deferred_lock);
+	list_splice_tail(&chunks, &deferred_chunks);
+	deferred_pages += nr_pages;
+	spin_unlock(&deferred_lock);
+	wake_up(&deferred_wait);
 
-	for (pg = 0; pg < buffer->pagecount; pg++)
-		__free_page(buffer->pages[pg]);
 	kfree(buffer->pages);
 	kfree(buffer);
 }
 
+static unsigned long system_heap_shrink_count(struct shrinker *shrinker,
+					      struct shrink_control *sc)
+{
+	unsigned long count = READ_ONCE(deferred_pages);
+	unsigned int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		count += READ_ONCE(pools[i].count) << orders[i];
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long system_heap_shrink_scan(struct shrinker *shrinker,
+					     struct shrink_control *sc)
+{
+	unsigned long freed = 0;
+	struct page *page;
+	unsigned int i;
+
+	/* Chunks not zeroed yet are the cheapest to give back. */
+	while (freed < sc->nr_to_scan) {
+		spin_lock(&deferred_lock);
+		page = list_first_entry_or_null(&deferred_chunks, struct page,
+						lru);
+		if (page) {
+			list_del(&page->lru);
+			deferred_pages -= 1 << page_private(page);
+		}
+		spin_unlock(&deferred_lock);
+
+		if (!page)
+			break;
+		freed += 1 << page_private(page);
+		system_heap_free_chunk(page);
+	}
+
+	for (i = 0; i < NUM_ORDERS && freed < sc->nr_to_scan; i++) {
+		while (freed < sc->nr_to_scan) {
+			page = system_heap_pool_remove(i);
+			if (!page)
+				break;
+			freed += 1 << orders[i];
+			system_heap_free_chunk(page);
+		}
+	}
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker system_heap_shrinker = {
+	.count_objects = system_heap_shrink_count,
+	.scan_objects = system_heap_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static int system_heap_allocate(struct dma_heap *heap,
 				unsigned long len,
 				unsigned long fd_flags,
 				unsigned long heap_flags)
 {
 	struct heap_helper_buffer *helper_buffer;
+	unsigned long size_remaining = len;
+	unsigned int max_order = orders[0];
 	struct dma_buf *dmabuf;
+	struct page *page;
 	int ret = -ENOMEM;
-	pgoff_t pg;
+	pgoff_t pg = 0;
+	unsigned int i;
 
 	helper_buffer = kzalloc(sizeof(*helper_buffer), GFP_KERNEL);
 	if (!helper_buffer)
@@ -59,7 +307,7 @@ static int system_heap_allocate(struct dma_heap *heap,
 		goto err0;
 	}
 
-	for (pg = 0; pg < helper_buffer->pagecount; pg++) {
+	while (size_remaining > 0) {
 		/*
 		 * Avoid trying to allocate memory if the process
 		 * has been killed by by SIGKILL
@@ -67,9 +315,14 @@ static int system_heap_allocate(struct dma_heap *heap,
 		if (fatal_signal_pending(current))
 			goto err1;
 
-		helper_buffer->pages[pg] = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (!helper_buffer->pages[pg])
+		page = alloc_largest_available(size_remaining, max_order);
+		if (!page)
 			goto err1;
+
+		max_order = page_private(page);
+		for (i = 0; i < (1 << max_order); i++)
+			helper_buffer->pages[pg++] = page + i;
+		size_remaining -= PAGE_SIZE << max_order;
 	}
 
 	/* create the dmabuf */
@@ -91,8 +344,11 @@ static int system_heap_allocate(struct dma_heap *heap,
 	return ret;
 
 err1:
-	while (pg > 0)
-		__free_page(helper_buffer->pages[--pg]);
+	/* The chunks were never handed out, so they are still zeroed. */
+	for (i = 0; i < pg; i += 1 << page_private(page)) {
+		page = helper_buffer->pages[i];
+		system_heap_pool_add(page);
+	}
 	kfree(helper_buffer->pages);
 err0:
 	kfree(helper_buffer);
@@ -107,16 +363,40 @@ static const struct dma_heap_ops system_heap_ops = {
 static int system_heap_create(void)
 {
 	struct dma_heap_export_info exp_info;
+	struct task_struct *thread;
+	unsigned int i;
 	int ret = 0;
 
+	for (i = 0; i < NUM_ORDERS; i++) {
+		spin_lock_init(&pools[i].lock);
+		INIT_LIST_HEAD(&pools[i].chunks);
+	}
+
+	thread = kthread_run(system_heap_zero_thread, NULL, "system-heap-zero");
+	if (IS_ERR(thread))
+		return PTR_ERR(thread);
+	sched_set_normal(thread, 19);
+
+	ret = register_shrinker(&system_heap_shrinker);
+	if (ret)
+		goto err_thread;
+
 	exp_info.name = "system";
 	exp_info.ops = &system_heap_ops;
 	exp_info.priv = NULL;
 
 	sys_heap = dma_heap_add(&exp_info);
-	if (IS_ERR(sys_heap))
+	if (IS_ERR(sys_heap)) {
 		ret = PTR_ERR(sys_heap);
+		goto err_shrinker;
+	}
+
+	return 0;
 
+err_shrinker:
+	unregister_shrinker(&system_heap_shrinker);
+err_thread:
+	kthread_stop(thread);
 	return ret;
 }
 module_init(system_heap_create);
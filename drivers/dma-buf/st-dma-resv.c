@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <linux/dma-fence.h>
+#include <linux/dma-resv.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "selftest.h"
+
+#define NUM_FENCES (1 << 10)
+
+static struct kmem_cache *slab_fences;
+
+static struct mock_fence {
+	struct dma_fence base;
+	spinlock_t lock;
+} *to_mock_fence(struct dma_fence *f) {
+	return container_of(f, struct mock_fence, base);
+}
+
+static const char *mock_name(struct dma_fence *f)
+{
+	return "mock";
+}
+
+static void mock_fence_release(struct dma_fence *f)
+{
+	kmem_cache_free(slab_fences, to_mock_fence(f));
+}
+
+static const struct dma_fence_ops mock_ops = {
+	.get_driver_name = mock_name,
+	.get_timeline_name = mock_name,
+	.release = mock_fence_release,
+};
+
+static struct dma_fence *mock_fence(void)
+{
+	struct mock_fence *f;
+
+	f = kmem_cache_alloc(slab_fences, GFP_KERNEL);
+	if (!f)
+		return NULL;
+
+	spin_lock_init(&f->lock);
+	dma_fence_init(&f->base, &mock_ops, &f->lock,
+		       dma_fence_context_alloc(1), 1);
+
+	return &f->base;
+}
+
+/* Add @count shared fences from distinct contexts, keeping them in @fences. */
+static int add_fences(struct dma_resv *resv, struct dma_fence **fences,
+		      unsigned int count)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < count; i++) {
+		fences[i] = mock_fence();
+		if (!fences[i])
+			return -ENOMEM;
+
+		err = dma_resv_reserve_shared(resv, 1);
+		if (err) {
+			dma_fence_put(fences[i]);
+			fences[i] = NULL;
+			return err;
+		}
+		dma_resv_add_shared_fence(resv, fences[i]);
+	}
+
+	return 0;
+}
+
+static void put_fences(struct dma_fence **fences, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!fences[i])
+			continue;
+		dma_fence_signal(fences[i]);
+		dma_fence_put(fences[i]);
+	}
+}
+
+static int sanitycheck(void *arg)
+{
+	struct dma_resv resv;
+	struct dma_fence *f;
+	int err;
+
+	f = mock_fence();
+	if (!f)
+		return -ENOMEM;
+
+	dma_resv_init(&resv);
+	dma_resv_lock(&resv, NULL);
+	err = dma_resv_reserve_shared(&resv, 1);
+	if (!err)
+		dma_resv_add_shared_fence(&resv, f);
+	dma_resv_unlock(&resv);
+
+	dma_fence_signal(f);
+	dma_fence_put(f);
+	dma_resv_fini(&resv);
+
+	return err;
+}
+
+static int test_prune_add(void *arg)
+{
+	struct dma_fence *fences[16] = {};
+	struct dma_resv_list *list;
+	struct dma_resv resv;
+	unsigned int i;
+	int err;
+
+	dma_resv_init(&resv);
+	dma_resv_lock(&resv, NULL);
+
+	err = add_fences(&resv, fences, ARRAY_SIZE(fences) - 1);
+	if (err)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(fences) - 1; i++)
+		dma_fence_signal(fences[i]);
+
+	err = add_fences(&resv, fences + ARRAY_SIZE(fences) - 1, 1);
+	if (err)
+		goto out;
+
+	list = dma_resv_get_list(&resv);
+	if (list->shared_count != 1) {
+		pr_err("Signaled fences were kept, %u shared fences\n",
+		       list->shared_count);
+		err = -EINVAL;
+	}
+
+out:
+	dma_resv_unlock(&resv);
+	dma_resv_fini(&resv);
+	put_fences(fences, ARRAY_SIZE(fences));
+	return err;
+}
+
+static int test_prune_reserve(void *arg)
+{
+	struct dma_fence *fences[32] = {};
+	struct dma_resv_list *list;
+	struct dma_resv resv;
+	unsigned int i, max;
+	int err;
+
+	dma_resv_init(&resv);
+	dma_resv_lock(&resv, NULL);
+
+	err = add_fences(&resv, fences, 1);
+	if (err)
+		goto out;
+
+	list = dma_resv_get_list(&resv);
+	max = min_t(unsigned int, list->shared_max, ARRAY_SIZE(fences));
+	err = add_fences(&resv, fences + 1, max - 1);
+	if (err)
+		goto out;
+
+	/* Keep one unsignaled at the front so the tail trimming can't help */
+	for (i = 1; i < max; i++)
+		dma_fence_signal(fences[i]);
+
+	err = dma_resv_reserve_shared(&resv, 1);
+	if (err)
+		goto out;
+
+	list = dma_resv_get_list(&resv);
+	if (list->shared_max != max || list->shared_count != 1) {
+		pr_err("Shared fence list grew to %u (%u fences), expected %u\n",
+		       list->shared_max, list->shared_count, max);
+		err = -EINVAL;
+	}
+
+out:
+	dma_resv_unlock(&resv);
+	dma_resv_fini(&resv);
+	put_fences(fences, ARRAY_SIZE(fences));
+	return err;
+}
+
+static int test_iter_unsignaled(void *arg)
+{
+	struct dma_fence *fences[64] = {};
+	struct dma_resv_iter cursor;
+	struct dma_fence *fence;
+	struct dma_resv resv;
+	unsigned int i, count = 0;
+	int err;
+
+	dma_resv_init(&resv);
+	dma_resv_lock(&resv, NULL);
+	err = add_fences(&resv, fences, ARRAY_SIZE(fences));
+	dma_resv_unlock(&resv);
+	if (err)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(fences); i += 2)
+		dma_fence_signal(fences[i]);
+
+	dma_resv_iter_begin(&cursor, &resv, true);
+	dma_resv_for_each_fence_unlocked(&cursor, fence) {
+		if (dma_resv_iter_is_restarted(&cursor))
+			count = 0;
+		if (dma_fence_is_signaled(fence)) {
+			pr_err("Iterator returned a signaled fence\n");
+			err = -EINVAL;
+		}
+		count++;
+	}
+	dma_resv_iter_end(&cursor);
+
+	if (!err && count != ARRAY_SIZE(fences) / 2) {
+		pr_err("Iterator returned %u fences, expected %zu\n",
+		       count, ARRAY_SIZE(fences) / 2);
+		err = -EINVAL;
+	}
+
+	if (!err && dma_resv_test_signaled_rcu(&resv, true)) {
+		pr_err("Reported signaled with unsignaled fences\n");
+		err = -EINVAL;
+	}
+
+out:
+	dma_resv_fini(&resv);
+	put_fences(fences, ARRAY_SIZE(fences));
+	return err;
+}
+
+static int perf_add_wait(void *arg)
+{
+	struct dma_fence **fences;
+	struct dma_resv resv;
+	ktime_t t0, t1, t2;
+	unsigned int i;
+	long ret;
+	int err;
+
+	fences = kcalloc(NUM_FENCES, sizeof(*fences), GFP_KERNEL);
+	if (!fences)
+		return -ENOMEM;
+
+	dma_resv_init(&resv);
+
+	t0 = ktime_get();
+	dma_resv_lock(&resv, NULL);
+	err = add_fences(&resv, fences, NUM_FENCES);
+	dma_resv_unlock(&resv);
+	t1 = ktime_get();
+	if (err)
+		goto out;
+
+	for (i = 0; i < NUM_FENCES; i++)
+		dma_fence_signal(fences[i]);
+
+	t2 = ktime_get();
+	ret = dma_resv_wait_timeout_rcu(&resv, true, false, 1);
+	if (ret <= 0) {
+		pr_err("Wait on signaled fences failed: %ld\n", ret);
+		err = -EINVAL;
+		goto out;
+	}
+
+	pr_info("%u fences: add %lluns per fence, wait on all signaled %lluns\n",
+		NUM_FENCES, div_u64(ktime_to_ns(ktime_sub(t1, t0)), NUM_FENCES),
+		(u64)ktime_to_ns(ktime_sub(ktime_get(), t2)));
+
+out:
+	dma_resv_fini(&resv);
+	put_fences(fences, NUM_FENCES);
+	kfree(fences);
+	return err;
+}
+
+int dma_resv(void)
+{
+	static const struct subtest tests[] = {
+		SUBTEST(sanitycheck),
+		SUBTEST(test_prune_add),
+		SUBTEST(test_prune_reserve),
+		SUBTEST(test_iter_unsignaled),
+		SUBTEST(perf_add_wait),
+	};
+	int ret;
+
+	slab_fences = KMEM_CACHE(mock_fence,
+				 SLAB_TYPESAFE_BY_RCU |
+				 SLAB_HWCACHE_ALIGN);
+	if (!slab_fences)
+		return -ENOMEM;
+
+	ret = subtests(tests, NULL);
+
+	kmem_cache_destroy(slab_fences);
+
+	return ret;
+}
@@ -0,0 +1,819 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * CPU offload DMA engine
+ *
+ * Without a DMA engine, async_tx runs xor and raid6 syndrome operations
+ * synchronously in the context of the submitter, so md raid5/6 stripe
+ * handling serializes on the thread that submits the work. This driver
+ * registers a software dmaengine provider instead: one device per NUMA
+ * node with one channel per CPU of the node. Descriptors run in submission
+ * order on their channel, from an unbound workqueue, and complete through
+ * the usual cookie, callback and dependency machinery, so that operations
+ * submitted on different CPUs run in parallel.
+ *
+ * Like a hardware ring, each channel has a fixed set of descriptors
+ * allocated with the channel; prep fails when they are all in flight, and
+ * async_tx then waits for the channel. A client that waits for a cookie,
+ * or for a free descriptor, runs the issued descriptors itself when the
+ * worker has not got to them yet, so waits do not depend on the worker
+ * being scheduled.
+ *
+ * Operations are done with the CPU on the kernel mapping of the buffers, so
+ * the device only works when DMA addresses map one to one to physical
+ * memory, which is checked at probe time, and not with highmem.
+ */
+
+#include <linux/dma-direct.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/raid/pq.h>
+#include <linux/raid/xor.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "dmaengine.h"
+
+#define CPU_DMA_NAME		"cpu-offload-dma"
+
+/* async_tx never passes more than 255 blocks, P and Q included */
+#define CPU_DMA_MAX_SRC		255
+
+/* descriptors per channel */
+#define CPU_DMA_RING_SIZE	32
+
+static unsigned int max_chans;
+module_param(max_chans, uint, 0444);
+MODULE_PARM_DESC(max_chans,
+		 "Maximum number of channels per node (default: one per CPU)");
+
+struct cpu_dma_desc {
+	struct dma_async_tx_descriptor txd;
+	struct list_head node;
+	enum dma_transaction_type type;
+	dma_addr_t dst[2];
+	size_t len;
+	unsigned long flags;
+	enum sum_check_flags *result;
+	unsigned int src_cnt;
+	dma_addr_t src[CPU_DMA_MAX_SRC];
+	unsigned char scf[CPU_DMA_MAX_SRC];
+};
+
+struct cpu_dma_chan {
+	struct dma_chan chan;
+	spinlock_t lock;		/* protects the lists and cookies */
+	struct list_head free;		/* ready for prep */
+	struct list_head pending;	/* submitted, not issued yet */
+	struct list_head active;	/* issued, waiting to be run */
+	struct list_head done;		/* completed, waiting for an ack */
+	struct cpu_dma_desc *ring;
+	struct work_struct work;
+	bool running;			/* the active list is being run */
+	int node;
+
+	/* runner scratch, only used with ->running set */
+	void *buf[2];
+	void **ptrs;
+};
+
+struct cpu_dma_device {
+	struct dma_device dma;
+	unsigned int nr_chans;
+	struct cpu_dma_chan chans[];
+};
+
+static struct workqueue_struct *cpu_dma_wq;
+static struct platform_device *cpu_dma_pdevs[MAX_NUMNODES];
+
+static inline struct cpu_dma_chan *to_cpu_dma_chan(struct dma_chan *chan)
+{
+	return container_of(chan, struct cpu_dma_chan, chan);
+}
+
+static inline struct cpu_dma_desc *
+to_cpu_dma_desc(struct dma_async_tx_descriptor *txd)
+{
+	return container_of(txd, struct cpu_dma_desc, txd);
+}
+
+static inline void *cpu_dma_addr(struct cpu_dma_chan *c, dma_addr_t addr)
+{
+	return phys_to_virt(dma_to_phys(c->chan.device->dev, addr));
+}
+
+static void cpu_dma_run_inline(struct cpu_dma_chan *c);
+
+/* recycle the completed descriptors that the client is done with */
+static void cpu_dma_reap(struct cpu_dma_chan *c)
+{
+	struct cpu_dma_desc *d, *n;
+
+	list_for_each_entry_safe(d, n, &c->done, node) {
+		if (async_tx_test_ack(&d->txd))
+			list_move_tail(&d->node, &c->free);
+	}
+}
+
+static struct cpu_dma_desc *cpu_dma_get_desc(struct cpu_dma_chan *c)
+{
+	struct cpu_dma_desc *d;
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	cpu_dma_reap(c);
+	d = list_first_entry_or_null(&c->free, struct cpu_dma_desc, node);
+	if (d)
+		list_del(&d->node);
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return d;
+}
+
+static dma_cookie_t cpu_dma_tx_submit(struct dma_async_tx_descriptor *txd)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(txd->chan);
+	struct cpu_dma_desc *d = to_cpu_dma_desc(txd);
+	unsigned long flags;
+	dma_cookie_t cookie;
+
+	spin_lock_irqsave(&c->lock, flags);
+	cookie = dma_cookie_assign(txd);
+	list_add_tail(&d->node, &c->pending);
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return cookie;
+}
+
+static struct cpu_dma_desc *
+cpu_dma_alloc_desc(struct dma_chan *chan, enum dma_transaction_type type,
+		   unsigned int src_cnt, size_t len, unsigned long flags)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	struct cpu_dma_desc *d;
+
+	if (src_cnt > CPU_DMA_MAX_SRC || !len)
+		return NULL;
+
+	d = cpu_dma_get_desc(c);
+	if (!d) {
+		/* the ring is full: complete what has been issued */
+		cpu_dma_run_inline(c);
+		d = cpu_dma_get_desc(c);
+		if (!d)
+			return NULL;
+	}
+
+	/* the source and coefficient arrays are filled in by the caller */
+	memset(d, 0, offsetof(struct cpu_dma_desc, src));
+	dma_async_tx_descriptor_init(&d->txd, chan);
+	d->txd.tx_submit = cpu_dma_tx_submit;
+	d->txd.flags = flags;
+	d->type = type;
+	d->len = len;
+	d->flags = flags;
+	d->src_cnt = src_cnt;
+
+	return d;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_memcpy(struct dma_chan *chan, dma_addr_t dst, dma_addr_t src,
+		    size_t len, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_MEMCPY, 1, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dst[0] = dst;
+	d->src[0] = src;
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_xor(struct dma_chan *chan, dma_addr_t dst, dma_addr_t *src,
+		 unsigned int src_cnt, size_t len, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_XOR, src_cnt, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dst[0] = dst;
+	memcpy(d->src, src, src_cnt * sizeof(*src));
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_xor_val(struct dma_chan *chan, dma_addr_t *src,
+		     unsigned int src_cnt, size_t len,
+		     enum sum_check_flags *result, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_XOR_VAL, src_cnt, len, flags);
+	if (!d)
+		return NULL;
+
+	memcpy(d->src, src, src_cnt * sizeof(*src));
+	d->result = result;
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_pq(struct dma_chan *chan, dma_addr_t *dst, dma_addr_t *src,
+		unsigned int src_cnt, const unsigned char *scf, size_t len,
+		unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_PQ, src_cnt, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dst[0] = dst[0];
+	d->dst[1] = dst[1];
+	memcpy(d->src, src, src_cnt * sizeof(*src));
+	memcpy(d->scf, scf, src_cnt);
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_pq_val(struct dma_chan *chan, dma_addr_t *pq, dma_addr_t *src,
+		    unsigned int src_cnt, const unsigned char *scf, size_t len,
+		    enum sum_check_flags *pqres, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_PQ_VAL, src_cnt, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dst[0] = pq[0];
+	d->dst[1] = pq[1];
+	memcpy(d->src, src, src_cnt * sizeof(*src));
+	memcpy(d->scf, scf, src_cnt);
+	d->result = pqres;
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_interrupt(struct dma_chan *chan, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_INTERRUPT, 0, 1, flags);
+
+	return d ? &d->txd : NULL;
+}
+
+/*
+ * dst ^= srcs[0] ^ ... ^ srcs[n - 1]. xor_blocks() works on multiples of
+ * 256 bytes and at most MAX_XOR_BLOCKS sources at a time.
+ */
+static void cpu_dma_xor(void *dst, void **srcs, unsigned int n, size_t len)
+{
+	size_t bulk = round_down(len, 256);
+	unsigned int i, cnt;
+
+	for (i = 0; bulk && i < n; i += cnt) {
+		cnt = min_t(unsigned int, n - i, MAX_XOR_BLOCKS);
+		xor_blocks(cnt, bulk, dst, &srcs[i]);
+	}
+
+	for (i = 0; bulk < len && i < n; i++) {
+		u8 *d = dst, *s = srcs[i];
+		size_t j;
+
+		for (j = bulk; j < len; j++)
+			d[j] ^= s[j];
+	}
+}
+
+/* dst ^= scf * src over GF(2^8) */
+static void cpu_dma_gfmul_xor(u8 *dst, const u8 *src, unsigned char scf,
+			      size_t len)
+{
+	const u8 *mul = raid6_gfmul[scf];
+	size_t i;
+
+	if (!scf)
+		return;
+	if (scf == 1) {
+		cpu_dma_xor(dst, (void **)&src, 1, len);
+		return;
+	}
+	for (i = 0; i < len; i++)
+		dst[i] ^= mul[src[i]];
+}
+
+/*
+ * P and Q of a plain raid6 stripe: both destinations, no continuation,
+ * and the coefficients of consecutive data disks (with the missing ones
+ * left out, as async_gen_syndrome() does). That is raid6_call's job.
+ */
+static bool cpu_dma_gen_syndrome(struct cpu_dma_chan *c, struct cpu_dma_desc *d)
+{
+	void **ptrs = c->ptrs;
+	int disks = 0, pos, i;
+
+	if (d->flags & (DMA_PREP_PQ_DISABLE_P | DMA_PREP_PQ_DISABLE_Q |
+			DMA_PREP_CONTINUE) || !IS_ALIGNED(d->len, 256))
+		return false;
+
+	for (i = 0; i < d->src_cnt; i++) {
+		pos = raid6_gflog[d->scf[i]];
+		if (!d->scf[i] || pos < disks || pos >= CPU_DMA_MAX_SRC - 2)
+			return false;
+		/* the zero page stands in for the missing disks */
+		if (pos > disks && d->len > PAGE_SIZE)
+			return false;
+		while (disks < pos)
+			ptrs[disks++] = (void *)raid6_empty_zero_page;
+		ptrs[disks++] = cpu_dma_addr(c, d->src[i]);
+	}
+	ptrs[disks++] = cpu_dma_addr(c, d->dst[0]);
+	ptrs[disks++] = cpu_dma_addr(c, d->dst[1]);
+
+	/* the destinations must not be sources as well */
+	for (i = 0; i < disks - 2; i++)
+		if (ptrs[i] == ptrs[disks - 2] || ptrs[i] == ptrs[disks - 1])
+			return false;
+
+	raid6_call.gen_syndrome(disks, d->len, ptrs);
+	return true;
+}
+
+/*
+ * Compute P and/or Q a page at a time into the channel scratch buffers,
+ * which allows the destinations to be sources as well (as the raid6
+ * recovery helpers do), and either store or check the result.
+ */
+static void cpu_dma_pq(struct cpu_dma_chan *c, struct cpu_dma_desc *d,
+		       bool check)
+{
+	bool do_p = !(d->flags & DMA_PREP_PQ_DISABLE_P);
+	bool do_q = !(d->flags & DMA_PREP_PQ_DISABLE_Q);
+	bool cont = dmaf_continue(d->flags);
+	void **srcs = c->ptrs;
+	u8 *p = do_p ? cpu_dma_addr(c, d->dst[0]) : NULL;
+	u8 *q = do_q ? cpu_dma_addr(c, d->dst[1]) : NULL;
+	size_t off, chunk;
+	unsigned int i;
+
+	if (check)
+		*d->result = 0;
+
+	for (i = 0; i < d->src_cnt; i++)
+		srcs[i] = cpu_dma_addr(c, d->src[i]);
+
+	for (off = 0; off < d->len; off += chunk) {
+		chunk = min_t(size_t, d->len - off, PAGE_SIZE);
+
+		if (do_p) {
+			if (cont)
+				memcpy(c->buf[0], p + off, chunk);
+			else
+				memset(c->buf[0], 0, chunk);
+		}
+		if (do_q) {
+			if (cont)
+				memcpy(c->buf[1], q + off, chunk);
+			else
+				memset(c->buf[1], 0, chunk);
+		}
+
+		for (i = 0; i < d->src_cnt; i++) {
+			void *src = srcs[i] + off;
+
+			if (do_p)
+				cpu_dma_xor(c->buf[0], &src, 1, chunk);
+			if (do_q)
+				cpu_dma_gfmul_xor(c->buf[1], src, d->scf[i],
+						  chunk);
+		}
+
+		if (check) {
+			if (do_p && memcmp(c->buf[0], p + off, chunk))
+				*d->result |= SUM_CHECK_P_RESULT;
+			if (do_q && memcmp(c->buf[1], q + off, chunk))
+				*d->result |= SUM_CHECK_Q_RESULT;
+		} else {
+			if (do_p)
+				memcpy(p + off, c->buf[0], chunk);
+			if (do_q)
+				memcpy(q + off, c->buf[1], chunk);
+		}
+	}
+}
+
+static void cpu_dma_run_desc(struct cpu_dma_chan *c, struct cpu_dma_desc *d)
+{
+	void **srcs = c->ptrs;
+	unsigned int i, j;
+	void *dst;
+	size_t off, chunk;
+
+	switch (d->type) {
+	case DMA_MEMCPY:
+		memcpy(cpu_dma_addr(c, d->dst[0]), cpu_dma_addr(c, d->src[0]),
+		       d->len);
+		break;
+	case DMA_XOR:
+		/*
+		 * The destination is only a source when it is listed; if it
+		 * is, async_xor() puts it first.
+		 */
+		dst = cpu_dma_addr(c, d->dst[0]);
+		for (i = 0, j = 0; i < d->src_cnt; i++) {
+			void *src = cpu_dma_addr(c, d->src[i]);
+
+			if (src != dst)
+				srcs[j++] = src;
+		}
+		if (j == d->src_cnt) {
+			memcpy(dst, srcs[0], d->len);
+			cpu_dma_xor(dst, &srcs[1], j - 1, d->len);
+		} else {
+			cpu_dma_xor(dst, srcs, j, d->len);
+		}
+		break;
+	case DMA_XOR_VAL:
+		*d->result = 0;
+		for (i = 0; i < d->src_cnt; i++)
+			srcs[i] = cpu_dma_addr(c, d->src[i]);
+		for (off = 0; off < d->len; off += chunk) {
+			chunk = min_t(size_t, d->len - off, PAGE_SIZE);
+			memcpy(c->buf[0], srcs[0] + off, chunk);
+			for (i = 1; i < d->src_cnt; i++) {
+				void *src = srcs[i] + off;
+
+				cpu_dma_xor(c->buf[0], &src, 1, chunk);
+			}
+			if (memchr_inv(c->buf[0], 0, chunk)) {
+				*d->result |= SUM_CHECK_P_RESULT;
+				break;
+			}
+		}
+		break;
+	case DMA_PQ:
+		if (!cpu_dma_gen_syndrome(c, d))
+			cpu_dma_pq(c, d, false);
+		break;
+	case DMA_PQ_VAL:
+		cpu_dma_pq(c, d, true);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Run the issued descriptors in order. Only one context runs a channel at
+ * a time, so that cookies complete in order: whoever finds the channel
+ * idle drains the active list, including what is issued while it runs.
+ */
+static void cpu_dma_run_active(struct cpu_dma_chan *c, bool may_sleep)
+{
+	struct cpu_dma_desc *d;
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	if (c->running) {
+		spin_unlock_irqrestore(&c->lock, flags);
+		return;
+	}
+	c->running = true;
+
+	while ((d = list_first_entry_or_null(&c->active, struct cpu_dma_desc,
+					     node))) {
+		list_del(&d->node);
+		spin_unlock_irqrestore(&c->lock, flags);
+
+		cpu_dma_run_desc(c, d);
+
+		spin_lock_irqsave(&c->lock, flags);
+		dma_cookie_complete(&d->txd);
+		spin_unlock_irqrestore(&c->lock, flags);
+
+		dma_descriptor_unmap(&d->txd);
+
+		/* clients expect to be called back from a tasklet */
+		local_bh_disable();
+		dmaengine_desc_get_callback_invoke(&d->txd, NULL);
+		dma_run_dependencies(&d->txd);
+		local_bh_enable();
+
+		if (may_sleep)
+			cond_resched();
+
+		spin_lock_irqsave(&c->lock, flags);
+		list_add_tail(&d->node, &c->done);
+	}
+
+	c->running = false;
+	cpu_dma_reap(c);
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static void cpu_dma_work(struct work_struct *work)
+{
+	struct cpu_dma_chan *c = container_of(work, struct cpu_dma_chan, work);
+
+	cpu_dma_run_active(c, true);
+}
+
+/*
+ * A client spinning on a cookie may be what keeps the worker from running
+ * (md raid5 submits with preemption disabled), so it runs the channel itself
+ * rather than burn the polling timeout. Not from hard interrupt context:
+ * callbacks are run with bottom halves disabled, as from a tasklet.
+ */
+static void cpu_dma_run_inline(struct cpu_dma_chan *c)
+{
+	if (in_irq() || irqs_disabled())
+		return;
+
+	cpu_dma_run_active(c, false);
+}
+
+static void cpu_dma_issue_pending(struct dma_chan *chan)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	if (!list_empty(&c->pending)) {
+		list_splice_tail_init(&c->pending, &c->active);
+		queue_work_node(c->node, cpu_dma_wq, &c->work);
+	}
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static enum dma_status cpu_dma_tx_status(struct dma_chan *chan,
+					 dma_cookie_t cookie,
+					 struct dma_tx_state *txstate)
+{
+	enum dma_status ret;
+
+	ret = dma_cookie_status(chan, cookie, txstate);
+	if (ret == DMA_COMPLETE)
+		return ret;
+
+	cpu_dma_run_inline(to_cpu_dma_chan(chan));
+
+	return dma_cookie_status(chan, cookie, txstate);
+}
+
+static void cpu_dma_free_chan_resources(struct dma_chan *chan)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+
+	flush_work(&c->work);
+
+	spin_lock_irq(&c->lock);
+	INIT_LIST_HEAD(&c->free);
+	INIT_LIST_HEAD(&c->pending);
+	INIT_LIST_HEAD(&c->active);
+	INIT_LIST_HEAD(&c->done);
+	spin_unlock_irq(&c->lock);
+
+	kvfree(c->ring);
+	c->ring = NULL;
+	kfree(c->ptrs);
+	free_page((unsigned long)c->buf[1]);
+	free_page((unsigned long)c->buf[0]);
+	c->ptrs = NULL;
+	c->buf[1] = NULL;
+	c->buf[0] = NULL;
+}
+
+static int cpu_dma_alloc_chan_resources(struct dma_chan *chan)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	unsigned int i;
+
+	c->buf[0] = (void *)__get_free_page(GFP_KERNEL);
+	c->buf[1] = (void *)__get_free_page(GFP_KERNEL);
+	c->ptrs = kcalloc_node(CPU_DMA_MAX_SRC, sizeof(*c->ptrs), GFP_KERNEL,
+			       c->node);
+	c->ring = kvzalloc_node(array_size(CPU_DMA_RING_SIZE, sizeof(*c->ring)),
+				GFP_KERNEL, c->node);
+	if (!c->buf[0] || !c->buf[1] || !c->ptrs || !c->ring) {
+		cpu_dma_free_chan_resources(chan);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < CPU_DMA_RING_SIZE; i++)
+		list_add_tail(&c->ring[i].node, &c->free);
+
+	dma_cookie_init(chan);
+
+	return CPU_DMA_RING_SIZE;
+}
+
+/* the engine reads and writes through the kernel mapping of the pages */
+static bool cpu_dma_direct_mapping(struct device *dev)
+{
+	struct page *page;
+	dma_addr_t addr;
+	bool ok;
+
+	if (IS_ENABLED(CONFIG_HIGHMEM))
+		return false;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return false;
+
+	addr = dma_map_page(dev, page, 0, PAGE_SIZE, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(dev, addr)) {
+		__free_page(page);
+		return false;
+	}
+	ok = phys_to_virt(dma_to_phys(dev, addr)) == page_address(page);
+	dma_unmap_page(dev, addr, PAGE_SIZE, DMA_BIDIRECTIONAL);
+	__free_page(page);
+
+	return ok;
+}
+
+static int cpu_dma_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	int node = pdev->id;
+	struct cpu_dma_device *cdev;
+	struct dma_device *dma;
+	unsigned int nr, i;
+	int ret;
+
+	set_dev_node(dev, node);
+	/* the CPU is cache coherent with itself */
+#if defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_DEVICE) || \
+    defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_CPU) || \
+    defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_CPU_ALL)
+	dev->dma_coherent = true;
+#endif
+	ret = dma_coerce_mask_and_coherent(dev, DMA_BIT_MASK(64));
+	if (ret)
+		return ret;
+	if (!cpu_dma_direct_mapping(dev)) {
+		dev_info(dev, "DMA addresses are not physical, not offloading\n");
+		return -ENODEV;
+	}
+
+	nr = nr_cpus_node(node);
+	if (max_chans)
+		nr = min(nr, max_chans);
+
+	cdev = devm_kzalloc(dev, struct_size(cdev, chans, nr), GFP_KERNEL);
+	if (!cdev)
+		return -ENOMEM;
+	cdev->nr_chans = nr;
+
+	dma = &cdev->dma;
+	dma->dev = dev;
+	INIT_LIST_HEAD(&dma->channels);
+	dma_cap_set(DMA_MEMCPY, dma->cap_mask);
+	dma_cap_set(DMA_XOR, dma->cap_mask);
+	dma_cap_set(DMA_XOR_VAL, dma->cap_mask);
+	dma_cap_set(DMA_PQ, dma->cap_mask);
+	dma_cap_set(DMA_PQ_VAL, dma->cap_mask);
+	dma_cap_set(DMA_INTERRUPT, dma->cap_mask);
+
+	dma->max_xor = CPU_DMA_MAX_SRC;
+	dma_set_maxpq(dma, CPU_DMA_MAX_SRC, 1);
+	dma->copy_align = DMAENGINE_ALIGN_1_BYTE;
+	dma->xor_align = DMAENGINE_ALIGN_64_BYTES;
+	dma->pq_align = DMAENGINE_ALIGN_64_BYTES;
+
+	dma->device_alloc_chan_resources = cpu_dma_alloc_chan_resources;
+	dma->device_free_chan_resources = cpu_dma_free_chan_resources;
+	dma->device_prep_dma_memcpy = cpu_dma_prep_memcpy;
+	dma->device_prep_dma_xor = cpu_dma_prep_xor;
+	dma->device_prep_dma_xor_val = cpu_dma_prep_xor_val;
+	dma->device_prep_dma_pq = cpu_dma_prep_pq;
+	dma->device_prep_dma_pq_val = cpu_dma_prep_pq_val;
+	dma->device_prep_dma_interrupt = cpu_dma_prep_interrupt;
+	dma->device_issue_pending = cpu_dma_issue_pending;
+	dma->device_tx_status = cpu_dma_tx_status;
+
+	for (i = 0; i < nr; i++) {
+		struct cpu_dma_chan *c = &cdev->chans[i];
+
+		spin_lock_init(&c->lock);
+		INIT_LIST_HEAD(&c->free);
+		INIT_LIST_HEAD(&c->pending);
+		INIT_LIST_HEAD(&c->active);
+		INIT_LIST_HEAD(&c->done);
+		INIT_WORK(&c->work, cpu_dma_work);
+		c->node = node;
+		c->chan.device = dma;
+		list_add_tail(&c->chan.device_node, &dma->channels);
+	}
+
+	ret = dma_async_device_register(dma);
+	if (ret)
+		return ret;
+
+	platform_set_drvdata(pdev, cdev);
+	dev_info(dev, "node %d: %u channels\n", node, nr);
+
+	return 0;
+}
+
+static int cpu_dma_remove(struct platform_device *pdev)
+{
+	struct cpu_dma_device *cdev = platform_get_drvdata(pdev);
+
+	dma_async_device_unregister(&cdev->dma);
+
+	return 0;
+}
+
+static struct platform_driver cpu_dma_driver = {
+	.probe = cpu_dma_probe,
+	.remove = cpu_dma_remove,
+	.driver = {
+		.name = CPU_DMA_NAME,
+	},
+};
+
+static void cpu_dma_destroy_devices(void)
+{
+	int node;
+
+	for_each_node(node) {
+		platform_device_unregister(cpu_dma_pdevs[node]);
+		cpu_dma_pdevs[node] = NULL;
+	}
+}
+
+static int __init cpu_dma_init(void)
+{
+	int node, ret;
+
+	cpu_dma_wq = alloc_workqueue("cpu_offload_dma",
+				     WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM,
+				     0);
+	if (!cpu_dma_wq)
+		return -ENOMEM;
+
+	ret = platform_driver_register(&cpu_dma_driver);
+	if (ret)
+		goto err_wq;
+
+	/*
+	 * A node with a single CPU gains nothing: its only CPU would be
+	 * waiting on itself whenever a client quiesces a chain.
+	 */
+	for_each_online_node(node) {
+		struct platform_device *pdev;
+
+		if (nr_cpus_node(node) < 2)
+			continue;
+
+		pdev = platform_device_register_simple(CPU_DMA_NAME, node,
+						       NULL, 0);
+		if (IS_ERR(pdev)) {
+			ret = PTR_ERR(pdev);
+			goto err_devices;
+		}
+		cpu_dma_pdevs[node] = pdev;
+	}
+
+	return 0;
+
+err_devices:
+	cpu_dma_destroy_devices();
+	platform_driver_unregister(&cpu_dma_driver);
+err_wq:
+	destroy_workqueue(cpu_dma_wq);
+	return ret;
+}
+/* after the raid6 and xor algorithms have been chosen */
+late_initcall(cpu_dma_init);
+
+static void __exit cpu_dma_exit(void)
+{
+	cpu_dma_destroy_devices();
+	platform_driver_unregister(&cpu_dma_driver);
+	destroy_workqueue(cpu_dma_wq);
+}
+module_exit(cpu_dma_exit);
+
+MODULE_DESCRIPTION("CPU offload engine for async_tx xor and raid6 operations");
+MODULE_LICENSE("GPL v2");
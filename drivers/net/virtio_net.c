@@ -46,6 +46,9 @@ module_param(napi_tx, bool, 0644);
 
 #define VIRTIO_XDP_FLAG	BIT(0)
 
+/* Transmitted buffers detached from the virtqueue at a time */
+#define VIRTNET_XMIT_FREE_BATCH	32
+
 /* RX packet size EWMA. The average packet size is used to determine the packet
  * buffer size when refilling RX rings. As the entire RX ring may be refilled
  * at once, the weight is chosen so that the EWMA will be insensitive to short-
@@ -1449,26 +1452,31 @@ static int virtnet_receive(struct receive_queue *rq, int budget,
 
 static void free_old_xmit_skbs(struct send_queue *sq, bool in_napi)
 {
-	unsigned int len;
+	void *ptrs[VIRTNET_XMIT_FREE_BATCH];
+	unsigned int i, n;
 	unsigned int packets = 0;
 	unsigned int bytes = 0;
-	void *ptr;
 
-	while ((ptr = virtqueue_get_buf(sq->vq, &len)) != NULL) {
-		if (likely(!is_xdp_frame(ptr))) {
-			struct sk_buff *skb = ptr;
+	while ((n = virtqueue_get_bufs(sq->vq, ptrs, NULL,
+				       ARRAY_SIZE(ptrs)))) {
+		for (i = 0; i < n; i++) {
+			void *ptr = ptrs[i];
 
-			pr_debug("Sent skb %p\n", skb);
+			if (likely(!is_xdp_frame(ptr))) {
+				struct sk_buff *skb = ptr;
 
-			bytes += skb->len;
-			napi_consume_skb(skb, in_napi);
-		} else {
-			struct xdp_frame *frame = ptr_to_xdp(ptr);
+				pr_debug("Sent skb %p\n", skb);
 
-			bytes += frame->len;
-			xdp_return_frame(frame);
+				bytes += skb->len;
+				napi_consume_skb(skb, in_napi);
+			} else {
+				struct xdp_frame *frame = ptr_to_xdp(ptr);
+
+				bytes += frame->len;
+				xdp_return_frame(frame);
+			}
 		}
-		packets++;
+		packets += n;
 	}
 
 	/* Avoid overhead when no packets have been processed
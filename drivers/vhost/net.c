@@ -128,6 +128,15 @@ struct vhost_net_virtqueue {
 	struct xdp_buff *xdp;
 };
 
+/* Number of used up TX page frags kept around for reuse */
+#define VHOST_NET_RECYCLE 8
+
+struct vhost_net_frag_page {
+	struct page *page;
+	unsigned int size;
+	int refcnt_bias;
+};
+
 struct vhost_net {
 	struct vhost_dev dev;
 	struct vhost_net_virtqueue vqs[VHOST_NET_VQ_MAX];
@@ -144,6 +153,11 @@ struct vhost_net {
 	struct page_frag page_frag;
 	/* Refcount bias of page frag */
 	int refcnt_bias;
+	/* Used up page frags waiting for the stack to release them, oldest
+	 * first. Protected by tx vq lock. */
+	struct vhost_net_frag_page recycle[VHOST_NET_RECYCLE];
+	int recycle_head;
+	int recycle_cnt;
 };
 
 static unsigned vhost_net_zcopy_mask __read_mostly;
@@ -543,7 +557,7 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	endtime = busy_clock() + busyloop_timeout;
 
 	while (vhost_can_busy_poll(endtime)) {
-		if (vhost_has_work(&net->dev)) {
+		if (vhost_vq_has_work(poll_rx ? rvq : tvq)) {
 			*busyloop_intr = true;
 			break;
 		}
@@ -654,15 +668,99 @@ static bool tx_can_batch(struct vhost_virtqueue *vq, size_t total_len)
 
 #define SKB_FRAG_PAGE_ORDER     get_order(32768)
 
+/* Only vhost holds references to the page: all its buffers were freed. */
+static bool vhost_net_page_idle(struct page *page, int refcnt_bias)
+{
+	return page_ref_count(page) == refcnt_bias;
+}
+
+static void vhost_net_page_frag_reset(struct vhost_net *net,
+				      struct page_frag *pfrag)
+{
+	page_ref_add(pfrag->page, USHRT_MAX - net->refcnt_bias);
+	net->refcnt_bias = USHRT_MAX;
+	pfrag->offset = 0;
+}
+
+/* Park a used up page frag until the buffers carved from it are freed. */
+static void vhost_net_page_frag_stash(struct vhost_net *net,
+				      struct page_frag *pfrag)
+{
+	struct vhost_net_frag_page *fp;
+
+	if (net->recycle_cnt == VHOST_NET_RECYCLE) {
+		fp = &net->recycle[net->recycle_head];
+		__page_frag_cache_drain(fp->page, fp->refcnt_bias);
+		net->recycle_head = (net->recycle_head + 1) % VHOST_NET_RECYCLE;
+		--net->recycle_cnt;
+	}
+
+	fp = &net->recycle[(net->recycle_head + net->recycle_cnt) %
+			   VHOST_NET_RECYCLE];
+	fp->page = pfrag->page;
+	fp->size = pfrag->size;
+	fp->refcnt_bias = net->refcnt_bias;
+	++net->recycle_cnt;
+	pfrag->page = NULL;
+}
+
+/* Pages are released roughly in the order they were used up, so only the
+ * oldest parked page is worth checking. */
+static bool vhost_net_page_frag_recycle(struct vhost_net *net,
+					struct page_frag *pfrag)
+{
+	struct vhost_net_frag_page *fp;
+
+	if (!net->recycle_cnt)
+		return false;
+
+	fp = &net->recycle[net->recycle_head];
+	if (!vhost_net_page_idle(fp->page, fp->refcnt_bias))
+		return false;
+
+	pfrag->page = fp->page;
+	pfrag->size = fp->size;
+	net->refcnt_bias = fp->refcnt_bias;
+	net->recycle_head = (net->recycle_head + 1) % VHOST_NET_RECYCLE;
+	--net->recycle_cnt;
+	vhost_net_page_frag_reset(net, pfrag);
+	return true;
+}
+
+static void vhost_net_page_frag_drain(struct vhost_net *net)
+{
+	struct vhost_net_frag_page *fp;
+
+	while (net->recycle_cnt) {
+		fp = &net->recycle[net->recycle_head];
+		__page_frag_cache_drain(fp->page, fp->refcnt_bias);
+		net->recycle_head = (net->recycle_head + 1) % VHOST_NET_RECYCLE;
+		--net->recycle_cnt;
+	}
+
+	if (net->page_frag.page)
+		__page_frag_cache_drain(net->page_frag.page, net->refcnt_bias);
+	net->page_frag.page = NULL;
+}
+
 static bool vhost_net_page_frag_refill(struct vhost_net *net, unsigned int sz,
 				       struct page_frag *pfrag, gfp_t gfp)
 {
 	if (pfrag->page) {
 		if (pfrag->offset + sz <= pfrag->size)
 			return true;
-		__page_frag_cache_drain(pfrag->page, net->refcnt_bias);
+		/* Reuse the page in place if the stack is already done
+		 * with it, otherwise park it and look for an idle one. */
+		if (vhost_net_page_idle(pfrag->page, net->refcnt_bias)) {
+			vhost_net_page_frag_reset(net, pfrag);
+			return true;
+		}
+		vhost_net_page_frag_stash(net, pfrag);
 	}
 
+	if (vhost_net_page_frag_recycle(net, pfrag))
+		return true;
+
 	pfrag->offset = 0;
 	net->refcnt_bias = 0;
 	if (SKB_FRAG_PAGE_ORDER) {
@@ -1234,7 +1332,9 @@ static void handle_rx(struct vhost_net *net)
 			goto out;
 		}
 		nvq->done_idx += headcount;
-		if (nvq->done_idx > VHOST_NET_BATCH)
+		/* Publish the heads once per batch taken from the tap ring */
+		if (nvq->done_idx > VHOST_NET_BATCH ||
+		    (nvq->rx_ring && vhost_net_buf_is_empty(&nvq->rxq)))
 			vhost_net_signal_used(nvq);
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len,
@@ -1340,12 +1440,16 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true,
 		       NULL);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 	n->page_frag.page = NULL;
 	n->refcnt_bias = 0;
+	n->recycle_head = 0;
+	n->recycle_cnt = 0;
 
 	return 0;
 }
@@ -1420,8 +1524,7 @@ static int vhost_net_release(struct inode *inode, struct file *f)
 	kfree(n->vqs[VHOST_NET_VQ_RX].rxq.queue);
 	kfree(n->vqs[VHOST_NET_VQ_TX].xdp);
 	kfree(n->dev.vqs);
-	if (n->page_frag.page)
-		__page_frag_cache_drain(n->page_frag.page, n->refcnt_bias);
+	vhost_net_page_frag_drain(n);
 	kvfree(n);
 	return 0;
 }
@@ -1733,9 +1836,11 @@ static long vhost_net_ioctl(struct file *f, unsigned int ioctl,
 	default:
 		mutex_lock(&n->dev.mutex);
 		r = vhost_dev_ioctl(&n->dev, ioctl, argp);
-		if (r == -ENOIOCTLCMD)
-			r = vhost_vring_ioctl(&n->dev, ioctl, argp);
-		else
+		if (r == -ENOIOCTLCMD) {
+			r = vhost_worker_ioctl(&n->dev, ioctl, argp);
+			if (r == -ENOIOCTLCMD)
+				r = vhost_vring_ioctl(&n->dev, ioctl, argp);
+		} else
 			vhost_net_flush(n);
 		mutex_unlock(&n->dev.mutex);
 		return r;
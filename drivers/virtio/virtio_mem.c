@@ -831,11 +831,14 @@ static void virtio_mem_online_page_cb(struct page *page, unsigned int order)
 	generic_online_page(page, order);
 }
 
-static uint64_t virtio_mem_send_request(struct virtio_mem *vm,
-					const struct virtio_mem_req *req)
+/*
+ * Send a request to the device without waiting for the response. There can
+ * only be a single request in flight.
+ */
+static int virtio_mem_queue_request(struct virtio_mem *vm,
+				    const struct virtio_mem_req *req)
 {
 	struct scatterlist *sgs[2], sg_req, sg_resp;
-	unsigned int len;
 	int rc;
 
 	/* don't use the request residing on the stack (vaddr) */
@@ -854,15 +857,35 @@ static uint64_t virtio_mem_send_request(struct virtio_mem *vm,
 		return rc;
 
 	virtqueue_kick(vm->vq);
+	return 0;
+}
+
+/*
+ * Wait for the response to the request in flight.
+ */
+static uint64_t virtio_mem_wait_response(struct virtio_mem *vm)
+{
+	unsigned int len;
 
-	/* wait for a response */
 	wait_event(vm->host_resp, virtqueue_get_buf(vm->vq, &len));
 
 	return virtio16_to_cpu(vm->vdev, vm->resp.type);
 }
 
-static int virtio_mem_send_plug_request(struct virtio_mem *vm, uint64_t addr,
-					uint64_t size)
+static uint64_t virtio_mem_send_request(struct virtio_mem *vm,
+					const struct virtio_mem_req *req)
+{
+	int rc;
+
+	rc = virtio_mem_queue_request(vm, req);
+	if (rc < 0)
+		return rc;
+
+	return virtio_mem_wait_response(vm);
+}
+
+static int virtio_mem_queue_plug_request(struct virtio_mem *vm, uint64_t addr,
+					 uint64_t size)
 {
 	const uint64_t nb_vm_blocks = size / vm->device_block_size;
 	const struct virtio_mem_req req = {
@@ -874,7 +897,12 @@ static int virtio_mem_send_plug_request(struct virtio_mem *vm, uint64_t addr,
 	if (atomic_read(&vm->config_changed))
 		return -EAGAIN;
 
-	switch (virtio_mem_send_request(vm, &req)) {
+	return virtio_mem_queue_request(vm, &req);
+}
+
+static int virtio_mem_plug_response(struct virtio_mem *vm, uint64_t size)
+{
+	switch (virtio_mem_wait_response(vm)) {
 	case VIRTIO_MEM_RESP_ACK:
 		vm->plugged_size += size;
 		return 0;
@@ -889,6 +917,18 @@ static int virtio_mem_send_plug_request(struct virtio_mem *vm, uint64_t addr,
 	}
 }
 
+static int virtio_mem_send_plug_request(struct virtio_mem *vm, uint64_t addr,
+					uint64_t size)
+{
+	int rc;
+
+	rc = virtio_mem_queue_plug_request(vm, addr, size);
+	if (rc)
+		return rc;
+
+	return virtio_mem_plug_response(vm, size);
+}
+
 static int virtio_mem_send_unplug_request(struct virtio_mem *vm, uint64_t addr,
 					  uint64_t size)
 {
@@ -977,6 +1017,40 @@ static int virtio_mem_mb_unplug_sb(struct virtio_mem *vm, unsigned long mb_id,
 	return rc;
 }
 
+/*
+ * Maximum number of memory blocks that can get (un)plugged with a single
+ * request, which is limited in the number of device blocks.
+ */
+static unsigned long virtio_mem_max_mb_per_request(struct virtio_mem *vm)
+{
+	return U16_MAX * vm->device_block_size / memory_block_size_bytes();
+}
+
+/*
+ * Unplug a range of fully plugged offline or not-added memory blocks with a
+ * single request. Updates the plugged state, but not the state of the
+ * memory blocks.
+ */
+static int virtio_mem_mbs_unplug(struct virtio_mem *vm,
+				 unsigned long first_mb_id, unsigned long nb_mb)
+{
+	unsigned long mb_id;
+	int rc;
+
+	dev_dbg(&vm->vdev->dev, "unplugging memory blocks: %lu - %lu\n",
+		first_mb_id, first_mb_id + nb_mb - 1);
+
+	rc = virtio_mem_send_unplug_request(vm,
+			virtio_mem_mb_id_to_phys(first_mb_id),
+			nb_mb * memory_block_size_bytes());
+	if (rc)
+		return rc;
+
+	for (mb_id = first_mb_id; mb_id < first_mb_id + nb_mb; mb_id++)
+		virtio_mem_mb_set_sb_unplugged(vm, mb_id, 0, vm->nb_sb_per_mb);
+	return 0;
+}
+
 /*
  * Unplug the desired number of plugged subblocks of a offline or not-added
  * memory block. Will fail if any subblock cannot get unplugged (instead of
@@ -1128,6 +1202,176 @@ static int virtio_mem_mb_plug_and_add(struct virtio_mem *vm,
 	return 0;
 }
 
+/*
+ * A range of unused memory blocks that gets fully plugged with a single
+ * request.
+ */
+struct virtio_mem_mb_batch {
+	unsigned long first_mb_id;
+	unsigned long nb_mb;
+};
+
+/*
+ * Select the next batch of unused memory blocks to fully plug, preparing
+ * new memory blocks as needed, and send the plug request to the device.
+ * Does not wait for the response.
+ *
+ * Will not modify the state of the memory blocks.
+ */
+static int virtio_mem_mb_batch_queue(struct virtio_mem *vm, uint64_t nb_sb,
+				     struct virtio_mem_mb_batch *batch)
+{
+	const uint64_t mb_size = memory_block_size_bytes();
+	unsigned long nb_offline, max_mb, mb_id, id;
+	int rc = 0;
+
+	batch->nb_mb = 0;
+
+	max_mb = nb_sb / vm->nb_sb_per_mb;
+	if (!max_mb)
+		return 0;
+
+	/*
+	 * Plugged blocks are added to Linux right after the response, so
+	 * account them as offline.
+	 */
+	nb_offline = vm->nb_mb_state[VIRTIO_MEM_MB_STATE_OFFLINE] +
+		     vm->nb_mb_state[VIRTIO_MEM_MB_STATE_OFFLINE_PARTIAL] +
+		     vm->nb_mb_state[VIRTIO_MEM_MB_STATE_PLUGGED];
+	if (nb_offline >= VIRTIO_MEM_NB_OFFLINE_THRESHOLD)
+		return -ENOSPC;
+	max_mb = min(max_mb, VIRTIO_MEM_NB_OFFLINE_THRESHOLD - nb_offline);
+	/* The number of device blocks per request is limited. */
+	max_mb = min_t(uint64_t, max_mb, virtio_mem_max_mb_per_request(vm));
+
+	mb_id = vm->next_mb_id;
+	virtio_mem_for_each_mb_state(vm, id, VIRTIO_MEM_MB_STATE_UNUSED) {
+		mb_id = id;
+		break;
+	}
+
+	batch->first_mb_id = mb_id;
+	for (; batch->nb_mb < max_mb; mb_id++) {
+		if (mb_id == vm->next_mb_id) {
+			rc = virtio_mem_prepare_next_mb(vm, &mb_id);
+			if (rc)
+				break;
+		} else if (virtio_mem_mb_get_state(vm, mb_id) !=
+			   VIRTIO_MEM_MB_STATE_UNUSED) {
+			break;
+		}
+		batch->nb_mb++;
+	}
+	if (!batch->nb_mb)
+		return rc;
+
+	dev_dbg(&vm->vdev->dev, "plugging memory blocks: %lu - %lu\n",
+		batch->first_mb_id, batch->first_mb_id + batch->nb_mb - 1);
+
+	rc = virtio_mem_queue_plug_request(vm,
+			virtio_mem_mb_id_to_phys(batch->first_mb_id),
+			batch->nb_mb * mb_size);
+	if (rc)
+		batch->nb_mb = 0;
+	return rc;
+}
+
+/*
+ * Wait for the plug request of a batch to complete.
+ *
+ * Will modify the state of the memory blocks.
+ */
+static int virtio_mem_mb_batch_plugged(struct virtio_mem *vm,
+				       struct virtio_mem_mb_batch *batch,
+				       uint64_t *nb_sb)
+{
+	unsigned long mb_id;
+	int rc;
+
+	rc = virtio_mem_plug_response(vm,
+				      batch->nb_mb * memory_block_size_bytes());
+	if (rc) {
+		batch->nb_mb = 0;
+		return rc;
+	}
+
+	for (mb_id = batch->first_mb_id;
+	     mb_id < batch->first_mb_id + batch->nb_mb; mb_id++) {
+		virtio_mem_mb_set_sb_plugged(vm, mb_id, 0, vm->nb_sb_per_mb);
+		virtio_mem_mb_set_state(vm, mb_id, VIRTIO_MEM_MB_STATE_PLUGGED);
+	}
+	*nb_sb -= batch->nb_mb * vm->nb_sb_per_mb;
+	return 0;
+}
+
+/*
+ * Add the memory blocks of a plugged batch to Linux. Memory blocks that
+ * cannot be added remain plugged and will get unplugged by
+ * virtio_mem_unplug_pending_mb().
+ *
+ * Will modify the state of the memory blocks.
+ */
+static int virtio_mem_mb_batch_add(struct virtio_mem *vm,
+				   const struct virtio_mem_mb_batch *batch)
+{
+	unsigned long mb_id;
+	int rc;
+
+	for (mb_id = batch->first_mb_id;
+	     mb_id < batch->first_mb_id + batch->nb_mb; mb_id++) {
+		/* See virtio_mem_mb_plug_and_add(). */
+		virtio_mem_mb_set_state(vm, mb_id, VIRTIO_MEM_MB_STATE_OFFLINE);
+
+		rc = virtio_mem_mb_add(vm, mb_id);
+		if (rc) {
+			dev_err(&vm->vdev->dev,
+				"adding memory block %lu failed with %d\n",
+				mb_id, rc);
+			virtio_mem_mb_set_state(vm, mb_id,
+						VIRTIO_MEM_MB_STATE_PLUGGED);
+			return rc;
+		}
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Fully plug and add unused memory blocks, several memory blocks per plug
+ * request. The plug request for the next batch is processed by the device
+ * while the previous batch gets added (and, depending on the policy,
+ * onlined).
+ *
+ * Stops once less than a memory block is left to plug.
+ */
+static int virtio_mem_plug_and_add_mbs(struct virtio_mem *vm, uint64_t *nb_sb)
+{
+	struct virtio_mem_mb_batch cur = {}, next;
+	int rc, rc2, rc3;
+
+	for (;;) {
+		rc = virtio_mem_mb_batch_queue(vm, *nb_sb, &next);
+		if (!cur.nb_mb && !next.nb_mb)
+			return rc;
+
+		rc2 = virtio_mem_mb_batch_add(vm, &cur);
+
+		rc3 = 0;
+		if (next.nb_mb)
+			rc3 = virtio_mem_mb_batch_plugged(vm, &next, nb_sb);
+
+		if (rc2)
+			return rc2;
+		if (rc3)
+			return rc3;
+		/* We might be able to continue after adding (onlining). */
+		if (rc && rc != -ENOSPC)
+			return rc;
+		cur = next;
+	}
+}
+
 /*
  * Try to plug the desired number of subblocks of a memory block that
  * is already added to Linux.
@@ -1222,6 +1466,11 @@ static int virtio_mem_plug_request(struct virtio_mem *vm, uint64_t diff)
 	 */
 	mutex_unlock(&vm->hotplug_mutex);
 
+	/* Try to plug and add unused and new blocks in batches */
+	rc = virtio_mem_plug_and_add_mbs(vm, &nb_sb);
+	if (rc || !nb_sb)
+		return rc;
+
 	/* Try to plug and add unused blocks */
 	virtio_mem_for_each_mb_state(vm, mb_id, VIRTIO_MEM_MB_STATE_UNUSED) {
 		if (virtio_mem_too_many_mb_offline(vm))
@@ -1295,6 +1544,51 @@ static int virtio_mem_mb_unplug_any_sb_offline(struct virtio_mem *vm,
 	return 0;
 }
 
+/*
+ * Unplug the fully plugged offline memory block @mb_id together with the
+ * consecutive fully plugged offline memory blocks below it, using a single
+ * request. Falls back to virtio_mem_mb_unplug_any_sb_offline() if less than
+ * two memory blocks can be unplugged that way. On success, @mb_id is set to
+ * the first memory block that was unplugged.
+ *
+ * Will modify the state of the memory blocks. Might temporarily drop the
+ * hotplug_mutex.
+ */
+static int virtio_mem_mbs_unplug_offline(struct virtio_mem *vm,
+					 unsigned long *mb_id, uint64_t *nb_sb)
+{
+	unsigned long max_mb, nb_mb = 1, id;
+	int rc;
+
+	max_mb = min_t(uint64_t, *nb_sb / vm->nb_sb_per_mb,
+		       virtio_mem_max_mb_per_request(vm));
+	while (nb_mb < max_mb && *mb_id >= vm->first_mb_id + nb_mb &&
+	       virtio_mem_mb_get_state(vm, *mb_id - nb_mb) ==
+	       VIRTIO_MEM_MB_STATE_OFFLINE)
+		nb_mb++;
+	if (nb_mb < 2)
+		return virtio_mem_mb_unplug_any_sb_offline(vm, *mb_id, nb_sb);
+
+	id = *mb_id - nb_mb + 1;
+	rc = virtio_mem_mbs_unplug(vm, id, nb_mb);
+	if (rc)
+		return rc;
+	*nb_sb -= nb_mb * vm->nb_sb_per_mb;
+	*mb_id = id;
+
+	/* See virtio_mem_mb_unplug_any_sb_offline(). */
+	for (id = *mb_id; id < *mb_id + nb_mb; id++)
+		virtio_mem_mb_set_state(vm, id, VIRTIO_MEM_MB_STATE_UNUSED);
+
+	mutex_unlock(&vm->hotplug_mutex);
+	for (id = *mb_id; id < *mb_id + nb_mb; id++) {
+		rc = virtio_mem_mb_remove(vm, id);
+		BUG_ON(rc);
+	}
+	mutex_lock(&vm->hotplug_mutex);
+	return 0;
+}
+
 /*
  * Unplug the given plugged subblocks of an online memory block.
  *
@@ -1427,11 +1721,13 @@ static int virtio_mem_unplug_request(struct virtio_mem *vm, uint64_t diff)
 		cond_resched();
 	}
 
-	/* Try to unplug subblocks of plugged offline blocks. */
+	/*
+	 * Try to unplug subblocks of plugged offline blocks, several memory
+	 * blocks per request where possible.
+	 */
 	virtio_mem_for_each_mb_state_rev(vm, mb_id,
 					 VIRTIO_MEM_MB_STATE_OFFLINE) {
-		rc = virtio_mem_mb_unplug_any_sb_offline(vm, mb_id,
-							 &nb_sb);
+		rc = virtio_mem_mbs_unplug_offline(vm, &mb_id, &nb_sb);
 		if (rc || !nb_sb)
 			goto out_unlock;
 		cond_resched();
@@ -1479,14 +1775,33 @@ static int virtio_mem_unplug_request(struct virtio_mem *vm, uint64_t diff)
  */
 static int virtio_mem_unplug_pending_mb(struct virtio_mem *vm)
 {
-	unsigned long mb_id;
+	const unsigned long max_mb = virtio_mem_max_mb_per_request(vm);
+	unsigned long mb_id, nb_mb, id;
 	int rc;
 
 	virtio_mem_for_each_mb_state(vm, mb_id, VIRTIO_MEM_MB_STATE_PLUGGED) {
-		rc = virtio_mem_mb_unplug(vm, mb_id);
+		/* Unplug consecutive fully plugged blocks in one request. */
+		nb_mb = 0;
+		while (nb_mb < max_mb && mb_id + nb_mb < vm->next_mb_id &&
+		       virtio_mem_mb_get_state(vm, mb_id + nb_mb) ==
+		       VIRTIO_MEM_MB_STATE_PLUGGED &&
+		       virtio_mem_mb_test_sb_plugged(vm, mb_id + nb_mb, 0,
+						     vm->nb_sb_per_mb))
+			nb_mb++;
+
+		if (nb_mb > 1) {
+			rc = virtio_mem_mbs_unplug(vm, mb_id, nb_mb);
+		} else {
+			rc = virtio_mem_mb_unplug(vm, mb_id);
+			nb_mb = 1;
+		}
 		if (rc)
 			return rc;
-		virtio_mem_mb_set_state(vm, mb_id, VIRTIO_MEM_MB_STATE_UNUSED);
+
+		for (id = mb_id; id < mb_id + nb_mb; id++)
+			virtio_mem_mb_set_state(vm, id,
+						VIRTIO_MEM_MB_STATE_UNUSED);
+		mb_id += nb_mb - 1;
 	}
 
 	return 0;
@@ -84,6 +84,11 @@ struct vring_desc_extra_packed {
 	u16 flags;			/* Descriptor flags. */
 };
 
+struct vring_desc_order {
+	u32 in_len;			/* Device writable length. */
+	u16 id;				/* Buffer id. */
+};
+
 struct vring_virtqueue {
 	struct virtqueue vq;
 
@@ -105,6 +110,9 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
+	/* Host uses buffers in the order they were made available */
+	bool in_order;
+
 	/* Head of free buffer list. */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
@@ -113,6 +121,15 @@ struct vring_virtqueue {
 	/* Last used index we've seen. */
 	u16 last_used_idx;
 
+	/*
+	 * Buffers in the order they were made available, oldest at
+	 * order_head, if in_order: an in order device may only report
+	 * the last buffer of a batch.
+	 */
+	struct vring_desc_order *order;
+	u16 order_head;
+	u16 order_tail;
+
 	union {
 		/* Available for split ring */
 		struct {
@@ -152,6 +169,15 @@ struct vring_virtqueue {
 			/* Device ring wrap counter. */
 			bool used_wrap_counter;
 
+			/*
+			 * The used element of the in order batch being
+			 * detached: the driver may reuse its descriptor
+			 * before the last buffer of the batch is reached.
+			 */
+			bool batch;
+			u16 batch_id;
+			u32 batch_len;
+
 			/* Avail used flags. */
 			u16 avail_used_flags;
 
@@ -200,6 +226,17 @@ struct vring_virtqueue {
 
 #define to_vvq(_vq) container_of(_vq, struct vring_virtqueue, vq)
 
+static inline void vring_order_push(struct vring_virtqueue *vq,
+				    unsigned int num, u16 id, u32 in_len)
+{
+	struct vring_desc_order *order = &vq->order[vq->order_tail];
+
+	order->id = id;
+	order->in_len = in_len;
+	if (++vq->order_tail == num)
+		vq->order_tail = 0;
+}
+
 static inline bool virtqueue_use_indirect(struct virtqueue *_vq,
 					  unsigned int total_sg)
 {
@@ -675,14 +712,52 @@ static inline bool more_used_split(const struct vring_virtqueue *vq)
 			vq->split.vring.used->idx);
 }
 
+/* Detach the buffer at last_used_idx. */
+static void *detach_used_split(struct vring_virtqueue *vq, unsigned int *len,
+			       void **ctx)
+{
+	u16 last_used = vq->last_used_idx & (vq->split.vring.num - 1);
+	unsigned int head;
+	void *ret;
+
+	head = virtio32_to_cpu(vq->vq.vdev,
+			vq->split.vring.used->ring[last_used].id);
+	*len = virtio32_to_cpu(vq->vq.vdev,
+			vq->split.vring.used->ring[last_used].len);
+
+	if (unlikely(head >= vq->split.vring.num)) {
+		BAD_RING(vq, "id %u out of range\n", head);
+		return NULL;
+	}
+	if (unlikely(!vq->split.desc_state[head].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", head);
+		return NULL;
+	}
+
+	/* detach_buf_split clears data, so grab it now. */
+	ret = vq->split.desc_state[head].data;
+	detach_buf_split(vq, head, ctx);
+	vq->last_used_idx++;
+	return ret;
+}
+
+static void update_used_event_split(struct vring_virtqueue *vq)
+{
+	/* If we expect an interrupt for the next entry, tell host
+	 * by writing event index and flush out the write before
+	 * the read in the next get_buf call. */
+	if (!(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+		virtio_store_mb(vq->weak_barriers,
+				&vring_used_event(&vq->split.vring),
+				cpu_to_virtio16(vq->vq.vdev, vq->last_used_idx));
+}
+
 static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 					 unsigned int *len,
 					 void **ctx)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	void *ret;
-	unsigned int i;
-	u16 last_used;
 
 	START_USE(vq);
 
@@ -700,32 +775,11 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	/* Only get used array entries after they have been exposed by host. */
 	virtio_rmb(vq->weak_barriers);
 
-	last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
-	i = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].id);
-	*len = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].len);
-
-	if (unlikely(i >= vq->split.vring.num)) {
-		BAD_RING(vq, "id %u out of range\n", i);
+	ret = detach_used_split(vq, len, ctx);
+	if (unlikely(!ret))
 		return NULL;
-	}
-	if (unlikely(!vq->split.desc_state[i].data)) {
-		BAD_RING(vq, "id %u is not a head!\n", i);
-		return NULL;
-	}
 
-	/* detach_buf_split clears data, so grab it now. */
-	ret = vq->split.desc_state[i].data;
-	detach_buf_split(vq, i, ctx);
-	vq->last_used_idx++;
-	/* If we expect an interrupt for the next entry, tell host
-	 * by writing event index and flush out the write before
-	 * the read in the next get_buf call. */
-	if (!(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
-		virtio_store_mb(vq->weak_barriers,
-				&vring_used_event(&vq->split.vring),
-				cpu_to_virtio16(_vq->vdev, vq->last_used_idx));
+	update_used_event_split(vq);
 
 	LAST_ADD_TIME_INVALID(vq);
 
@@ -733,6 +787,44 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	return ret;
 }
 
+static unsigned int virtqueue_get_bufs_split(struct virtqueue *_vq,
+					     void **bufs, unsigned int *lens,
+					     unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n, len;
+	u16 used_idx;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	used_idx = virtio16_to_cpu(_vq->vdev, vq->split.vring.used->idx);
+
+	/* Only get used array entries after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	for (n = 0; n < num && vq->last_used_idx != used_idx; n++) {
+		bufs[n] = detach_used_split(vq, &len, NULL);
+		if (unlikely(!bufs[n]))
+			return n;
+		if (lens)
+			lens[n] = len;
+	}
+
+	/* One event index update for the whole batch. */
+	if (n) {
+		update_used_event_split(vq);
+		LAST_ADD_TIME_INVALID(vq);
+	}
+
+	END_USE(vq);
+	return n;
+}
+
 static void virtqueue_disable_cb_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -779,7 +871,8 @@ static bool virtqueue_poll_split(struct virtqueue *_vq, unsigned last_used_idx)
 			vq->split.vring.used->idx);
 }
 
-static bool virtqueue_enable_cb_delayed_split(struct virtqueue *_vq)
+static bool virtqueue_enable_cb_delayed_split(struct virtqueue *_vq,
+					      unsigned int max_bufs)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 bufs;
@@ -800,6 +893,7 @@ static bool virtqueue_enable_cb_delayed_split(struct virtqueue *_vq)
 	}
 	/* TODO: tune this threshold */
 	bufs = (u16)(vq->split.avail_idx_shadow - vq->last_used_idx) * 3 / 4;
+	bufs = min_t(unsigned int, bufs, max_bufs - 1);
 
 	virtio_store_mb(vq->weak_barriers,
 			&vring_used_event(&vq->split.vring),
@@ -987,6 +1081,7 @@ static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 	struct vring_packed_desc *desc;
 	struct scatterlist *sg;
 	unsigned int i, n, err_idx;
+	u32 in_len = 0;
 	u16 head, id;
 	dma_addr_t addr;
 
@@ -1017,6 +1112,8 @@ static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 						0 : VRING_DESC_F_WRITE);
 			desc[i].addr = cpu_to_le64(addr);
 			desc[i].len = cpu_to_le32(sg->length);
+			if (n >= out_sgs)
+				in_len += sg->length;
 			i++;
 		}
 	}
@@ -1071,6 +1168,9 @@ static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 	vq->packed.desc_state[id].indir_desc = desc;
 	vq->packed.desc_state[id].last = id;
 
+	if (vq->in_order)
+		vring_order_push(vq, vq->packed.vring.num, id, in_len);
+
 	vq->num_added += 1;
 
 	pr_debug("Added buffer head %i to %p\n", head, vq);
@@ -1103,6 +1203,7 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 	struct vring_packed_desc *desc;
 	struct scatterlist *sg;
 	unsigned int i, n, c, descs_used, err_idx;
+	u32 in_len = 0;
 	__le16 head_flags, flags;
 	u16 head, id, prev, curr, avail_used_flags;
 	int err;
@@ -1171,6 +1272,8 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 			desc[i].addr = cpu_to_le64(addr);
 			desc[i].len = cpu_to_le32(sg->length);
 			desc[i].id = cpu_to_le16(id);
+			if (n >= out_sgs)
+				in_len += sg->length;
 
 			if (unlikely(vq->use_dma_api)) {
 				vq->packed.desc_extra[curr].addr = addr;
@@ -1206,6 +1309,9 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 	vq->packed.desc_state[id].indir_desc = ctx;
 	vq->packed.desc_state[id].last = prev;
 
+	if (vq->in_order)
+		vring_order_push(vq, vq->packed.vring.num, id, in_len);
+
 	/*
 	 * A driver MUST NOT make the first descriptor in the list
 	 * available before all subsequent descriptors comprising
@@ -1349,38 +1455,48 @@ static inline bool is_used_desc_packed(const struct vring_virtqueue *vq,
 
 static inline bool more_used_packed(const struct vring_virtqueue *vq)
 {
-	return is_used_desc_packed(vq, vq->last_used_idx,
-			vq->packed.used_wrap_counter);
+	return vq->packed.batch ||
+		is_used_desc_packed(vq, vq->last_used_idx,
+				    vq->packed.used_wrap_counter);
 }
 
-static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
-					  unsigned int *len,
-					  void **ctx)
+/*
+ * Detach the buffer the used element at last_used_idx stands for. An in
+ * order device may write a single used element for a batch, with the id of
+ * its last buffer, and skip the descriptors of the whole batch.
+ */
+static void *detach_used_packed(struct vring_virtqueue *vq,
+				unsigned int *len, void **ctx)
 {
-	struct vring_virtqueue *vq = to_vvq(_vq);
-	u16 last_used, id;
+	u16 last_used = vq->last_used_idx, id;
+	struct vring_desc_order *order;
 	void *ret;
 
-	START_USE(vq);
+	if (vq->in_order) {
+		if (!vq->packed.batch) {
+			vq->packed.batch_id =
+				le16_to_cpu(vq->packed.vring.desc[last_used].id);
+			vq->packed.batch_len =
+				le32_to_cpu(vq->packed.vring.desc[last_used].len);
+			vq->packed.batch = true;
+		}
 
-	if (unlikely(vq->broken)) {
-		END_USE(vq);
-		return NULL;
-	}
+		order = &vq->order[vq->order_head];
+		id = order->id;
+		if (id == vq->packed.batch_id) {
+			*len = vq->packed.batch_len;
+			vq->packed.batch = false;
+		} else {
+			*len = order->in_len;
+		}
 
-	if (!more_used_packed(vq)) {
-		pr_debug("No more buffers in queue\n");
-		END_USE(vq);
-		return NULL;
+		if (++vq->order_head == vq->packed.vring.num)
+			vq->order_head = 0;
+	} else {
+		id = le16_to_cpu(vq->packed.vring.desc[last_used].id);
+		*len = le32_to_cpu(vq->packed.vring.desc[last_used].len);
 	}
 
-	/* Only get used elements after they have been exposed by host. */
-	virtio_rmb(vq->weak_barriers);
-
-	last_used = vq->last_used_idx;
-	id = le16_to_cpu(vq->packed.vring.desc[last_used].id);
-	*len = le32_to_cpu(vq->packed.vring.desc[last_used].len);
-
 	if (unlikely(id >= vq->packed.vring.num)) {
 		BAD_RING(vq, "id %u out of range\n", id);
 		return NULL;
@@ -1400,6 +1516,11 @@ static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
 		vq->packed.used_wrap_counter ^= 1;
 	}
 
+	return ret;
+}
+
+static void update_used_event_packed(struct vring_virtqueue *vq)
+{
 	/*
 	 * If we expect an interrupt for the next entry, tell host
 	 * by writing event index and flush out the write before
@@ -1411,6 +1532,36 @@ static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
 				cpu_to_le16(vq->last_used_idx |
 					(vq->packed.used_wrap_counter <<
 					 VRING_PACKED_EVENT_F_WRAP_CTR)));
+}
+
+static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
+					  unsigned int *len,
+					  void **ctx)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	void *ret;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (!more_used_packed(vq)) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return NULL;
+	}
+
+	/* Only get used elements after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	ret = detach_used_packed(vq, len, ctx);
+	if (unlikely(!ret))
+		return NULL;
+
+	update_used_event_packed(vq);
 
 	LAST_ADD_TIME_INVALID(vq);
 
@@ -1418,6 +1569,41 @@ static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
 	return ret;
 }
 
+static unsigned int virtqueue_get_bufs_packed(struct virtqueue *_vq,
+					      void **bufs, unsigned int *lens,
+					      unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n, len;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	for (n = 0; n < num && more_used_packed(vq); n++) {
+		/* Only get used elements after they have been exposed by host. */
+		virtio_rmb(vq->weak_barriers);
+
+		bufs[n] = detach_used_packed(vq, &len, NULL);
+		if (unlikely(!bufs[n]))
+			return n;
+		if (lens)
+			lens[n] = len;
+	}
+
+	/* One event offset update for the whole batch. */
+	if (n) {
+		update_used_event_packed(vq);
+		LAST_ADD_TIME_INVALID(vq);
+	}
+
+	END_USE(vq);
+	return n;
+}
+
 static void virtqueue_disable_cb_packed(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -1471,13 +1657,18 @@ static bool virtqueue_poll_packed(struct virtqueue *_vq, u16 off_wrap)
 	bool wrap_counter;
 	u16 used_idx;
 
+	/* The rest of an in order batch is still to be detached. */
+	if (vq->packed.batch)
+		return true;
+
 	wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
 	used_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
 
 	return is_used_desc_packed(vq, used_idx, wrap_counter);
 }
 
-static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq)
+static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq,
+					       unsigned int max_bufs)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 used_idx, wrap_counter;
@@ -1493,6 +1684,7 @@ static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq)
 	if (vq->event) {
 		/* TODO: tune this threshold */
 		bufs = (vq->packed.vring.num - vq->vq.num_free) * 3 / 4;
+		bufs = min_t(unsigned int, bufs, max_bufs - 1);
 		wrap_counter = vq->packed.used_wrap_counter;
 
 		used_idx = vq->last_used_idx + bufs;
@@ -1525,9 +1717,7 @@ static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq)
 	 */
 	virtio_mb(vq->weak_barriers);
 
-	if (is_used_desc_packed(vq,
-				vq->last_used_idx,
-				vq->packed.used_wrap_counter)) {
+	if (more_used_packed(vq)) {
 		END_USE(vq);
 		return false;
 	}
@@ -1626,6 +1816,10 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
+	vq->order = NULL;
+	vq->order_head = 0;
+	vq->order_tail = 0;
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -1647,6 +1841,7 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	vq->packed.used_wrap_counter = 1;
 	vq->packed.event_flags_shadow = 0;
 	vq->packed.avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+	vq->packed.batch = false;
 
 	vq->packed.desc_state = kmalloc_array(num,
 			sizeof(struct vring_desc_state_packed),
@@ -1671,6 +1866,12 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	memset(vq->packed.desc_extra, 0,
 		num * sizeof(struct vring_desc_extra_packed));
 
+	if (vq->in_order) {
+		vq->order = kcalloc(num, sizeof(*vq->order), GFP_KERNEL);
+		if (!vq->order)
+			goto err_order;
+	}
+
 	/* No callback?  Tell other side not to bother us. */
 	if (!callback) {
 		vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
@@ -1683,6 +1884,8 @@ static struct virtqueue *vring_create_virtqueue_packed(
 	spin_unlock(&vdev->vqs_list_lock);
 	return &vq->vq;
 
+err_order:
+	kfree(vq->packed.desc_extra);
 err_desc_extra:
 	kfree(vq->packed.desc_state);
 err_desc_state:
@@ -1918,6 +2121,31 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	return virtqueue_get_buf_ctx(_vq, len, NULL);
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+/**
+ * virtqueue_get_bufs - get a batch of used buffers
+ * @_vq: the struct virtqueue we're talking about.
+ * @bufs: array filled with the "data" tokens handed to virtqueue_add_*()
+ * @lens: array filled with the lengths written into the buffers, or NULL
+ * @num: the size of @bufs and @lens
+ *
+ * Like calling virtqueue_get_buf() up to @num times, but the used ring
+ * index is read and the event index written once for the whole batch.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ *
+ * Returns the number of buffers detached, zero if there are none.
+ */
+unsigned int virtqueue_get_bufs(struct virtqueue *_vq, void **bufs,
+				unsigned int *lens, unsigned int num)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_get_bufs_packed(_vq, bufs, lens, num) :
+				 virtqueue_get_bufs_split(_vq, bufs, lens, num);
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs);
 /**
  * virtqueue_disable_cb - disable callbacks
  * @_vq: the struct virtqueue we're talking about.
@@ -2014,13 +2242,36 @@ EXPORT_SYMBOL_GPL(virtqueue_enable_cb);
  * operations at the same time (except where noted).
  */
 bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
+{
+	return virtqueue_enable_cb_after(_vq, UINT_MAX);
+}
+EXPORT_SYMBOL_GPL(virtqueue_enable_cb_delayed);
+
+/**
+ * virtqueue_enable_cb_after - restart callbacks after disable_cb.
+ * @_vq: the struct virtqueue we're talking about.
+ * @nbufs: number of used buffers to wait for, at least 1.
+ *
+ * Like virtqueue_enable_cb_delayed(), but the interrupt is delayed until
+ * @nbufs buffers have been used, or most of the available buffers if
+ * there are fewer than that in flight. There is no time bound on the
+ * delay: without VIRTIO_RING_F_EVENT_IDX, or with @nbufs == 1, this is
+ * the same as virtqueue_enable_cb().
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ */
+bool virtqueue_enable_cb_after(struct virtqueue *_vq, unsigned int nbufs)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
-	return vq->packed_ring ? virtqueue_enable_cb_delayed_packed(_vq) :
-				 virtqueue_enable_cb_delayed_split(_vq);
+	if (WARN_ON_ONCE(!nbufs))
+		nbufs = 1;
+
+	return vq->packed_ring ? virtqueue_enable_cb_delayed_packed(_vq, nbufs) :
+				 virtqueue_enable_cb_delayed_split(_vq, nbufs);
 }
-EXPORT_SYMBOL_GPL(virtqueue_enable_cb_delayed);
+EXPORT_SYMBOL_GPL(virtqueue_enable_cb_after);
 
 /**
  * virtqueue_detach_unused_buf - detach first unused buffer
@@ -2105,6 +2356,11 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	/* VIRTIO_F_IN_ORDER is only negotiated with VIRTIO_F_RING_PACKED. */
+	vq->in_order = false;
+	vq->order = NULL;
+	vq->order_head = 0;
+	vq->order_tail = 0;
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -2224,6 +2480,7 @@ void vring_del_virtqueue(struct virtqueue *_vq)
 	}
 	if (!vq->packed_ring)
 		kfree(vq->split.desc_state);
+	kfree(vq->order);
 	spin_lock(&vq->vq.vdev->vqs_list_lock);
 	list_del(&_vq->list);
 	spin_unlock(&vq->vq.vdev->vqs_list_lock);
@@ -2248,6 +2505,11 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_RING_PACKED:
 			break;
+		case VIRTIO_F_IN_ORDER:
+			/* Only the packed ring handles in order batches. */
+			if (!__virtio_test_bit(vdev, VIRTIO_F_RING_PACKED))
+				__virtio_clear_bit(vdev, i);
+			break;
 		case VIRTIO_F_ORDER_PLATFORM:
 			break;
 		default:
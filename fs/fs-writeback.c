@@ -67,6 +67,26 @@ struct wb_writeback_work {
  */
 unsigned int dirtytime_expire_interval = 12 * 60 * 60;
 
+/*
+ * Number of workers that may drain a single bdi_writeback's b_io list in
+ * parallel.  The flusher itself always counts as one, so the default of 1
+ * keeps the classic single-threaded behaviour.  Helpers pull inodes off the
+ * shared b_io list under wb->list_lock exactly like the flusher does, and
+ * I_SYNC keeps them from ever working on the same inode, so the split is by
+ * inode and adapts to however unevenly the dirty data is spread.
+ */
+#define WB_MAX_WORKERS		4
+unsigned int dirty_writeback_workers = 1;
+
+struct wb_writeback_helper {
+	struct work_struct work;
+	struct bdi_writeback *wb;
+	struct wb_writeback_work wwork;	/* private share of the parent work */
+	long progress;
+};
+
+static struct workqueue_struct *wb_helper_wq;
+
 static inline struct inode *wb_inode(struct list_head *head)
 {
 	return list_entry(head, struct inode, i_io_list);
@@ -1835,6 +1855,115 @@ static long writeback_inodes_wb(struct bdi_writeback *wb, long nr_pages,
 	return nr_pages - work.nr_pages;
 }
 
+static void wb_writeback_helper_fn(struct work_struct *work)
+{
+	struct wb_writeback_helper *helper =
+		container_of(work, struct wb_writeback_helper, work);
+	struct bdi_writeback *wb = helper->wb;
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	spin_lock(&wb->list_lock);
+	if (helper->wwork.sb)
+		helper->progress = writeback_sb_inodes(helper->wwork.sb, wb,
+						       &helper->wwork);
+	else
+		helper->progress = __writeback_inodes_wb(wb, &helper->wwork);
+	spin_unlock(&wb->list_lock);
+	blk_finish_plug(&plug);
+}
+
+/*
+ * The helpers live on the flusher's stack for the duration of one
+ * wb_writeback() call, so writeback never has to allocate memory to make
+ * use of them.  Returns the number of helpers set up.
+ */
+static int wb_init_helpers(struct bdi_writeback *wb,
+			   struct wb_writeback_helper *helpers)
+{
+	int i, nr = min_t(unsigned int, READ_ONCE(dirty_writeback_workers),
+			  WB_MAX_WORKERS) - 1;
+
+	if (nr <= 0 || !wb_helper_wq)
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		INIT_WORK_ONSTACK(&helpers[i].work, wb_writeback_helper_fn);
+		helpers[i].wb = wb;
+	}
+	return nr;
+}
+
+static void wb_destroy_helpers(struct wb_writeback_helper *helpers,
+			       int nr_helpers)
+{
+	int i;
+
+	for (i = 0; i < nr_helpers; i++)
+		destroy_work_on_stack(&helpers[i].work);
+}
+
+/*
+ * Hand out equal shares of @work's page budget to the helpers and start
+ * them on the freshly queued b_io list.  The caller keeps the remaining
+ * share in @work.  Returns the number of helpers started.
+ */
+static int wb_start_helpers(struct bdi_writeback *wb,
+			    struct wb_writeback_work *work,
+			    struct wb_writeback_helper *helpers, int nr_helpers)
+{
+	long share;
+	int i;
+
+	assert_spin_locked(&wb->list_lock);
+
+	/* Not worth waking anybody up for a single inode. */
+	if (!nr_helpers || list_empty(&wb->b_io) ||
+	    list_is_singular(&wb->b_io))
+		return 0;
+
+	share = work->nr_pages / (nr_helpers + 1);
+	if (share < MIN_WRITEBACK_PAGES)
+		return 0;
+
+	for (i = 0; i < nr_helpers; i++) {
+		helpers[i].wwork = *work;
+		helpers[i].wwork.nr_pages = share;
+		helpers[i].wwork.done = NULL;
+		helpers[i].wwork.auto_free = 0;
+		INIT_LIST_HEAD(&helpers[i].wwork.list);
+		helpers[i].progress = 0;
+		queue_work(wb_helper_wq, &helpers[i].work);
+	}
+	work->nr_pages -= share * nr_helpers;
+	return nr_helpers;
+}
+
+/*
+ * Wait for the helpers started by wb_start_helpers() and fold their unused
+ * page budget and progress back into @work.  Called with wb->list_lock
+ * held, which is dropped while waiting.
+ */
+static long wb_wait_helpers(struct bdi_writeback *wb,
+			    struct wb_writeback_work *work,
+			    struct wb_writeback_helper *helpers, int started)
+{
+	long progress = 0;
+	int i;
+
+	if (!started)
+		return 0;
+
+	spin_unlock(&wb->list_lock);
+	for (i = 0; i < started; i++) {
+		flush_work(&helpers[i].work);
+		work->nr_pages += helpers[i].wwork.nr_pages;
+		progress += helpers[i].progress;
+	}
+	spin_lock(&wb->list_lock);
+	return progress;
+}
+
 /*
  * Explicit flushing or periodic writeback of "old" data.
  *
@@ -1859,6 +1988,10 @@ static long wb_writeback(struct bdi_writeback *wb,
 	struct inode *inode;
 	long progress;
 	struct blk_plug plug;
+	struct wb_writeback_helper helpers[WB_MAX_WORKERS - 1];
+	int nr_helpers, started;
+
+	nr_helpers = wb_init_helpers(wb, helpers);
 
 	blk_start_plug(&plug);
 	spin_lock(&wb->list_lock);
@@ -1901,10 +2034,12 @@ static long wb_writeback(struct bdi_writeback *wb,
 		trace_writeback_start(wb, work);
 		if (list_empty(&wb->b_io))
 			queue_io(wb, work, dirtied_before);
+		started = wb_start_helpers(wb, work, helpers, nr_helpers);
 		if (work->sb)
 			progress = writeback_sb_inodes(work->sb, wb, work);
 		else
 			progress = __writeback_inodes_wb(wb, work);
+		progress += wb_wait_helpers(wb, work, helpers, started);
 		trace_writeback_written(wb, work);
 
 		wb_update_bandwidth(wb, wb_start);
@@ -1939,6 +2074,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 	}
 	spin_unlock(&wb->list_lock);
 	blk_finish_plug(&plug);
+	wb_destroy_helpers(helpers, nr_helpers);
 
 	return nr_pages - work->nr_pages;
 }
@@ -2205,6 +2341,37 @@ int dirtytime_interval_handler(struct ctl_table *table, int write,
 	return ret;
 }
 
+static int max_writeback_workers = WB_MAX_WORKERS;
+
+static struct ctl_table writeback_workers_table[] = {
+	{
+		.procname	= "dirty_writeback_workers",
+		.data		= &dirty_writeback_workers,
+		.maxlen		= sizeof(dirty_writeback_workers),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ONE,
+		.extra2		= &max_writeback_workers,
+	},
+	{ }
+};
+
+static int __init writeback_workers_init(void)
+{
+	/*
+	 * Helpers are waited on from the flusher, which itself may be running
+	 * off bdi_wq's rescuer, so they need a rescuer of their own.
+	 */
+	wb_helper_wq = alloc_workqueue("writeback_helper",
+				       WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!wb_helper_wq)
+		return -ENOMEM;
+
+	register_sysctl("vm", writeback_workers_table);
+	return 0;
+}
+__initcall(writeback_workers_init);
+
 /**
  * __mark_inode_dirty -	internal function
  *
@@ -6,6 +6,7 @@
 #include <linux/jiffies.h>
 #include <linux/kernel.h> /* UINT_MAX */
 #include <linux/mount.h>
+#include <linux/pid_namespace.h>
 #include <linux/sched.h>
 #include <linux/sched/user.h>
 #include <linux/sched/signal.h>
@@ -14,6 +15,7 @@
 #include <linux/audit.h>
 #include <linux/sched/mm.h>
 #include <linux/statfs.h>
+#include <linux/vmalloc.h>
 
 #include "fanotify.h"
 
@@ -132,29 +134,37 @@ static bool fanotify_should_merge(struct fsnotify_event *old_fsn,
 /* Limit event merges to limit CPU overhead per event */
 #define FANOTIFY_MAX_MERGE_EVENTS 128
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+/*
+ * Look for a queued event to merge with in the hash bucket of the new
+ * event.  The whole queue is covered, not only its tail, and the number
+ * of comparisons stays bounded per bucket.
+ *
+ * Called with group->notification_lock held.
+ */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
 {
-	struct fsnotify_event *test_event;
-	struct fanotify_event *new;
+	struct fanotify_event *old, *new = FANOTIFY_E(event);
+	struct hlist_head *hlist;
 	int i = 0;
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
-	new = FANOTIFY_E(event);
+	pr_debug("%s: group=%p event=%p bucket=%u\n", __func__,
+		 group, event, new->hash);
 
 	/*
 	 * Don't merge a permission event with any other event so that we know
 	 * the event structure we have created in fanotify_handle_event() is the
 	 * one we should check for permission response.
 	 */
-	if (fanotify_is_perm_event(new->mask))
+	if (!fanotify_is_hashed_event(new->mask))
 		return 0;
 
-	list_for_each_entry_reverse(test_event, list, list) {
+	hlist = fanotify_event_hash_bucket(group, new);
+	hlist_for_each_entry(old, hlist, merge_list) {
 		if (++i > FANOTIFY_MAX_MERGE_EVENTS)
 			break;
-		if (fanotify_should_merge(test_event, event)) {
-			FANOTIFY_E(test_event)->mask |= new->mask;
+		if (fanotify_should_merge(&old->fse, event)) {
+			old->mask |= new->mask;
 			return 1;
 		}
 	}
@@ -162,6 +172,27 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+/*
+ * Add an event to the merge hash and, if the listener set up an event
+ * ring, make sure the ring gets refilled.
+ *
+ * Called with group->notification_lock held.
+ */
+static void fanotify_insert_event(struct fsnotify_group *group,
+				  struct fsnotify_event *fsn_event)
+{
+	struct fanotify_event *event = FANOTIFY_E(fsn_event);
+
+	assert_spin_locked(&group->notification_lock);
+
+	if (fanotify_is_hashed_event(event->mask))
+		hlist_add_head(&event->merge_list,
+			       fanotify_event_hash_bucket(group, event));
+
+	if (group->fanotify_data.ring)
+		queue_work(system_unbound_wq, &group->fanotify_data.ring_work);
+}
+
 /*
  * Wait for response to permission event. The function also takes care of
  * freeing the permission event (or offloads that in case the wait is canceled
@@ -612,6 +643,7 @@ static struct fanotify_event *fanotify_alloc_event(struct fsnotify_group *group,
 		event->pid = get_pid(task_pid(current));
 	else
 		event->pid = get_pid(task_tgid(current));
+	fanotify_event_hash_init(event);
 
 out:
 	set_active_memcg(old_memcg);
@@ -721,7 +753,8 @@ static int fanotify_handle_event(struct fsnotify_group *group, u32 mask,
 	}
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FANOTIFY_PERM_EVENTS);
@@ -744,6 +777,10 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 {
 	struct user_struct *user;
 
+	kfree(group->fanotify_data.merge_hash);
+	vfree(group->fanotify_data.ring);
+	if (group->fanotify_data.ring_pid_ns)
+		put_pid_ns(group->fanotify_data.ring_pid_ns);
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
@@ -3,6 +3,7 @@
 #include <linux/path.h>
 #include <linux/slab.h>
 #include <linux/exportfs.h>
+#include <linux/hash.h>
 
 extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_fid_event_cachep;
@@ -139,19 +140,43 @@ enum fanotify_event_type {
 
 struct fanotify_event {
 	struct fsnotify_event fse;
+	struct hlist_node merge_list;	/* List for hashed merge */
 	u32 mask;
+	unsigned int hash;
 	enum fanotify_event_type type;
 	struct pid *pid;
 };
 
+/*
+ * Queued events are hashed by object id and pid, so a new event only has
+ * to be compared with the queued events that could possibly merge with it.
+ */
+#define FANOTIFY_HTABLE_BITS	(7)
+#define FANOTIFY_HTABLE_SIZE	(1 << FANOTIFY_HTABLE_BITS)
+
 static inline void fanotify_init_event(struct fanotify_event *event,
 				       unsigned long id, u32 mask)
 {
 	fsnotify_init_event(&event->fse, id);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->mask = mask;
+	event->hash = 0;
 	event->pid = NULL;
 }
 
+static inline void fanotify_event_hash_init(struct fanotify_event *event)
+{
+	event->hash = hash_long(event->fse.objectid ^ (unsigned long)event->pid,
+				FANOTIFY_HTABLE_BITS);
+}
+
+static inline struct hlist_head *fanotify_event_hash_bucket(
+						struct fsnotify_group *group,
+						struct fanotify_event *event)
+{
+	return &group->fanotify_data.merge_hash[event->hash];
+}
+
 struct fanotify_fid_event {
 	struct fanotify_event fae;
 	__kernel_fsid_t fsid;
@@ -264,6 +289,12 @@ static inline bool fanotify_is_perm_event(u32 mask)
 		mask & FANOTIFY_PERM_EVENTS;
 }
 
+/* Permission events and the overflow event are never merged */
+static inline bool fanotify_is_hashed_event(u32 mask)
+{
+	return !fanotify_is_perm_event(mask) && !(mask & FS_Q_OVERFLOW);
+}
+
 static inline struct fanotify_event *FANOTIFY_E(struct fsnotify_event *fse)
 {
 	return container_of(fse, struct fanotify_event, fse);
@@ -284,3 +315,10 @@ static inline struct path *fanotify_event_path(struct fanotify_event *event)
 	else
 		return NULL;
 }
+
+static inline void fanotify_unhash_event(struct fsnotify_group *group,
+					 struct fanotify_event *event)
+{
+	assert_spin_locked(&group->notification_lock);
+	hlist_del_init(&event->merge_list);
+}
@@ -17,8 +17,11 @@
 #include <linux/compat.h>
 #include <linux/sched/signal.h>
 #include <linux/memcontrol.h>
+#include <linux/pid_namespace.h>
 #include <linux/statfs.h>
 #include <linux/exportfs.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
 
 #include <asm/ioctls.h>
 
@@ -118,6 +121,7 @@ static struct fanotify_event *get_one_event(struct fsnotify_group *group,
 		goto out;
 	}
 	event = FANOTIFY_E(fsnotify_remove_first_event(group));
+	fanotify_unhash_event(group, event);
 	if (fanotify_is_perm_event(event->mask))
 		FANOTIFY_PERM(event)->state = FAN_EVENT_REPORTED;
 out:
@@ -225,9 +229,9 @@ static int process_access_response(struct fsnotify_group *group,
 	return -ENOENT;
 }
 
-static int copy_info_to_user(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
+static int copy_info_to_iter(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
 			     int info_type, const char *name, size_t name_len,
-			     char __user *buf, size_t count)
+			     struct iov_iter *to)
 {
 	struct fanotify_event_info_fid info = { };
 	struct file_handle handle = { };
@@ -235,6 +239,7 @@ static int copy_info_to_user(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
 	size_t fh_len = fh ? fh->len : 0;
 	size_t info_len = fanotify_fid_info_len(fh_len, name_len);
 	size_t len = info_len;
+	size_t count = iov_iter_count(to);
 
 	pr_debug("%s: fh_len=%zu name_len=%zu, info_len=%zu, count=%zu\n",
 		 __func__, fh_len, name_len, info_len, count);
@@ -266,20 +271,18 @@ static int copy_info_to_user(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
 	info.hdr.info_type = info_type;
 	info.hdr.len = len;
 	info.fsid = *fsid;
-	if (copy_to_user(buf, &info, sizeof(info)))
+	if (copy_to_iter(&info, sizeof(info), to) != sizeof(info))
 		return -EFAULT;
 
-	buf += sizeof(info);
 	len -= sizeof(info);
 	if (WARN_ON_ONCE(len < sizeof(handle)))
 		return -EFAULT;
 
 	handle.handle_type = fh->type;
 	handle.handle_bytes = fh_len;
-	if (copy_to_user(buf, &handle, sizeof(handle)))
+	if (copy_to_iter(&handle, sizeof(handle), to) != sizeof(handle))
 		return -EFAULT;
 
-	buf += sizeof(handle);
 	len -= sizeof(handle);
 	if (WARN_ON_ONCE(len < fh_len))
 		return -EFAULT;
@@ -293,10 +296,9 @@ static int copy_info_to_user(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
 		memcpy(bounce, fh_buf, fh_len);
 		fh_buf = bounce;
 	}
-	if (copy_to_user(buf, fh_buf, fh_len))
+	if (copy_to_iter(fh_buf, fh_len, to) != fh_len)
 		return -EFAULT;
 
-	buf += fh_len;
 	len -= fh_len;
 
 	if (name_len) {
@@ -305,24 +307,28 @@ static int copy_info_to_user(__kernel_fsid_t *fsid, struct fanotify_fh *fh,
 		if (WARN_ON_ONCE(len < name_len))
 			return -EFAULT;
 
-		if (copy_to_user(buf, name, name_len))
+		if (copy_to_iter(name, name_len, to) != name_len)
 			return -EFAULT;
 
-		buf += name_len;
 		len -= name_len;
 	}
 
 	/* Pad with 0's */
 	WARN_ON_ONCE(len < 0 || len >= FANOTIFY_EVENT_ALIGN);
-	if (len > 0 && clear_user(buf, len))
+	if (len > 0 && iov_iter_zero(len, to) != len)
 		return -EFAULT;
 
 	return info_len;
 }
 
-static ssize_t copy_event_to_user(struct fsnotify_group *group,
+/*
+ * Format an event into @to, which is either the user buffer passed to read()
+ * or a slot of the event ring.  The pid is reported as seen from @pid_ns.
+ */
+static ssize_t copy_event_to_iter(struct fsnotify_group *group,
 				  struct fanotify_event *event,
-				  char __user *buf, size_t count)
+				  struct iov_iter *to,
+				  struct pid_namespace *pid_ns)
 {
 	struct fanotify_event_metadata metadata;
 	struct path *path = fanotify_event_path(event);
@@ -340,7 +346,7 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	metadata.vers = FANOTIFY_METADATA_VERSION;
 	metadata.reserved = 0;
 	metadata.mask = event->mask & FANOTIFY_OUTGOING_EVENTS;
-	metadata.pid = pid_vnr(event->pid);
+	metadata.pid = pid_nr_ns(event->pid, pid_ns);
 
 	if (path && path->mnt && path->dentry) {
 		fd = create_fd(group, path, &f);
@@ -354,15 +360,13 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	 * Sanity check copy size in case get_one_event() and
 	 * event_len sizes ever get out of sync.
 	 */
-	if (WARN_ON_ONCE(metadata.event_len > count))
+	if (WARN_ON_ONCE(metadata.event_len > iov_iter_count(to)))
 		goto out_close_fd;
 
-	if (copy_to_user(buf, &metadata, FAN_EVENT_METADATA_LEN))
+	if (copy_to_iter(&metadata, FAN_EVENT_METADATA_LEN, to) !=
+	    FAN_EVENT_METADATA_LEN)
 		goto out_close_fd;
 
-	buf += FAN_EVENT_METADATA_LEN;
-	count -= FAN_EVENT_METADATA_LEN;
-
 	if (fanotify_is_perm_event(event->mask))
 		FANOTIFY_PERM(event)->fd = fd;
 
@@ -370,15 +374,12 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	if (fanotify_event_dir_fh_len(event)) {
 		info_type = info->name_len ? FAN_EVENT_INFO_TYPE_DFID_NAME :
 					     FAN_EVENT_INFO_TYPE_DFID;
-		ret = copy_info_to_user(fanotify_event_fsid(event),
+		ret = copy_info_to_iter(fanotify_event_fsid(event),
 					fanotify_info_dir_fh(info),
 					info_type, fanotify_info_name(info),
-					info->name_len, buf, count);
+					info->name_len, to);
 		if (ret < 0)
 			goto out_close_fd;
-
-		buf += ret;
-		count -= ret;
 	}
 
 	if (fanotify_event_object_fh_len(event)) {
@@ -419,14 +420,11 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 			info_type = FAN_EVENT_INFO_TYPE_FID;
 		}
 
-		ret = copy_info_to_user(fanotify_event_fsid(event),
+		ret = copy_info_to_iter(fanotify_event_fsid(event),
 					fanotify_event_object_fh(event),
-					info_type, dot, dot_len, buf, count);
+					info_type, dot, dot_len, to);
 		if (ret < 0)
 			goto out_close_fd;
-
-		buf += ret;
-		count -= ret;
 	}
 
 	if (f)
@@ -442,6 +440,190 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	return ret;
 }
 
+/*
+ * Write a record with a zero mask, which the listener skips, to fill @len
+ * bytes of the event ring at @pos.
+ */
+static void fanotify_ring_pad(struct fanotify_ring *ring, u32 pos, u32 len)
+{
+	struct fanotify_event_metadata pad = {
+		.event_len = len,
+		.vers = FANOTIFY_METADATA_VERSION,
+		.metadata_len = FAN_EVENT_METADATA_LEN,
+		.fd = FAN_NOFD,
+	};
+
+	memcpy(ring->data + pos, &pad, FAN_EVENT_METADATA_LEN);
+}
+
+/*
+ * Reserve @len contiguous bytes at the ring tail, padding up to the end of
+ * the ring if needed.  Only the ring worker produces, so the private copy
+ * of the tail needs no locking.  Returns false if the ring is full.
+ */
+static bool fanotify_ring_reserve(struct fsnotify_group *group, u32 len,
+				  u32 *pos)
+{
+	struct fanotify_ring *ring = group->fanotify_data.ring;
+	u32 size = group->fanotify_data.ring_size;
+	u32 tail = group->fanotify_data.ring_tail;
+	/* pairs with the release store of head by the listener */
+	u32 used = tail - smp_load_acquire(&ring->head);
+	u32 off = tail & (size - 1);
+	u32 to_end = size - off;
+	u32 need = len;
+
+	/* A bogus head from the listener just makes the ring look full */
+	if (used > size)
+		return false;
+	if (to_end < len)
+		need += to_end;
+	if (size - used < need)
+		return false;
+
+	if (to_end < len) {
+		if (to_end >= FAN_EVENT_METADATA_LEN)
+			fanotify_ring_pad(ring, off, to_end);
+		tail += to_end;
+		off = 0;
+	}
+	group->fanotify_data.ring_tail = tail + len;
+	*pos = off;
+	return true;
+}
+
+/*
+ * Move queued events into the event ring, oldest first, until either the
+ * queue is empty or the ring is full.  Events stay in the queue, and are
+ * merged with, until the worker gets to them.
+ */
+static void fanotify_ring_work(struct work_struct *work)
+{
+	struct fsnotify_group *group = container_of(work,
+			struct fsnotify_group, fanotify_data.ring_work);
+	struct fanotify_ring *ring = group->fanotify_data.ring;
+	unsigned int fid_mode = FAN_GROUP_FLAG(group, FANOTIFY_FID_BITS);
+	bool produced = false;
+
+	for (;;) {
+		struct fanotify_event *event;
+		struct iov_iter to;
+		struct kvec kvec;
+		u32 len, pos;
+
+		cond_resched();
+		spin_lock(&group->notification_lock);
+		if (fsnotify_notify_queue_is_empty(group)) {
+			spin_unlock(&group->notification_lock);
+			break;
+		}
+		event = FANOTIFY_E(fsnotify_peek_first_event(group));
+		len = FAN_EVENT_METADATA_LEN +
+		      fanotify_event_info_len(fid_mode, event);
+		if (!fanotify_ring_reserve(group, len, &pos)) {
+			ring->full++;
+			spin_unlock(&group->notification_lock);
+			break;
+		}
+		fsnotify_remove_first_event(group);
+		fanotify_unhash_event(group, event);
+		spin_unlock(&group->notification_lock);
+
+		kvec.iov_base = ring->data + pos;
+		kvec.iov_len = len;
+		iov_iter_kvec(&to, READ, &kvec, 1, len);
+		if (copy_event_to_iter(group, event, &to,
+				       group->fanotify_data.ring_pid_ns) != len)
+			fanotify_ring_pad(ring, pos, len);
+
+		/* pairs with the acquire load of tail by the listener */
+		smp_store_release(&ring->tail, group->fanotify_data.ring_tail);
+		fsnotify_destroy_event(group, &event->fse);
+		produced = true;
+	}
+
+	if (produced)
+		wake_up(&group->notification_waitq);
+}
+
+static bool fanotify_ring_pending(struct fsnotify_group *group)
+{
+	struct fanotify_ring *ring = group->fanotify_data.ring;
+
+	return ring && READ_ONCE(ring->head) != READ_ONCE(ring->tail);
+}
+
+static int fanotify_setup_ring(struct fsnotify_group *group,
+			       struct fanotify_ring_setup __user *arg)
+{
+	struct fanotify_ring_setup setup;
+	struct fanotify_ring *ring;
+	size_t mmap_size;
+	int ret = 0;
+
+	/* The reader has no fds installed for it, so only fids can be reported */
+	if (!FAN_GROUP_FLAG(group, FANOTIFY_FID_BITS))
+		return -EINVAL;
+
+	if (copy_from_user(&setup, arg, sizeof(setup)))
+		return -EFAULT;
+	if (setup.flags || !is_power_of_2(setup.size) ||
+	    setup.size < FAN_RING_MIN_SIZE || setup.size > FAN_RING_MAX_SIZE)
+		return -EINVAL;
+
+	mmap_size = PAGE_ALIGN(struct_size(ring, data, setup.size));
+	ring = vmalloc_user(mmap_size);
+	if (!ring)
+		return -ENOMEM;
+	ring->size = setup.size;
+
+	spin_lock(&group->notification_lock);
+	if (group->fanotify_data.ring) {
+		ret = -EBUSY;
+	} else {
+		group->fanotify_data.ring_size = setup.size;
+		group->fanotify_data.ring_tail = 0;
+		/*
+		 * The worker runs in a kworker, so pids are translated into the
+		 * namespace of the task that set up the ring.
+		 */
+		group->fanotify_data.ring_pid_ns =
+			get_pid_ns(task_active_pid_ns(current));
+		group->fanotify_data.ring = ring;
+		/* Move what is already queued */
+		if (!fsnotify_notify_queue_is_empty(group))
+			queue_work(system_unbound_wq,
+				   &group->fanotify_data.ring_work);
+	}
+	spin_unlock(&group->notification_lock);
+	if (ret) {
+		vfree(ring);
+		return ret;
+	}
+
+	setup.mmap_size = mmap_size;
+	if (copy_to_user(arg, &setup, sizeof(setup)))
+		return -EFAULT;
+	return 0;
+}
+
+static int fanotify_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fsnotify_group *group = file->private_data;
+	struct fanotify_ring *ring;
+
+	spin_lock(&group->notification_lock);
+	ring = group->fanotify_data.ring;
+	spin_unlock(&group->notification_lock);
+
+	if (!ring || vma->vm_pgoff)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	/* remap_vmalloc_range() checks the size against the allocation */
+	return remap_vmalloc_range(vma, ring, 0);
+}
+
 /* intofiy userspace file descriptor functions */
 static __poll_t fanotify_poll(struct file *file, poll_table *wait)
 {
@@ -450,8 +632,15 @@ static __poll_t fanotify_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &group->notification_waitq, wait);
 	spin_lock(&group->notification_lock);
-	if (!fsnotify_notify_queue_is_empty(group))
+	if (!fsnotify_notify_queue_is_empty(group)) {
+		ret = EPOLLIN | EPOLLRDNORM;
+		/* The listener may have made room in the ring since */
+		if (group->fanotify_data.ring)
+			queue_work(system_unbound_wq,
+				   &group->fanotify_data.ring_work);
+	} else if (fanotify_ring_pending(group)) {
 		ret = EPOLLIN | EPOLLRDNORM;
+	}
 	spin_unlock(&group->notification_lock);
 
 	return ret;
@@ -462,15 +651,20 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 {
 	struct fsnotify_group *group;
 	struct fanotify_event *event;
-	char __user *start;
+	struct iovec iov;
+	struct iov_iter to;
 	int ret;
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
-	start = buf;
 	group = file->private_data;
 
 	pr_debug("%s: group=%p\n", __func__, group);
 
+	ret = import_single_range(READ, buf, count, &iov, &to);
+	if (ret)
+		return ret;
+	count = iov_iter_count(&to);
+
 	add_wait_queue(&group->notification_waitq, &wait);
 	while (1) {
 		/*
@@ -478,7 +672,7 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 		 * in case there are lots of available events.
 		 */
 		cond_resched();
-		event = get_one_event(group, count);
+		event = get_one_event(group, iov_iter_count(&to));
 		if (IS_ERR(event)) {
 			ret = PTR_ERR(event);
 			break;
@@ -493,14 +687,15 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 			if (signal_pending(current))
 				break;
 
-			if (start != buf)
+			if (iov_iter_count(&to) != count)
 				break;
 
 			wait_woken(&wait, TASK_INTERRUPTIBLE, MAX_SCHEDULE_TIMEOUT);
 			continue;
 		}
 
-		ret = copy_event_to_user(group, event, buf, count);
+		ret = copy_event_to_iter(group, event, &to,
+					 task_active_pid_ns(current));
 		if (unlikely(ret == -EOPENSTALE)) {
 			/*
 			 * We cannot report events with stale fd so drop it.
@@ -532,13 +727,11 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 		}
 		if (ret < 0)
 			break;
-		buf += ret;
-		count -= ret;
 	}
 	remove_wait_queue(&group->notification_waitq, &wait);
 
-	if (start != buf && ret != -EFAULT)
-		ret = buf - start;
+	if (iov_iter_count(&to) != count && ret != -EFAULT)
+		ret = count - iov_iter_count(&to);
 	return ret;
 }
 
@@ -581,6 +774,9 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 */
 	fsnotify_group_stop_queueing(group);
 
+	/* No more events can be inserted, so the ring worker stays idle */
+	cancel_work_sync(&group->fanotify_data.ring_work);
+
 	/*
 	 * Process all permission events on access_list and notification queue
 	 * and simulate reply from userspace.
@@ -605,6 +801,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 		struct fanotify_event *event;
 
 		event = FANOTIFY_E(fsnotify_remove_first_event(group));
+		fanotify_unhash_event(group, event);
 		if (!(event->mask & FANOTIFY_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, &event->fse);
@@ -645,6 +842,9 @@ static long fanotify_ioctl(struct file *file, unsigned int cmd, unsigned long ar
 		spin_unlock(&group->notification_lock);
 		ret = put_user(send_len, (int __user *) p);
 		break;
+	case FAN_IOC_SETUP_RING:
+		ret = fanotify_setup_ring(group, p);
+		break;
 	}
 
 	return ret;
@@ -655,6 +855,7 @@ static const struct file_operations fanotify_fops = {
 	.poll		= fanotify_poll,
 	.read		= fanotify_read,
 	.write		= fanotify_write,
+	.mmap		= fanotify_mmap,
 	.fasync		= NULL,
 	.release	= fanotify_release,
 	.unlocked_ioctl	= fanotify_ioctl,
@@ -919,6 +1120,22 @@ static struct fsnotify_event *fanotify_alloc_overflow_event(void)
 	return &oevent->fse;
 }
 
+static struct hlist_head *fanotify_alloc_merge_hash(void)
+{
+	struct hlist_head *hash;
+	int i;
+
+	hash = kmalloc(sizeof(struct hlist_head) << FANOTIFY_HTABLE_BITS,
+		       GFP_KERNEL_ACCOUNT);
+	if (!hash)
+		return NULL;
+
+	for (i = 0; i < FANOTIFY_HTABLE_SIZE; i++)
+		INIT_HLIST_HEAD(&hash[i]);
+
+	return hash;
+}
+
 /* fanotify syscalls */
 SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 {
@@ -993,6 +1210,13 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 		goto out_destroy_group;
 	}
 
+	group->fanotify_data.merge_hash = fanotify_alloc_merge_hash();
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+	INIT_WORK(&group->fanotify_data.ring_work, fanotify_ring_work);
+
 	if (force_o_largefile())
 		event_f_flags |= O_LARGEFILE;
 	group->fanotify_data.f_flags = event_f_flags;
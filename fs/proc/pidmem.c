@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * /proc/pidmem: batched binary memory/cpu statistics for many processes.
+ *
+ * Monitoring agents used to read /proc/<pid>/status or smaps_rollup for
+ * every process every few seconds.  This file lets them sample all the
+ * processes they care about with one pread(), reporting only counters the
+ * mm already maintains incrementally, so the cost does not grow with the
+ * size of the processes.
+ */
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pid_namespace.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/proc_pidmem.h>
+
+#include "internal.h"
+
+struct pidmem_private {
+	struct mutex lock;	/* protects pids/nr_pids */
+	pid_t *pids;
+	unsigned int nr_pids;
+};
+
+static void pidmem_fill(struct pid_namespace *ns, struct proc_fs_info *fs_info,
+			pid_t nr, struct proc_pidmem *rec)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	unsigned long anon, file, shmem, hiwater_rss;
+	u64 utime, stime;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->pid = nr;
+
+	rcu_read_lock();
+	task = find_task_by_pid_ns(nr, ns);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rec->error = -ESRCH;
+		return;
+	}
+
+	/* Same visibility rules as /proc/<pid> itself */
+	if (!has_pid_permissions(fs_info, task, HIDEPID_NO_ACCESS)) {
+		rec->error = -ENOENT;
+		goto out;
+	}
+
+	thread_group_cputime_adjusted(task, &utime, &stime);
+	rec->utime = utime;
+	rec->stime = stime;
+	rec->nr_threads = get_nr_threads(task);
+
+	if (task->flags & PF_KTHREAD) {
+		rec->flags |= PROC_PIDMEM_KTHREAD;
+		goto out;
+	}
+
+	/* An exiting task has already dropped its mm, report no memory */
+	mm = get_task_mm(task);
+	if (!mm)
+		goto out;
+
+	/* See task_mem() for why these racy snapshots are good enough */
+	anon = get_mm_counter(mm, MM_ANONPAGES);
+	file = get_mm_counter(mm, MM_FILEPAGES);
+	shmem = get_mm_counter(mm, MM_SHMEMPAGES);
+	hiwater_rss = max(anon + file + shmem, READ_ONCE(mm->hiwater_rss));
+
+	rec->vm_size = (u64)READ_ONCE(mm->total_vm) << PAGE_SHIFT;
+	rec->vm_hwm = (u64)hiwater_rss << PAGE_SHIFT;
+	rec->rss_anon = (u64)anon << PAGE_SHIFT;
+	rec->rss_file = (u64)file << PAGE_SHIFT;
+	rec->rss_shmem = (u64)shmem << PAGE_SHIFT;
+	rec->swap = (u64)get_mm_counter(mm, MM_SWAPENTS) << PAGE_SHIFT;
+	rec->pgtables = mm_pgtables_bytes(mm);
+	mmput(mm);
+out:
+	put_task_struct(task);
+}
+
+static ssize_t pidmem_read(struct file *file, char __user *buf, size_t count,
+			   loff_t *ppos)
+{
+	struct pidmem_private *priv = file->private_data;
+	struct super_block *sb = file_inode(file)->i_sb;
+	struct pid_namespace *ns = proc_pid_ns(sb);
+	struct proc_fs_info *fs_info = proc_sb_info(sb);
+	struct proc_pidmem rec;
+	ssize_t done = 0;
+	unsigned int i;
+	loff_t pos = *ppos;
+
+	/* Only whole records are returned */
+	if (pos % sizeof(rec))
+		return -EINVAL;
+
+	mutex_lock(&priv->lock);
+	/* Past the last record is EOF, whatever the buffer size */
+	if (pos / sizeof(rec) >= priv->nr_pids)
+		goto out;
+	if (count < sizeof(rec)) {
+		done = -EINVAL;
+		goto out;
+	}
+
+	for (i = pos / sizeof(rec); i < priv->nr_pids; i++) {
+		if (count - done < sizeof(rec))
+			break;
+		pidmem_fill(ns, fs_info, priv->pids[i], &rec);
+		if (copy_to_user(buf + done, &rec, sizeof(rec))) {
+			if (!done)
+				done = -EFAULT;
+			break;
+		}
+		done += sizeof(rec);
+		cond_resched();
+	}
+out:
+	mutex_unlock(&priv->lock);
+
+	if (done > 0)
+		*ppos = pos + done;
+	return done;
+}
+
+static ssize_t pidmem_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct pidmem_private *priv = file->private_data;
+	pid_t *pids;
+
+	if (*ppos || count % sizeof(pid_t) ||
+	    count > PROC_PIDMEM_MAX_PIDS * sizeof(pid_t))
+		return -EINVAL;
+
+	pids = memdup_user(buf, count);
+	if (IS_ERR(pids))
+		return PTR_ERR(pids);
+
+	mutex_lock(&priv->lock);
+	kfree(priv->pids);
+	priv->pids = pids;
+	priv->nr_pids = count / sizeof(pid_t);
+	mutex_unlock(&priv->lock);
+
+	return count;
+}
+
+static int pidmem_open(struct inode *inode, struct file *file)
+{
+	struct pidmem_private *priv;
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL_ACCOUNT);
+	if (!priv)
+		return -ENOMEM;
+
+	mutex_init(&priv->lock);
+	file->private_data = priv;
+	return 0;
+}
+
+static int pidmem_release(struct inode *inode, struct file *file)
+{
+	struct pidmem_private *priv = file->private_data;
+
+	kfree(priv->pids);
+	kfree(priv);
+	return 0;
+}
+
+static const struct proc_ops pidmem_proc_ops = {
+	.proc_flags	= PROC_ENTRY_PERMANENT,
+	.proc_open	= pidmem_open,
+	.proc_read	= pidmem_read,
+	.proc_write	= pidmem_write,
+	.proc_lseek	= default_llseek,
+	.proc_release	= pidmem_release,
+};
+
+static int __init proc_pidmem_init(void)
+{
+	proc_create("pidmem", 0666, NULL, &pidmem_proc_ops);
+	return 0;
+}
+fs_initcall(proc_pidmem_init);
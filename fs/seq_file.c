@@ -16,6 +16,7 @@
 #include <linux/slab.h>
 #include <linux/cred.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
 #include <linux/printk.h>
 #include <linux/string_helpers.h>
 #include <linux/uio.h>
@@ -25,6 +26,15 @@
 
 static struct kmem_cache *seq_file_cache __ro_after_init;
 
+/*
+ * Most seq_files never need more than the initial PAGE_SIZE buffer, and
+ * many are opened, read once and closed.  Keep one such buffer per cpu
+ * around so that this pattern does not hit the allocator every time.
+ * The memcg charge stays with whoever allocated the buffer first, which
+ * is bounded to one page per cpu.
+ */
+static DEFINE_PER_CPU(void *, seq_buf_cache);
+
 static void seq_set_overflow(struct seq_file *m)
 {
 	m->count = m->size;
@@ -35,9 +45,23 @@ static void *seq_buf_alloc(unsigned long size)
 	if (unlikely(size > MAX_RW_COUNT))
 		return NULL;
 
+	if (size == PAGE_SIZE) {
+		void *buf = this_cpu_xchg(seq_buf_cache, NULL);
+
+		if (buf)
+			return buf;
+	}
 	return kvmalloc(size, GFP_KERNEL_ACCOUNT);
 }
 
+static void seq_buf_free(void *buf, size_t size)
+{
+	if (buf && size == PAGE_SIZE &&
+	    !this_cpu_cmpxchg(seq_buf_cache, NULL, buf))
+		return;
+	kvfree(buf);
+}
+
 /**
  *	seq_open -	initialize sequential file
  *	@file: file we initialize
@@ -95,6 +119,7 @@ static int traverse(struct seq_file *m, loff_t offset)
 
 	m->index = 0;
 	m->count = m->from = 0;
+	seq_cursor_reset(m);
 	if (!offset)
 		return 0;
 
@@ -133,7 +158,7 @@ static int traverse(struct seq_file *m, loff_t offset)
 
 Eoverflow:
 	m->op->stop(m, p);
-	kvfree(m->buf);
+	seq_buf_free(m->buf, m->size);
 	m->count = 0;
 	m->buf = seq_buf_alloc(m->size <<= 1);
 	return !m->buf ? -ENOMEM : -EAGAIN;
@@ -188,6 +213,7 @@ ssize_t seq_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	if (iocb->ki_pos == 0) {
 		m->index = 0;
 		m->count = 0;
+		seq_cursor_reset(m);
 	}
 
 	/* Don't assume ki_pos is where we left it */
@@ -240,7 +266,7 @@ ssize_t seq_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 			goto Fill;
 		// need a bigger buffer
 		m->op->stop(m, p);
-		kvfree(m->buf);
+		seq_buf_free(m->buf, m->size);
 		m->count = 0;
 		m->buf = seq_buf_alloc(m->size <<= 1);
 		if (!m->buf)
@@ -352,7 +378,7 @@ EXPORT_SYMBOL(seq_lseek);
 int seq_release(struct inode *inode, struct file *file)
 {
 	struct seq_file *m = file->private_data;
-	kvfree(m->buf);
+	seq_buf_free(m->buf, m->size);
 	kmem_cache_free(seq_file_cache, m);
 	return 0;
 }
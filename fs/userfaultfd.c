@@ -27,6 +27,8 @@
 #include <linux/ioctl.h>
 #include <linux/security.h>
 #include <linux/hugetlb.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
 
 int sysctl_unprivileged_userfaultfd __read_mostly = 1;
 
@@ -69,6 +71,12 @@ struct userfaultfd_ctx {
 	bool mmap_changing;
 	/* mm with one ore more vmas attached to this userfaultfd_ctx */
 	struct mm_struct *mm;
+	/* fault ring shared with userland, protected by fault_pending_wqh lock */
+	struct uffd_ring *ring;
+	/* kernel private copy of the ring producer index and size */
+	unsigned int ring_tail;
+	unsigned int ring_entries;
+	size_t ring_size;
 };
 
 struct userfaultfd_fork_ctx {
@@ -173,6 +181,7 @@ static void userfaultfd_ctx_put(struct userfaultfd_ctx *ctx)
 		VM_BUG_ON(waitqueue_active(&ctx->event_wqh));
 		VM_BUG_ON(spin_is_locked(&ctx->fd_wqh.lock));
 		VM_BUG_ON(waitqueue_active(&ctx->fd_wqh));
+		vfree(ctx->ring);
 		mmdrop(ctx->mm);
 		kmem_cache_free(userfaultfd_ctx_cachep, ctx);
 	}
@@ -351,6 +360,45 @@ static inline long userfaultfd_get_blocking_state(unsigned int flags)
 	return TASK_UNINTERRUPTIBLE;
 }
 
+/*
+ * Publish a pagefault message in the fault ring, if there is one and it
+ * has room.  Returns true if the message was delivered, in which case
+ * the userfault counts as already read.  fault_pending_wqh.lock must be
+ * held by the caller, it serializes the producers.
+ */
+static bool userfaultfd_ring_push(struct userfaultfd_ctx *ctx,
+				  struct uffd_msg *msg)
+{
+	struct uffd_ring *ring = ctx->ring;
+	unsigned int tail = ctx->ring_tail;
+
+	lockdep_assert_held(&ctx->fault_pending_wqh.lock);
+
+	if (!ring)
+		return false;
+	/*
+	 * head is written by userland: a bogus value can only make the
+	 * ring look full, never make us write out of bounds.
+	 */
+	if (tail - READ_ONCE(ring->head) >= ctx->ring_entries) {
+		ring->overflow++;
+		return false;
+	}
+	ring->msgs[tail & (ctx->ring_entries - 1)] = *msg;
+	ctx->ring_tail = tail + 1;
+	/* pairs with the acquire load of tail in userland */
+	smp_store_release(&ring->tail, ctx->ring_tail);
+	return true;
+}
+
+static bool userfaultfd_ring_pending(struct userfaultfd_ctx *ctx)
+{
+	/* pairs with the release store in userfaultfd_ring() */
+	struct uffd_ring *ring = smp_load_acquire(&ctx->ring);
+
+	return ring && READ_ONCE(ring->head) != READ_ONCE(ctx->ring_tail);
+}
+
 /*
  * The locking rules involved in returning VM_FAULT_RETRY depending on
  * FAULT_FLAG_ALLOW_RETRY, FAULT_FLAG_RETRY_NOWAIT and
@@ -482,11 +530,22 @@ vm_fault_t handle_userfault(struct vm_fault *vmf, unsigned long reason)
 	blocking_state = userfaultfd_get_blocking_state(vmf->flags);
 
 	spin_lock_irq(&ctx->fault_pending_wqh.lock);
-	/*
-	 * After the __add_wait_queue the uwq is visible to userland
-	 * through poll/read().
-	 */
-	__add_wait_queue(&ctx->fault_pending_wqh, &uwq.wq);
+	if (userfaultfd_ring_push(ctx, &uwq.msg)) {
+		/*
+		 * Userland already has the message, so skip the
+		 * pending state and queue directly where read()
+		 * would have refiled it.
+		 */
+		spin_lock(&ctx->fault_wqh.lock);
+		__add_wait_queue(&ctx->fault_wqh, &uwq.wq);
+		spin_unlock(&ctx->fault_wqh.lock);
+	} else {
+		/*
+		 * After the __add_wait_queue the uwq is visible to
+		 * userland through poll/read().
+		 */
+		__add_wait_queue(&ctx->fault_pending_wqh, &uwq.wq);
+	}
 	/*
 	 * The smp_mb() after __set_current_state prevents the reads
 	 * following the spin_unlock to happen before the list_add in
@@ -663,6 +722,11 @@ int dup_userfaultfd(struct vm_area_struct *vma, struct list_head *fcs)
 		ctx->features = octx->features;
 		ctx->released = false;
 		ctx->mmap_changing = false;
+		/* the child sets up its own fault ring, if any */
+		ctx->ring = NULL;
+		ctx->ring_tail = 0;
+		ctx->ring_entries = 0;
+		ctx->ring_size = 0;
 		ctx->mm = vma->vm_mm;
 		mmgrab(ctx->mm);
 
@@ -961,6 +1025,8 @@ static __poll_t userfaultfd_poll(struct file *file, poll_table *wait)
 		ret = EPOLLIN;
 	else if (waitqueue_active(&ctx->event_wqh))
 		ret = EPOLLIN;
+	else if (userfaultfd_ring_pending(ctx))
+		ret = EPOLLIN;
 
 	return ret;
 }
@@ -1222,6 +1288,72 @@ static __always_inline void wake_userfault(struct userfaultfd_ctx *ctx,
 		__wake_userfault(ctx, range);
 }
 
+static int wake_range_cmp(const void *a, const void *b)
+{
+	const struct userfaultfd_wake_range *ra = a, *rb = b;
+
+	if (ra->start < rb->start)
+		return -1;
+	return ra->start > rb->start;
+}
+
+/*
+ * Wake the userfaults of many ranges taking the waitqueue locks only
+ * once.  The ranges are sorted and adjacent or overlapping ones merged
+ * first, so each waitqueue walk covers as much as possible.
+ */
+static void wake_userfault_batch(struct userfaultfd_ctx *ctx,
+				 struct userfaultfd_wake_range *ranges,
+				 unsigned long nr)
+{
+	unsigned long i, merged = 0;
+	unsigned seq;
+	bool need_wakeup;
+
+	if (!nr)
+		return;
+
+	sort(ranges, nr, sizeof(*ranges), wake_range_cmp, NULL);
+	for (i = 1; i < nr; i++) {
+		struct userfaultfd_wake_range *last = &ranges[merged];
+
+		if (ranges[i].start <= last->start + last->len) {
+			last->len = max(last->start + last->len,
+					ranges[i].start + ranges[i].len) -
+				    last->start;
+			continue;
+		}
+		ranges[++merged] = ranges[i];
+	}
+	merged++;
+
+	/* see wake_userfault() */
+	smp_mb();
+	do {
+		seq = read_seqcount_begin(&ctx->refile_seq);
+		need_wakeup = waitqueue_active(&ctx->fault_pending_wqh) ||
+			waitqueue_active(&ctx->fault_wqh);
+		cond_resched();
+	} while (read_seqcount_retry(&ctx->refile_seq, seq));
+	if (!need_wakeup)
+		return;
+
+	spin_lock_irq(&ctx->fault_pending_wqh.lock);
+	spin_lock(&ctx->fault_wqh.lock);
+	for (i = 0; i < merged; i++) {
+		/* len == 0 would wake all */
+		VM_BUG_ON(!ranges[i].len);
+		if (waitqueue_active(&ctx->fault_pending_wqh))
+			__wake_up_locked_key(&ctx->fault_pending_wqh,
+					     TASK_NORMAL, &ranges[i]);
+		if (waitqueue_active(&ctx->fault_wqh))
+			__wake_up_locked_key(&ctx->fault_wqh, TASK_NORMAL,
+					     &ranges[i]);
+	}
+	spin_unlock(&ctx->fault_wqh.lock);
+	spin_unlock_irq(&ctx->fault_pending_wqh.lock);
+}
+
 static __always_inline int validate_range(struct mm_struct *mm,
 					  __u64 start, __u64 len)
 {
@@ -1761,6 +1893,194 @@ static int userfaultfd_zeropage(struct userfaultfd_ctx *ctx,
 	return ret;
 }
 
+/*
+ * Resolve a single entry of an UFFDIO_COPY_VEC or UFFDIO_ZEROPAGE_VEC
+ * without waking anybody.  Returns the number of bytes resolved, or a
+ * negative error.  The result is also written to the entry like the
+ * single range ioctls do.
+ */
+static __s64 userfaultfd_vec_one(struct userfaultfd_ctx *ctx, bool zeropage,
+				 void __user *entry,
+				 struct userfaultfd_wake_range *range)
+{
+	__s64 ret;
+
+	if (READ_ONCE(ctx->mmap_changing))
+		return -EAGAIN;
+
+	if (zeropage) {
+		struct uffdio_zeropage uz;
+		struct uffdio_zeropage __user *user_uz = entry;
+
+		if (copy_from_user(&uz, user_uz, sizeof(uz) - sizeof(__s64)))
+			return -EFAULT;
+		ret = validate_range(ctx->mm, uz.range.start, uz.range.len);
+		if (ret)
+			return ret;
+		if (uz.mode & ~UFFDIO_ZEROPAGE_MODE_DONTWAKE)
+			return -EINVAL;
+		ret = mfill_zeropage(ctx->mm, uz.range.start, uz.range.len,
+				     &ctx->mmap_changing);
+		if (unlikely(put_user(ret, &user_uz->zeropage)))
+			return -EFAULT;
+		range->start = uz.range.start;
+		if (ret > 0 && ret != uz.range.len) {
+			range->len = ret;
+			return -EAGAIN;
+		}
+	} else {
+		struct uffdio_copy uc;
+		struct uffdio_copy __user *user_uc = entry;
+
+		if (copy_from_user(&uc, user_uc, sizeof(uc) - sizeof(__s64)))
+			return -EFAULT;
+		ret = validate_range(ctx->mm, uc.dst, uc.len);
+		if (ret)
+			return ret;
+		if (uc.src + uc.len <= uc.src)
+			return -EINVAL;
+		if (uc.mode & ~(UFFDIO_COPY_MODE_DONTWAKE|UFFDIO_COPY_MODE_WP))
+			return -EINVAL;
+		ret = mcopy_atomic(ctx->mm, uc.dst, uc.src, uc.len,
+				   &ctx->mmap_changing, uc.mode);
+		if (unlikely(put_user(ret, &user_uc->copy)))
+			return -EFAULT;
+		range->start = uc.dst;
+		if (ret > 0 && ret != uc.len) {
+			range->len = ret;
+			return -EAGAIN;
+		}
+	}
+	if (ret > 0)
+		range->len = ret;
+	return ret;
+}
+
+static int userfaultfd_vec(struct userfaultfd_ctx *ctx, unsigned long arg,
+			   bool zeropage)
+{
+	struct uffdio_vec uffdio_vec;
+	struct uffdio_vec __user *user_uffdio_vec;
+	struct userfaultfd_wake_range *ranges;
+	size_t entry_size = zeropage ? sizeof(struct uffdio_zeropage) :
+				       sizeof(struct uffdio_copy);
+	unsigned long i, nr_ranges = 0;
+	__s64 ret = 0;
+
+	user_uffdio_vec = (struct uffdio_vec __user *) arg;
+
+	if (copy_from_user(&uffdio_vec, user_uffdio_vec,
+			   /* don't copy "done" last field */
+			   sizeof(uffdio_vec)-sizeof(__s64)))
+		return -EFAULT;
+	if (!uffdio_vec.nr || uffdio_vec.nr > UFFDIO_VEC_MAX)
+		return -EINVAL;
+	if (uffdio_vec.mode & ~UFFDIO_VEC_MODE_DONTWAKE)
+		return -EINVAL;
+
+	ranges = kvmalloc_array(uffdio_vec.nr, sizeof(*ranges), GFP_KERNEL);
+	if (!ranges)
+		return -ENOMEM;
+
+	if (!mmget_not_zero(ctx->mm)) {
+		kvfree(ranges);
+		return -ESRCH;
+	}
+	for (i = 0; i < uffdio_vec.nr; i++) {
+		void __user *entry = u64_to_user_ptr(uffdio_vec.vec) +
+				     i * entry_size;
+
+		ranges[nr_ranges].len = 0;
+		ret = userfaultfd_vec_one(ctx, zeropage, entry,
+					  &ranges[nr_ranges]);
+		/* partially resolved ranges still have waiters to wake */
+		if (ranges[nr_ranges].len)
+			nr_ranges++;
+		if (ret < 0)
+			break;
+		cond_resched();
+	}
+	mmput(ctx->mm);
+
+	if (!(uffdio_vec.mode & UFFDIO_VEC_MODE_DONTWAKE))
+		wake_userfault_batch(ctx, ranges, nr_ranges);
+	kvfree(ranges);
+
+	if (put_user(i ? (__s64)i : min_t(__s64, ret, 0),
+		     &user_uffdio_vec->done))
+		return -EFAULT;
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Set up the fault ring. It can only be done once per uffd, the ring
+ * then lives as long as the uffd context.
+ */
+static int userfaultfd_ring(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_ring uffdio_ring;
+	struct uffdio_ring __user *user_uffdio_ring;
+	struct uffd_ring *ring;
+	size_t size;
+	int ret;
+
+	user_uffdio_ring = (struct uffdio_ring __user *) arg;
+
+	if (!(ctx->features & UFFD_FEATURE_FAULT_RING))
+		return -EINVAL;
+	if (copy_from_user(&uffdio_ring, user_uffdio_ring,
+			   /* don't copy "mmap_size" last field */
+			   sizeof(uffdio_ring)-sizeof(__u64)))
+		return -EFAULT;
+	if (uffdio_ring.flags || !is_power_of_2(uffdio_ring.nr_entries) ||
+	    uffdio_ring.nr_entries > UFFD_RING_MAX_ENTRIES)
+		return -EINVAL;
+
+	size = PAGE_ALIGN(struct_size(ring, msgs, uffdio_ring.nr_entries));
+	ring = vmalloc_user(size);
+	if (!ring)
+		return -ENOMEM;
+	ring->nr_entries = uffdio_ring.nr_entries;
+
+	ret = -EBUSY;
+	spin_lock_irq(&ctx->fault_pending_wqh.lock);
+	if (!ctx->ring) {
+		ctx->ring_tail = 0;
+		ctx->ring_entries = uffdio_ring.nr_entries;
+		ctx->ring_size = size;
+		/*
+		 * Lockless readers (mmap, poll) use ring_size and the ring
+		 * header once they see the pointer.
+		 */
+		smp_store_release(&ctx->ring, ring);
+		ring = NULL;
+		ret = 0;
+	}
+	spin_unlock_irq(&ctx->fault_pending_wqh.lock);
+	vfree(ring);
+	if (ret)
+		return ret;
+
+	if (put_user((__u64)size, &user_uffdio_ring->mmap_size))
+		return -EFAULT;
+	return 0;
+}
+
+static int userfaultfd_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	/* pairs with the release store in userfaultfd_ring() */
+	struct uffd_ring *ring = smp_load_acquire(&ctx->ring);
+
+	if (!ring || vma->vm_pgoff)
+		return -EINVAL;
+	if (vma->vm_end - vma->vm_start > ctx->ring_size)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	return remap_vmalloc_range(vma, ring, 0);
+}
+
 static int userfaultfd_writeprotect(struct userfaultfd_ctx *ctx,
 				    unsigned long arg)
 {
@@ -1901,6 +2221,15 @@ static long userfaultfd_ioctl(struct file *file, unsigned cmd,
 	case UFFDIO_WRITEPROTECT:
 		ret = userfaultfd_writeprotect(ctx, arg);
 		break;
+	case UFFDIO_COPY_VEC:
+		ret = userfaultfd_vec(ctx, arg, false);
+		break;
+	case UFFDIO_ZEROPAGE_VEC:
+		ret = userfaultfd_vec(ctx, arg, true);
+		break;
+	case UFFDIO_RING:
+		ret = userfaultfd_ring(ctx, arg);
+		break;
 	}
 	return ret;
 }
@@ -1911,6 +2240,8 @@ static void userfaultfd_show_fdinfo(struct seq_file *m, struct file *f)
 	struct userfaultfd_ctx *ctx = f->private_data;
 	wait_queue_entry_t *wq;
 	unsigned long pending = 0, total = 0;
+	unsigned int ring_entries = 0, ring_used = 0;
+	unsigned long long ring_overflow = 0;
 
 	spin_lock_irq(&ctx->fault_pending_wqh.lock);
 	list_for_each_entry(wq, &ctx->fault_pending_wqh.head, entry) {
@@ -1920,6 +2251,11 @@ static void userfaultfd_show_fdinfo(struct seq_file *m, struct file *f)
 	list_for_each_entry(wq, &ctx->fault_wqh.head, entry) {
 		total++;
 	}
+	if (ctx->ring) {
+		ring_entries = ctx->ring_entries;
+		ring_used = ctx->ring_tail - READ_ONCE(ctx->ring->head);
+		ring_overflow = ctx->ring->overflow;
+	}
 	spin_unlock_irq(&ctx->fault_pending_wqh.lock);
 
 	/*
@@ -1930,6 +2266,9 @@ static void userfaultfd_show_fdinfo(struct seq_file *m, struct file *f)
 	seq_printf(m, "pending:\t%lu\ntotal:\t%lu\nAPI:\t%Lx:%x:%Lx\n",
 		   pending, total, UFFD_API, ctx->features,
 		   UFFD_API_IOCTLS|UFFD_API_RANGE_IOCTLS);
+	if (ring_entries)
+		seq_printf(m, "ring:\t%u %u %llu\n", ring_entries, ring_used,
+			   ring_overflow);
 }
 #endif
 
@@ -1940,6 +2279,7 @@ static const struct file_operations userfaultfd_fops = {
 	.release	= userfaultfd_release,
 	.poll		= userfaultfd_poll,
 	.read		= userfaultfd_read,
+	.mmap		= userfaultfd_mmap,
 	.unlocked_ioctl = userfaultfd_ioctl,
 	.compat_ioctl	= compat_ptr_ioctl,
 	.llseek		= noop_llseek,
@@ -1982,6 +2322,10 @@ SYSCALL_DEFINE1(userfaultfd, int, flags)
 	ctx->features = 0;
 	ctx->released = false;
 	ctx->mmap_changing = false;
+	ctx->ring = NULL;
+	ctx->ring_tail = 0;
+	ctx->ring_entries = 0;
+	ctx->ring_size = 0;
 	ctx->mm = current->mm;
 	/* prevent the mm struct to be freed */
 	mmgrab(ctx->mm);
@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Common values for the POLYVAL hash function
+ */
+
+#ifndef __CRYPTO_POLYVAL_H__
+#define __CRYPTO_POLYVAL_H__
+
+#define POLYVAL_BLOCK_SIZE	16
+#define POLYVAL_DIGEST_SIZE	16
+
+#endif
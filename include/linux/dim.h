@@ -34,7 +34,7 @@
  * struct dim_cq_moder - Structure for CQ moderation values.
  * Used for communications between DIM and its consumer.
  *
- * @usec: CQ timer suggestion (by DIM)
+ * @usec: CQ timer suggestion (by DIM), unused by block DIM
  * @pkts: CQ packet counter suggestion (by DIM)
  * @comps: Completion counter
  * @cq_period_mode: CQ period count mode (from CQE/EQE)
@@ -55,6 +55,7 @@ struct dim_cq_moder {
  * @byte_ctr: Number of bytes
  * @event_ctr: Number of events
  * @comp_ctr: Current completion counter
+ * @lat_ctr: Accumulated completion latency, in usec
  */
 struct dim_sample {
 	ktime_t time;
@@ -62,6 +63,7 @@ struct dim_sample {
 	u32 byte_ctr;
 	u16 event_ctr;
 	u32 comp_ctr;
+	u32 lat_ctr;
 };
 
 /**
@@ -73,6 +75,7 @@ struct dim_sample {
  * @epms: Events per msec
  * @cpms: Completions per msec
  * @cpe_ratio: Ratio of completions to events
+ * @lat_avg: Average completion latency, in usec
  */
 struct dim_stats {
 	int ppms; /* packets per msec */
@@ -80,6 +83,7 @@ struct dim_stats {
 	int epms; /* events per msec */
 	int cpms; /* completions per msec */
 	int cpe_ratio; /* ratio of completions to events */
+	int lat_avg; /* average completion latency in usec */
 };
 
 /**
@@ -333,4 +337,51 @@ void net_dim(struct dim *dim, struct dim_sample end_sample);
  */
 void rdma_dim(struct dim *dim, u64 completions);
 
+/* Block DIM */
+
+/*
+ * Block DIM profile:
+ * profile size must be of BLK_DIM_PARAMS_NUM_PROFILES.
+ * Profile 0 is no moderation: one interrupt per completion.
+ */
+#define BLK_DIM_PARAMS_NUM_PROFILES 6
+#define BLK_DIM_START_PROFILE 0
+
+/**
+ *	blk_dim_update_sample - set a block DIM sample's fields
+ *	@event_ctr: number of interrupts to set
+ *	@comps: number of completed requests to set
+ *	@lat_us: accumulated latency of the completed requests to set, in usec
+ *	@s: DIM sample
+ */
+static inline void
+blk_dim_update_sample(u16 event_ctr, u64 comps, u64 lat_us,
+		      struct dim_sample *s)
+{
+	dim_update_sample_with_comps(event_ctr, 0, 0, comps, s);
+	s->lat_ctr = lat_us;
+}
+
+/**
+ *	blk_dim_get_moderation - provide the moderation for the given profile
+ *	@ix: Profile index
+ *
+ * @comps is the number of completions that raise the interrupt. Block
+ * profiles have no timer, @usec is always zero.
+ */
+struct dim_cq_moder blk_dim_get_moderation(int ix);
+
+/**
+ *	blk_dim - main block DIM algorithm entry point
+ *	@dim: DIM instance information
+ *	@end_sample: Current data measurement, see blk_dim_update_sample()
+ *
+ * Called by the consumer from its completion interrupt, with running
+ * counters of interrupts, completed requests and their latency. The
+ * completion rate is the main criterion; at the same rate, lower latency
+ * and then fewer interrupts per completion are better. Latency may be
+ * left at zero if the consumer does not track it.
+ */
+void blk_dim(struct dim *dim, struct dim_sample end_sample);
+
 #endif /* DIM_H */
@@ -271,6 +271,90 @@ dma_resv_get_excl_rcu(struct dma_resv *obj)
 	return fence;
 }
 
+/**
+ * struct dma_resv_iter - current position into the dma_resv fences
+ * @obj: the dma_resv object we iterate over
+ * @all_fences: also return the shared fences, not just the exclusive one
+ * @fence: the currently handled fence, with a reference held
+ * @seq: sequence number to check for modifications
+ * @index: index into the shared fences, -1 for the exclusive fence
+ * @fences: the shared fences
+ * @shared_count: number of shared fences
+ * @is_restarted: true if this is the first returned fence
+ *
+ * Don't touch this directly in the driver, use the accessor functions
+ * instead.
+ */
+struct dma_resv_iter {
+	struct dma_resv *obj;
+	bool all_fences;
+	struct dma_fence *fence;
+	unsigned int seq;
+	unsigned int index;
+	struct dma_resv_list *fences;
+	unsigned int shared_count;
+	bool is_restarted;
+};
+
+struct dma_fence *dma_resv_iter_first_unlocked(struct dma_resv_iter *cursor);
+struct dma_fence *dma_resv_iter_next_unlocked(struct dma_resv_iter *cursor);
+
+/**
+ * dma_resv_iter_begin - initialize a dma_resv_iter object
+ * @cursor: The dma_resv_iter object to initialize
+ * @obj: The dma_resv object which we want to iterate over
+ * @all_fences: If all fences should be returned or just the exclusive one
+ */
+static inline void dma_resv_iter_begin(struct dma_resv_iter *cursor,
+				       struct dma_resv *obj,
+				       bool all_fences)
+{
+	cursor->obj = obj;
+	cursor->all_fences = all_fences;
+	cursor->fence = NULL;
+}
+
+/**
+ * dma_resv_iter_end - cleanup a dma_resv_iter object
+ * @cursor: the dma_resv_iter object which should be cleaned up
+ *
+ * Make sure that the reference to the fence in the cursor is properly
+ * dropped.
+ */
+static inline void dma_resv_iter_end(struct dma_resv_iter *cursor)
+{
+	dma_fence_put(cursor->fence);
+}
+
+/**
+ * dma_resv_iter_is_restarted - test if this is the first fence after a restart
+ * @cursor: the cursor with the current position
+ *
+ * Return true if this is the first fence in an iteration after a restart.
+ * Callers collecting fences should throw away what they have so far.
+ */
+static inline bool dma_resv_iter_is_restarted(struct dma_resv_iter *cursor)
+{
+	return cursor->is_restarted;
+}
+
+/**
+ * dma_resv_for_each_fence_unlocked - unlocked unsignaled fence iterator
+ * @cursor: a struct dma_resv_iter pointer
+ * @fence: the current fence
+ *
+ * Iterate over the unsignaled fences of a struct dma_resv object without
+ * holding the &dma_resv.lock and using RCU instead. The cursor needs to be
+ * initialized with dma_resv_iter_begin() and cleaned up with
+ * dma_resv_iter_end(). Inside the iterator a reference to the fence is held
+ * and the RCU lock dropped, so it is fine to wait on the fence.
+ *
+ * When the dma_resv is modified the iteration starts over again.
+ */
+#define dma_resv_for_each_fence_unlocked(cursor, fence)			\
+	for (fence = dma_resv_iter_first_unlocked(cursor);		\
+	     fence; fence = dma_resv_iter_next_unlocked(cursor))
+
 void dma_resv_init(struct dma_resv *obj);
 void dma_resv_fini(struct dma_resv *obj);
 int dma_resv_reserve_shared(struct dma_resv *obj, unsigned int num_fences);
@@ -19,6 +19,7 @@
 #include <linux/atomic.h>
 #include <linux/user_namespace.h>
 #include <linux/refcount.h>
+#include <linux/workqueue.h>
 
 /*
  * IN_* from inotfy.h lines up EXACTLY with FS_*, this is so we can easily
@@ -241,6 +242,15 @@ struct fsnotify_group {
 			int f_flags; /* event_f_flags from fanotify_init() */
 			unsigned int max_marks;
 			struct user_struct *user;
+			/* queued events hashed by object for merging */
+			struct hlist_head *merge_hash;
+			/* optional event ring mmap()ed by the listener */
+			struct fanotify_ring *ring;
+			u32 ring_size;
+			u32 ring_tail;
+			struct work_struct ring_work;
+			/* pid namespace that ring events report pids in */
+			struct pid_namespace *ring_pid_ns;
 		} fanotify_data;
 #endif /* CONFIG_FANOTIFY */
 	};
@@ -486,12 +496,14 @@ extern void fsnotify_destroy_event(struct fsnotify_group *group,
 /* attach the event to the group notification queue */
 extern int fsnotify_add_event(struct fsnotify_group *group,
 			      struct fsnotify_event *event,
-			      int (*merge)(struct list_head *,
-					   struct fsnotify_event *));
+			      int (*merge)(struct fsnotify_group *,
+					   struct fsnotify_event *),
+			      void (*insert)(struct fsnotify_group *,
+					     struct fsnotify_event *));
 /* Queue overflow event to a notification group */
 static inline void fsnotify_queue_overflow(struct fsnotify_group *group)
 {
-	fsnotify_add_event(group, group->overflow_event, NULL);
+	fsnotify_add_event(group, group->overflow_event, NULL, NULL);
 }
 
 /* true if the group notification queue is empty */
@@ -320,6 +320,22 @@ int LZ4_decompress_safe(const char *source, char *dest, int compressedSize,
 int LZ4_decompress_safe_partial(const char *source, char *dest,
 	int compressedSize, int targetOutputSize, int maxDecompressedSize);
 
+/**
+ * LZ4_decompress_safe_page() - Decompress a block holding exactly one page
+ * @source: source address of the compressed data
+ * @dest: output buffer of PAGE_SIZE bytes
+ * @compressedSize: is the precise full size of the compressed block
+ *
+ * Same as LZ4_decompress_safe() with a maxDecompressedSize of PAGE_SIZE,
+ * for swap and block device users that store one page per compressed
+ * block. It is specialized for the fixed output size and treats a block
+ * that decodes to less than a full page as malformed.
+ *
+ * Return: PAGE_SIZE on success or a negative result in case of error
+ */
+int LZ4_decompress_safe_page(const char *source, char *dest,
+	int compressedSize);
+
 /*-************************************************************************
  *	LZ4 HC Compression
  **************************************************************************/
@@ -21,6 +21,8 @@ struct seq_file {
 	size_t pad_until;
 	loff_t index;
 	loff_t read_pos;
+	loff_t cursor_index;
+	u64 cursor;
 	struct mutex lock;
 	const struct seq_operations *op;
 	int poll_event;
@@ -52,6 +54,47 @@ static inline bool seq_has_overflowed(struct seq_file *m)
 	return m->count == m->size;
 }
 
+/**
+ * seq_cursor_set - remember where the record at @index can be found
+ * @m: the seq_file handle
+ * @index: the iterator position the cursor describes
+ * @cursor: iterator specific value locating the record, e.g. an object id
+ *
+ * Iterators whose ->start() would otherwise have to walk @index records to
+ * find where to resume can record an opaque cursor from ->next() and pick
+ * it up again with seq_cursor_get().  That keeps every read() O(1) in the
+ * size of the file instead of making a full read quadratic.  The cursor
+ * must stay meaningful if the object it was taken from goes away, so it
+ * should be a key to search from rather than a pointer.
+ */
+static inline void seq_cursor_set(struct seq_file *m, loff_t index, u64 cursor)
+{
+	m->cursor_index = index;
+	m->cursor = cursor;
+}
+
+/**
+ * seq_cursor_get - look up the cursor recorded for @index
+ * @m: the seq_file handle
+ * @index: the position ->start() was asked for
+ * @cursor: where the cursor is stored
+ *
+ * Returns true if seq_cursor_set() was called for @index since the file was
+ * last rewound.  Position 0 never has a cursor.
+ */
+static inline bool seq_cursor_get(struct seq_file *m, loff_t index, u64 *cursor)
+{
+	if (!index || index != m->cursor_index)
+		return false;
+	*cursor = m->cursor;
+	return true;
+}
+
+static inline void seq_cursor_reset(struct seq_file *m)
+{
+	m->cursor_index = 0;
+}
+
 /**
  * seq_get_buf - get buffer to write arbitrary data to
  * @m: the seq_file handle
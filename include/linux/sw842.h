@@ -2,7 +2,7 @@
 #ifndef __SW842_H__
 #define __SW842_H__
 
-#define SW842_MEM_COMPRESS	(0xf000)
+#define SW842_MEM_COMPRESS	(0x3400)
 
 int sw842_compress(const u8 *src, unsigned int srclen,
 		   u8 *dst, unsigned int *destlen, void *wmem);
@@ -359,6 +359,7 @@ extern unsigned long vm_dirty_bytes;
 extern unsigned int dirty_writeback_interval;
 extern unsigned int dirty_expire_interval;
 extern unsigned int dirtytime_expire_interval;
+extern unsigned int dirty_writeback_workers;
 extern int vm_highmem_is_dirtyable;
 extern int block_dump;
 extern int laptop_mode;
@@ -233,6 +233,33 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s);
  */
 XZ_EXTERN void xz_dec_end(struct xz_dec *s);
 
+#if defined(CONFIG_XZ_DEC_MT) && !defined(XZ_PREBOOT)
+/**
+ * xz_dec_mt_run() - Decode the Blocks of a .xz Stream in parallel
+ * @in:         Beginning of the Stream
+ * @in_size:    Size of the input buffer; it may extend past the Stream
+ * @in_used:    Set to the size of the Stream on success
+ * @flush:      Called with the uncompressed data of each Block, in order.
+ *              It must return the size it was given.
+ *
+ * The Blocks are located from the Compressed Size stored in their Block
+ * Headers, which xz writes when it compresses with --threads or
+ * --block-size, and validated against the Index. They are then decoded
+ * on an unbound workqueue, a few at a time.
+ *
+ * XZ_OPTIONS_ERROR is returned, before @flush has been called, if the
+ * Stream cannot be decoded this way: it has a single Block, a Block
+ * Header lacks Compressed Size, the Check is neither none nor CRC32, or
+ * the Blocks would need too much memory. The caller should then decode
+ * it with xz_dec_run(). Otherwise XZ_STREAM_END is returned on success;
+ * a failure after the first call to @flush is returned as XZ_DATA_ERROR,
+ * XZ_MEM_ERROR or XZ_BUF_ERROR (if @flush fails).
+ */
+XZ_EXTERN enum xz_ret xz_dec_mt_run(const uint8_t *in, size_t in_size,
+				    size_t *in_used,
+				    long (*flush)(void *, unsigned long));
+#endif
+
 /*
  * Standalone build (userspace build or in-kernel build for boot time use)
  * needs a CRC32 implementation. For normal in-kernel use, kernel's own
@@ -398,7 +398,9 @@ ZSTD_CDict *ZSTD_initCDict(const void *dictBuffer, size_t dictSize,
  * @params:      The parameters to use for compression. See ZSTD_getParams().
  *
  * Compression using a digested dictionary. The same dictionary must be used
- * during decompression.
+ * during decompression. For small inputs compressed at the fastest levels the
+ * dictionary's tables are searched in place rather than copied into @cctx, so
+ * the CDict must not be freed while a frame started from it is in progress.
  *
  * Return:       The compressed size or an error, which can be checked using
  *               ZSTD_isError().
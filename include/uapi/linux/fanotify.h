@@ -3,6 +3,7 @@
 #define _UAPI_LINUX_FANOTIFY_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* the following events that user-space can register for */
 #define FAN_ACCESS		0x00000001	/* File was accessed */
@@ -172,4 +173,46 @@ struct fanotify_response {
 				(long)(meta)->event_len >= (long)FAN_EVENT_METADATA_LEN && \
 				(long)(meta)->event_len <= (long)(len))
 
+/*
+ * Event ring mmap()ed from a fanotify fd, set up with FAN_IOC_SETUP_RING.
+ * Only groups that report fids (FAN_REPORT_FID / FAN_REPORT_DIR_FID) can
+ * use a ring, since no event fd has to be created for the reader.
+ *
+ * The records in data[] have the same format as the ones returned by
+ * read().  "head" and "tail" are free running byte offsets that must be
+ * masked with (size - 1).  The kernel advances "tail" with release
+ * semantics, the listener advances "head" with release semantics once it
+ * is done with a record.  A record never wraps: when fewer than
+ * FAN_EVENT_METADATA_LEN bytes are left before the end of data[], the
+ * next record starts at offset 0; otherwise a record with a zero mask is
+ * written to pad up to the end and must be skipped.
+ *
+ * Events that do not fit in the ring stay queued and keep being reported
+ * by poll() and read(), and they are always newer than the events in the
+ * ring.  "full" counts how often the kernel found the ring full.
+ */
+struct fanotify_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 flags;
+	__u64 full;
+	__u64 reserved[5];
+	__u8 data[];
+};
+
+struct fanotify_ring_setup {
+	/* size of data[], power of two between 4KiB and 16MiB */
+	__u32 size;
+	__u32 flags;
+	/* out: length to mmap() at offset 0 of the fanotify fd */
+	__u64 mmap_size;
+};
+
+#define FAN_RING_MIN_SIZE	(1U << 12)
+#define FAN_RING_MAX_SIZE	(1U << 24)
+
+#define FAN_IOC_MAGIC		0xFA
+#define FAN_IOC_SETUP_RING	_IOWR(FAN_IOC_MAGIC, 1, struct fanotify_ring_setup)
+
 #endif /* _UAPI_LINUX_FANOTIFY_H */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_PROC_PIDMEM_H
+#define _UAPI_LINUX_PROC_PIDMEM_H
+
+#include <linux/types.h>
+
+/*
+ * /proc/pidmem reports memory and cpu usage of many processes at once,
+ * in binary form, without walking any page table or taking mmap_lock.
+ *
+ * write() an array of pids (__s32, in the pid namespace of the proc
+ * mount) to select the processes, then read() or pread() at offset 0
+ * returns one struct proc_pidmem per pid, in the same order.  The pid
+ * list stays in place until the next write(), so a monitoring agent can
+ * keep the file open and sample with a single pread() per interval.
+ */
+#define PROC_PIDMEM_MAX_PIDS	8192
+
+struct proc_pidmem {
+	__s32 pid;
+	/* 0, or -ESRCH / -ENOENT if the pid is gone or not visible */
+	__s32 error;
+	/* All sizes are in bytes, the counters are updated incrementally */
+	__u64 vm_size;
+	__u64 vm_hwm;
+	__u64 rss_anon;
+	__u64 rss_file;
+	__u64 rss_shmem;
+	__u64 swap;
+	__u64 pgtables;
+	/* Thread group cpu time, in nanoseconds */
+	__u64 utime;
+	__u64 stime;
+	__u32 nr_threads;
+	__u32 flags;
+	__u64 reserved[4];
+};
+
+/* proc_pidmem.flags */
+#define PROC_PIDMEM_KTHREAD	(1U << 0)	/* kernel thread, only cpu times */
+
+#endif /* _UAPI_LINUX_PROC_PIDMEM_H */
@@ -27,19 +27,24 @@
 			   UFFD_FEATURE_MISSING_HUGETLBFS |	\
 			   UFFD_FEATURE_MISSING_SHMEM |		\
 			   UFFD_FEATURE_SIGBUS |		\
-			   UFFD_FEATURE_THREAD_ID)
+			   UFFD_FEATURE_THREAD_ID |		\
+			   UFFD_FEATURE_FAULT_RING)
 #define UFFD_API_IOCTLS				\
 	((__u64)1 << _UFFDIO_REGISTER |		\
 	 (__u64)1 << _UFFDIO_UNREGISTER |	\
+	 (__u64)1 << _UFFDIO_RING |		\
 	 (__u64)1 << _UFFDIO_API)
 #define UFFD_API_RANGE_IOCTLS			\
 	((__u64)1 << _UFFDIO_WAKE |		\
 	 (__u64)1 << _UFFDIO_COPY |		\
 	 (__u64)1 << _UFFDIO_ZEROPAGE |		\
-	 (__u64)1 << _UFFDIO_WRITEPROTECT)
+	 (__u64)1 << _UFFDIO_WRITEPROTECT |	\
+	 (__u64)1 << _UFFDIO_COPY_VEC |		\
+	 (__u64)1 << _UFFDIO_ZEROPAGE_VEC)
 #define UFFD_API_RANGE_IOCTLS_BASIC		\
 	((__u64)1 << _UFFDIO_WAKE |		\
-	 (__u64)1 << _UFFDIO_COPY)
+	 (__u64)1 << _UFFDIO_COPY |		\
+	 (__u64)1 << _UFFDIO_COPY_VEC)
 
 /*
  * Valid ioctl command number range with this API is from 0x00 to
@@ -55,6 +60,9 @@
 #define _UFFDIO_COPY			(0x03)
 #define _UFFDIO_ZEROPAGE		(0x04)
 #define _UFFDIO_WRITEPROTECT		(0x06)
+#define _UFFDIO_COPY_VEC		(0x10)
+#define _UFFDIO_ZEROPAGE_VEC		(0x11)
+#define _UFFDIO_RING			(0x12)
 #define _UFFDIO_API			(0x3F)
 
 /* userfaultfd ioctl ids */
@@ -73,6 +81,12 @@
 				      struct uffdio_zeropage)
 #define UFFDIO_WRITEPROTECT	_IOWR(UFFDIO, _UFFDIO_WRITEPROTECT, \
 				      struct uffdio_writeprotect)
+#define UFFDIO_COPY_VEC		_IOWR(UFFDIO, _UFFDIO_COPY_VEC,	\
+				      struct uffdio_vec)
+#define UFFDIO_ZEROPAGE_VEC	_IOWR(UFFDIO, _UFFDIO_ZEROPAGE_VEC, \
+				      struct uffdio_vec)
+#define UFFDIO_RING		_IOWR(UFFDIO, _UFFDIO_RING,	\
+				      struct uffdio_ring)
 
 /* read() structure */
 struct uffd_msg {
@@ -171,6 +185,10 @@ struct uffdio_api {
 	 *
 	 * UFFD_FEATURE_THREAD_ID pid of the page faulted task_struct will
 	 * be returned, if feature is not requested 0 will be returned.
+	 *
+	 * UFFD_FEATURE_FAULT_RING means the UFFDIO_RING ioctl can be used
+	 * to have UFFD_EVENT_PAGEFAULT messages delivered through a ring
+	 * mmap()ed from the uffd instead of through read().
 	 */
 #define UFFD_FEATURE_PAGEFAULT_FLAG_WP		(1<<0)
 #define UFFD_FEATURE_EVENT_FORK			(1<<1)
@@ -181,6 +199,7 @@ struct uffdio_api {
 #define UFFD_FEATURE_EVENT_UNMAP		(1<<6)
 #define UFFD_FEATURE_SIGBUS			(1<<7)
 #define UFFD_FEATURE_THREAD_ID			(1<<8)
+#define UFFD_FEATURE_FAULT_RING			(1<<9)
 	__u64 features;
 
 	__u64 ioctls;
@@ -257,4 +276,64 @@ struct uffdio_writeprotect {
 	__u64 mode;
 };
 
+/*
+ * Resolve many ranges with a single ioctl. "vec" points to an array of
+ * "nr" struct uffdio_copy (UFFDIO_COPY_VEC) or struct uffdio_zeropage
+ * (UFFDIO_ZEROPAGE_VEC).  The per-entry DONTWAKE flags are ignored:
+ * all the waiters of all the resolved ranges are woken at once at the
+ * end, unless UFFDIO_VEC_MODE_DONTWAKE is set.  Each entry gets its
+ * "copy" or "zeropage" field written as with the single range ioctls.
+ */
+struct uffdio_vec {
+	__u64 vec;
+	__u64 nr;
+#define UFFDIO_VEC_MODE_DONTWAKE		((__u64)1<<0)
+	__u64 mode;
+
+	/*
+	 * "done" is written by the ioctl and must be at the end: the
+	 * copy_from_user will not read the last 8 bytes.  It is the
+	 * number of entries fully resolved, or a negative error if the
+	 * very first entry failed.
+	 */
+	__s64 done;
+};
+
+#define UFFDIO_VEC_MAX				1024
+
+/*
+ * Layout of the fault ring mmap()ed from the uffd after UFFDIO_RING.
+ * The kernel produces messages at "tail", userland consumes them by
+ * advancing "head".  Both indexes are free running and must be masked
+ * with (nr_entries - 1).  Userland must read "tail" with acquire
+ * semantics and update "head" with release semantics.
+ *
+ * Only UFFD_EVENT_PAGEFAULT messages go through the ring; faults that
+ * find the ring full and all the other events are still returned by
+ * read(), so poll() and read() must still be serviced.
+ */
+struct uffd_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 nr_entries;
+	__u32 flags;
+	/* pagefaults that found the ring full and fell back to read() */
+	__u64 overflow;
+	__u64 reserved[5];
+	struct uffd_msg msgs[];
+};
+
+struct uffdio_ring {
+	/* power of two, at most UFFD_RING_MAX_ENTRIES */
+	__u32 nr_entries;
+	__u32 flags;
+	/*
+	 * "mmap_size" is written by the ioctl: the length to pass to
+	 * mmap() at offset 0 of the uffd to map the ring.
+	 */
+	__u64 mmap_size;
+};
+
+#define UFFD_RING_MAX_ENTRIES			(1U << 16)
+
 #endif /* _LINUX_USERFAULTFD_H */
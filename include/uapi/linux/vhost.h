@@ -45,6 +45,15 @@
 #define VHOST_SET_LOG_BASE _IOW(VHOST_VIRTIO, 0x04, __u64)
 /* Specify an eventfd file descriptor to signal on log write. */
 #define VHOST_SET_LOG_FD _IOW(VHOST_VIRTIO, 0x07, int)
+/* By default the virtqueues of a device share a single worker thread. Create
+ * another worker for the device, to be attached to some of its virtqueues
+ * with VHOST_ATTACH_VRING_WORKER. Must be called by the owner, after
+ * VHOST_SET_OWNER. The worker joins the owner's cgroups and uses its address
+ * space. Its id is returned in worker_id. */
+#define VHOST_NEW_WORKER _IOR(VHOST_VIRTIO, 0x8, struct vhost_worker_state)
+/* Free a worker created with VHOST_NEW_WORKER. It must not be attached to any
+ * virtqueue. Workers still around are freed when the device is released. */
+#define VHOST_FREE_WORKER _IOW(VHOST_VIRTIO, 0x9, struct vhost_worker_state)
 
 /* Ring setup. */
 /* Set number of descriptors in ring. This parameter can not
@@ -56,6 +65,11 @@
 #define VHOST_SET_VRING_BASE _IOW(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
 /* Get accessor: reads index, writes value in num */
 #define VHOST_GET_VRING_BASE _IOWR(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
+/* Run the virtqueue's work on a worker created with VHOST_NEW_WORKER, in
+ * place of its current worker. */
+#define VHOST_ATTACH_VRING_WORKER _IOW(VHOST_VIRTIO, 0x15, struct vhost_vring_worker)
+/* Get accessor: reads index, writes the id of the virtqueue's worker */
+#define VHOST_GET_VRING_WORKER _IOWR(VHOST_VIRTIO, 0x16, struct vhost_vring_worker)
 
 /* Set the vring byte order in num. Valid values are VHOST_VRING_LITTLE_ENDIAN
  * or VHOST_VRING_BIG_ENDIAN (other values return -EINVAL).
@@ -448,6 +448,37 @@ static unsigned long my_inptr; /* index of next byte to be processed in inbuf */
 
 #include <linux/decompress/generic.h>
 
+#ifdef CONFIG_XZ_DEC_MT
+#include <linux/xz.h>
+
+/*
+ * Archives compressed with xz --threads are made of independent Blocks,
+ * which can be decoded on all CPUs. Returns false, without touching the
+ * archive, if this one cannot.
+ */
+static bool __init unpack_xz_parallel(char *buf, unsigned long len)
+{
+	size_t in_used;
+	enum xz_ret ret;
+
+	ret = xz_dec_mt_run(buf, len, &in_used, flush_buffer);
+	if (ret == XZ_OPTIONS_ERROR)
+		return false;
+
+	if (ret != XZ_STREAM_END) {
+		error("decompressor failed");
+		in_used = len;
+	}
+	my_inptr = in_used;
+	return true;
+}
+#else
+static inline bool unpack_xz_parallel(char *buf, unsigned long len)
+{
+	return false;
+}
+#endif
+
 static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 {
 	long written;
@@ -484,8 +515,12 @@ static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 		decompress = decompress_method(buf, len, &compress_name);
 		pr_debug("Detected %s compressed data\n", compress_name);
 		if (decompress) {
-			int res = decompress(buf, len, NULL, flush_buffer, NULL,
-				   &my_inptr, error);
+			int res = 0;
+
+			if (strcmp(compress_name, "xz") ||
+			    !unpack_xz_parallel(buf, len))
+				res = decompress(buf, len, NULL, flush_buffer,
+						 NULL, &my_inptr, error);
 			if (res)
 				error("decompressor failed");
 		} else if (compress_name) {
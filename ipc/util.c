@@ -749,36 +749,41 @@ struct pid_namespace *ipc_seq_pid_ns(struct seq_file *s)
 }
 
 /*
- * This routine locks the ipc structure found at least at position pos.
+ * This routine locks the first ipc structure with an idr index of at least
+ * *idx, and updates *idx to the index it was found at.
  */
-static struct kern_ipc_perm *sysvipc_find_ipc(struct ipc_ids *ids, loff_t pos,
-					      loff_t *new_pos)
+static struct kern_ipc_perm *sysvipc_find_ipc(struct ipc_ids *ids, int *idx)
 {
 	struct kern_ipc_perm *ipc;
-	int total, id;
 
-	total = 0;
-	for (id = 0; id < pos && total < ids->in_use; id++) {
-		ipc = idr_find(&ids->ipcs_idr, id);
-		if (ipc != NULL)
-			total++;
+	ipc = idr_get_next(&ids->ipcs_idr, idx);
+	if (ipc) {
+		rcu_read_lock();
+		ipc_lock_object(ipc);
 	}
+	return ipc;
+}
 
-	ipc = NULL;
-	if (total >= ids->in_use)
-		goto out;
+/*
+ * Find the idr index to resume from for file position pos.  Sequential
+ * readers always hit the cursor left behind by the previous read; only
+ * lseek() and pread() have to count entries from the start.
+ */
+static int sysvipc_pos_to_idx(struct seq_file *s, struct ipc_ids *ids,
+			      loff_t pos)
+{
+	u64 cursor;
+	int idx = 0;
 
-	for (; pos < ipc_mni; pos++) {
-		ipc = idr_find(&ids->ipcs_idr, pos);
-		if (ipc != NULL) {
-			rcu_read_lock();
-			ipc_lock_object(ipc);
+	if (seq_cursor_get(s, pos, &cursor))
+		return cursor;
+
+	while (--pos > 0) {
+		if (!idr_get_next(&ids->ipcs_idr, &idx))
 			break;
-		}
+		idx++;
 	}
-out:
-	*new_pos = pos + 1;
-	return ipc;
+	return idx;
 }
 
 static void *sysvipc_proc_next(struct seq_file *s, void *it, loff_t *pos)
@@ -786,23 +791,32 @@ static void *sysvipc_proc_next(struct seq_file *s, void *it, loff_t *pos)
 	struct ipc_proc_iter *iter = s->private;
 	struct ipc_proc_iface *iface = iter->iface;
 	struct kern_ipc_perm *ipc = it;
+	int idx = 0;
 
 	/* If we had an ipc id locked before, unlock it */
-	if (ipc && ipc != SEQ_START_TOKEN)
+	if (ipc && ipc != SEQ_START_TOKEN) {
+		idx = ipcid_to_idx(ipc->id) + 1;
 		ipc_unlock(ipc);
+	}
 
-	return sysvipc_find_ipc(&iter->ns->ids[iface->ids], *pos, pos);
+	++*pos;
+	ipc = sysvipc_find_ipc(&iter->ns->ids[iface->ids], &idx);
+	if (ipc)
+		seq_cursor_set(s, *pos, idx);
+	return ipc;
 }
 
 /*
- * File positions: pos 0 -> header, pos n -> ipc id = n - 1.
+ * File positions: pos 0 -> header, pos n -> n-th ipc in idr order.
  * SeqFile iterator: iterator value locked ipc pointer or SEQ_TOKEN_START.
  */
 static void *sysvipc_proc_start(struct seq_file *s, loff_t *pos)
 {
 	struct ipc_proc_iter *iter = s->private;
 	struct ipc_proc_iface *iface = iter->iface;
+	struct kern_ipc_perm *ipc;
 	struct ipc_ids *ids;
+	int idx;
 
 	ids = &iter->ns->ids[iface->ids];
 
@@ -820,8 +834,11 @@ static void *sysvipc_proc_start(struct seq_file *s, loff_t *pos)
 	if (*pos == 0)
 		return SEQ_START_TOKEN;
 
-	/* Find the (pos-1)th ipc */
-	return sysvipc_find_ipc(ids, *pos - 1, pos);
+	idx = sysvipc_pos_to_idx(s, ids, *pos);
+	ipc = sysvipc_find_ipc(ids, &idx);
+	if (ipc)
+		seq_cursor_set(s, *pos, idx);
+	return ipc;
 }
 
 static void sysvipc_proc_stop(struct seq_file *s, void *it)
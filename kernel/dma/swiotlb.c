@@ -25,6 +25,9 @@
 #include <linux/dma-map-ops.h>
 #include <linux/mm.h>
 #include <linux/export.h>
+#include <linux/cpumask.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/swiotlb.h>
@@ -38,6 +41,7 @@
 #include <linux/set_memory.h>
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #endif
 
 #include <asm/io.h>
@@ -74,17 +78,39 @@ phys_addr_t io_tlb_start, io_tlb_end;
  */
 static unsigned long io_tlb_nslabs;
 
-/*
- * The number of used IO TLB block
- */
-static unsigned long io_tlb_used;
-
 /*
  * This is a free list describing the number of free entries available from
  * each index
  */
 static unsigned int *io_tlb_list;
-static unsigned int io_tlb_index;
+
+/**
+ * struct io_tlb_area - IO TLB memory area descriptor
+ * @used:	The number of used slots in the area.
+ * @index:	The area relative slot index to start searching from.
+ * @contended:	The number of times the area lock was found held.
+ * @lock:	Protects the above and the io_tlb_list entries of the area.
+ *
+ * The slots are split into areas of whole segments, so an allocation never
+ * crosses an area.  Each CPU starts searching in its own area, which keeps
+ * bounce heavy workloads on different CPUs off each other's locks.
+ */
+struct io_tlb_area {
+	unsigned long used;
+	unsigned int index;
+	unsigned long contended;
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp;
+
+static struct io_tlb_area *io_tlb_areas;
+static unsigned int io_tlb_nareas;
+static unsigned long io_tlb_area_nslabs;
+
+/*
+ * The number of areas asked for on the command line, or zero for one per
+ * possible CPU.
+ */
+static unsigned int default_nareas;
 
 /*
  * Max segment that we can provide which (if pages are contingous) will
@@ -99,11 +125,6 @@ static unsigned int max_segment;
 #define INVALID_PHYS_ADDR (~(phys_addr_t)0)
 static phys_addr_t *io_tlb_orig_addr;
 
-/*
- * Protect the above data structures in the map and unmap calls
- */
-static DEFINE_SPINLOCK(io_tlb_lock);
-
 static int late_alloc;
 
 static int __init
@@ -114,6 +135,13 @@ setup_io_tlb_npages(char *str)
 		/* avoid tail segment of size < IO_TLB_SEGSIZE */
 		io_tlb_nslabs = ALIGN(io_tlb_nslabs, IO_TLB_SEGSIZE);
 	}
+	if (*str == ',')
+		++str;
+	if (isdigit(*str)) {
+		default_nareas = simple_strtoul(str, &str, 0);
+		if (default_nareas)
+			default_nareas = roundup_pow_of_two(default_nareas);
+	}
 	if (*str == ',')
 		++str;
 	if (!strcmp(str, "force")) {
@@ -178,6 +206,45 @@ static inline unsigned long io_tlb_offset(unsigned long val)
 	return val & (IO_TLB_SEGSIZE - 1);
 }
 
+/*
+ * Pick a power of two number of areas, each made of whole segments.
+ */
+static unsigned int swiotlb_nareas(unsigned long nslabs)
+{
+	unsigned int nareas = default_nareas;
+
+	if (!nareas)
+		nareas = roundup_pow_of_two(num_possible_cpus());
+	while (nareas > 1 && nslabs % (nareas * IO_TLB_SEGSIZE))
+		nareas >>= 1;
+	return nareas;
+}
+
+static void swiotlb_init_areas(struct io_tlb_area *areas, unsigned int nareas)
+{
+	unsigned int i;
+
+	for (i = 0; i < nareas; i++) {
+		areas[i].used = 0;
+		areas[i].index = 0;
+		areas[i].contended = 0;
+		spin_lock_init(&areas[i].lock);
+	}
+	io_tlb_areas = areas;
+	io_tlb_nareas = nareas;
+	io_tlb_area_nslabs = io_tlb_nslabs / nareas;
+}
+
+static unsigned long swiotlb_used(void)
+{
+	unsigned long used = 0;
+	unsigned int i;
+
+	for (i = 0; i < io_tlb_nareas; i++)
+		used += READ_ONCE(io_tlb_areas[i].used);
+	return used;
+}
+
 static inline unsigned long nr_slots(u64 val)
 {
 	return DIV_ROUND_UP(val, IO_TLB_SIZE);
@@ -205,6 +272,8 @@ void __init swiotlb_update_mem_attributes(void)
 
 int __init swiotlb_init_with_tbl(char *tlb, unsigned long nslabs, int verbose)
 {
+	unsigned int nareas = swiotlb_nareas(nslabs);
+	struct io_tlb_area *areas;
 	unsigned long i, bytes;
 	size_t alloc_size;
 
@@ -231,11 +300,17 @@ int __init swiotlb_init_with_tbl(char *tlb, unsigned long nslabs, int verbose)
 		panic("%s: Failed to allocate %zu bytes align=0x%lx\n",
 		      __func__, alloc_size, PAGE_SIZE);
 
+	alloc_size = array_size(nareas, sizeof(*areas));
+	areas = memblock_alloc(alloc_size, SMP_CACHE_BYTES);
+	if (!areas)
+		panic("%s: Failed to allocate %zu bytes align=0x%x\n",
+		      __func__, alloc_size, SMP_CACHE_BYTES);
+
 	for (i = 0; i < io_tlb_nslabs; i++) {
 		io_tlb_list[i] = IO_TLB_SEGSIZE - io_tlb_offset(i);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas(areas, nareas);
 	no_iotlb_memory = false;
 
 	if (verbose)
@@ -328,6 +403,9 @@ swiotlb_late_init_with_default_size(size_t default_size)
 
 static void swiotlb_cleanup(void)
 {
+	io_tlb_areas = NULL;
+	io_tlb_nareas = 0;
+	io_tlb_area_nslabs = 0;
 	io_tlb_end = 0;
 	io_tlb_start = 0;
 	io_tlb_nslabs = 0;
@@ -337,6 +415,8 @@ static void swiotlb_cleanup(void)
 int
 swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 {
+	unsigned int nareas = swiotlb_nareas(nslabs);
+	struct io_tlb_area *areas;
 	unsigned long i, bytes;
 
 	bytes = nslabs << IO_TLB_SHIFT;
@@ -365,11 +445,15 @@ swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 	if (!io_tlb_orig_addr)
 		goto cleanup4;
 
+	areas = kcalloc(nareas, sizeof(*areas), GFP_KERNEL);
+	if (!areas)
+		goto cleanup5;
+
 	for (i = 0; i < io_tlb_nslabs; i++) {
 		io_tlb_list[i] = IO_TLB_SEGSIZE - io_tlb_offset(i);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas(areas, nareas);
 	no_iotlb_memory = false;
 
 	swiotlb_print_info();
@@ -380,6 +464,10 @@ swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 
 	return 0;
 
+cleanup5:
+	free_pages((unsigned long)io_tlb_orig_addr,
+		   get_order(io_tlb_nslabs * sizeof(phys_addr_t)));
+	io_tlb_orig_addr = NULL;
 cleanup4:
 	free_pages((unsigned long)io_tlb_list, get_order(io_tlb_nslabs *
 	                                                 sizeof(int)));
@@ -395,6 +483,7 @@ void __init swiotlb_exit(void)
 		return;
 
 	if (late_alloc) {
+		kfree(io_tlb_areas);
 		free_pages((unsigned long)io_tlb_orig_addr,
 			   get_order(io_tlb_nslabs * sizeof(phys_addr_t)));
 		free_pages((unsigned long)io_tlb_list, get_order(io_tlb_nslabs *
@@ -402,6 +491,9 @@ void __init swiotlb_exit(void)
 		free_pages((unsigned long)phys_to_virt(io_tlb_start),
 			   get_order(io_tlb_nslabs << IO_TLB_SHIFT));
 	} else {
+		memblock_free_late(__pa(io_tlb_areas),
+				   array_size(io_tlb_nareas,
+					      sizeof(*io_tlb_areas)));
 		memblock_free_late(__pa(io_tlb_orig_addr),
 				   PAGE_ALIGN(io_tlb_nslabs * sizeof(phys_addr_t)));
 		memblock_free_late(__pa(io_tlb_list),
@@ -475,20 +567,21 @@ static inline unsigned long get_max_slots(unsigned long boundary_mask)
 	return nr_slots(boundary_mask + 1);
 }
 
-static unsigned int wrap_index(unsigned int index)
+static unsigned int wrap_area_index(unsigned int index)
 {
-	if (index >= io_tlb_nslabs)
+	if (index >= io_tlb_area_nslabs)
 		return 0;
 	return index;
 }
 
 /*
  * Find a suitable number of IO TLB entries size that will fit this request and
- * allocate a buffer from that IO TLB pool.
+ * allocate a buffer from the given area of the IO TLB pool.
  */
-static int find_slots(struct device *dev, phys_addr_t orig_addr,
-		size_t alloc_size)
+static int swiotlb_area_find_slots(struct device *dev, unsigned int area_index,
+		phys_addr_t orig_addr, size_t alloc_size)
 {
+	struct io_tlb_area *area = &io_tlb_areas[area_index];
 	unsigned long boundary_mask = dma_get_seg_boundary(dev);
 	dma_addr_t tbl_dma_addr =
 		phys_to_dma_unencrypted(dev, io_tlb_start) & boundary_mask;
@@ -496,7 +589,8 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 	unsigned int iotlb_align_mask =
 		dma_get_min_align_mask(dev) & ~(IO_TLB_SIZE - 1);
 	unsigned int nslots = nr_slots(alloc_size), stride;
-	unsigned int index, wrap, count = 0, i;
+	unsigned int base = area_index * io_tlb_area_nslabs;
+	unsigned int index, slot, wrap, count = 0, i;
 	unsigned long flags;
 
 	BUG_ON(!nslots);
@@ -510,15 +604,19 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 	if (alloc_size >= PAGE_SIZE)
 		stride = max(stride, stride << (PAGE_SHIFT - IO_TLB_SHIFT));
 
-	spin_lock_irqsave(&io_tlb_lock, flags);
-	if (unlikely(nslots > io_tlb_nslabs - io_tlb_used))
+	if (!spin_trylock_irqsave(&area->lock, flags)) {
+		spin_lock_irqsave(&area->lock, flags);
+		area->contended++;
+	}
+	if (unlikely(nslots > io_tlb_area_nslabs - area->used))
 		goto not_found;
 
-	index = wrap = wrap_index(ALIGN(io_tlb_index, stride));
+	index = wrap = wrap_area_index(ALIGN(area->index, stride));
 	do {
-		if ((slot_addr(tbl_dma_addr, index) & iotlb_align_mask) !=
+		slot = base + index;
+		if ((slot_addr(tbl_dma_addr, slot) & iotlb_align_mask) !=
 		    (orig_addr & iotlb_align_mask)) {
-			index = wrap_index(index + 1);
+			index = wrap_area_index(index + 1);
 			continue;
 		}
 
@@ -527,23 +625,23 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 		 * contiguous buffers, we allocate the buffers from that slot
 		 * and mark the entries as '0' indicating unavailable.
 		 */
-		if (!iommu_is_span_boundary(index, nslots,
+		if (!iommu_is_span_boundary(slot, nslots,
 					    nr_slots(tbl_dma_addr),
 					    max_slots)) {
-			if (io_tlb_list[index] >= nslots)
+			if (io_tlb_list[slot] >= nslots)
 				goto found;
 		}
-		index = wrap_index(index + stride);
+		index = wrap_area_index(index + stride);
 	} while (index != wrap);
 
 not_found:
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	spin_unlock_irqrestore(&area->lock, flags);
 	return -1;
 
 found:
-	for (i = index; i < index + nslots; i++)
+	for (i = slot; i < slot + nslots; i++)
 		io_tlb_list[i] = 0;
-	for (i = index - 1;
+	for (i = slot - 1;
 	     io_tlb_offset(i) != IO_TLB_SEGSIZE - 1 &&
 	     io_tlb_list[i]; i--)
 		io_tlb_list[i] = ++count;
@@ -551,14 +649,40 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 	/*
 	 * Update the indices to avoid searching in the next round.
 	 */
-	if (index + nslots < io_tlb_nslabs)
-		io_tlb_index = index + nslots;
+	if (index + nslots < io_tlb_area_nslabs)
+		area->index = index + nslots;
 	else
-		io_tlb_index = 0;
-	io_tlb_used += nslots;
+		area->index = 0;
+	area->used += nslots;
 
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
-	return index;
+	spin_unlock_irqrestore(&area->lock, flags);
+	return slot;
+}
+
+/*
+ * Allocate from the area of the current CPU, falling back to the others in
+ * turn when it is full.
+ */
+static int find_slots(struct device *dev, phys_addr_t orig_addr,
+		size_t alloc_size)
+{
+	unsigned int start, i;
+	int index;
+
+	if (unlikely(!io_tlb_nareas))
+		return -1;
+
+	start = raw_smp_processor_id() & (io_tlb_nareas - 1);
+	i = start;
+	do {
+		index = swiotlb_area_find_slots(dev, i, orig_addr, alloc_size);
+		if (index != -1)
+			return index;
+		if (++i >= io_tlb_nareas)
+			i = 0;
+	} while (i != start);
+
+	return -1;
 }
 
 phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
@@ -587,7 +711,7 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 		if (!(attrs & DMA_ATTR_NO_WARN))
 			dev_warn_ratelimited(dev,
 	"swiotlb buffer is full (sz: %zd bytes), total %lu (slots), used %lu (slots)\n",
-				 alloc_size, io_tlb_nslabs, io_tlb_used);
+				 alloc_size, io_tlb_nslabs, swiotlb_used());
 		return (phys_addr_t)DMA_MAPPING_ERROR;
 	}
 
@@ -622,6 +746,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	unsigned int offset = swiotlb_align_offset(hwdev, tlb_addr);
 	int i, count, nslots = nr_slots(alloc_size + offset);
 	int index = (tlb_addr - offset - io_tlb_start) >> IO_TLB_SHIFT;
+	struct io_tlb_area *area = &io_tlb_areas[index / io_tlb_area_nslabs];
 	phys_addr_t orig_addr = io_tlb_orig_addr[index];
 
 	/*
@@ -636,9 +761,13 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	 * Return the buffer to the free list by setting the corresponding
 	 * entries to indicate the number of contiguous entries available.
 	 * While returning the entries to the free list, we merge the entries
-	 * with slots below and above the pool being returned.
+	 * with slots below and above the pool being returned.  Segments never
+	 * span areas, so the merging stays within the area of the slots.
 	 */
-	spin_lock_irqsave(&io_tlb_lock, flags);
+	if (!spin_trylock_irqsave(&area->lock, flags)) {
+		spin_lock_irqsave(&area->lock, flags);
+		area->contended++;
+	}
 	if (index + nslots < ALIGN(index + 1, IO_TLB_SEGSIZE))
 		count = io_tlb_list[index + nslots];
 	else
@@ -661,8 +790,8 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	     io_tlb_offset(i) != IO_TLB_SEGSIZE - 1 && io_tlb_list[i];
 	     i--)
 		io_tlb_list[i] = ++count;
-	io_tlb_used -= nslots;
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	area->used -= nslots;
+	spin_unlock_irqrestore(&area->lock, flags);
 }
 
 void swiotlb_tbl_sync_single(struct device *hwdev, phys_addr_t tlb_addr,
@@ -759,13 +888,50 @@ bool is_swiotlb_active(void)
 
 #ifdef CONFIG_DEBUG_FS
 
+static int io_tlb_used_get(void *data, u64 *val)
+{
+	*val = swiotlb_used();
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_used, io_tlb_used_get, NULL, "%llu\n");
+
+static int io_tlb_contended_get(void *data, u64 *val)
+{
+	unsigned int i;
+
+	*val = 0;
+	for (i = 0; i < io_tlb_nareas; i++)
+		*val += READ_ONCE(io_tlb_areas[i].contended);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_contended, io_tlb_contended_get, NULL,
+			 "%llu\n");
+
+static int io_tlb_areas_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	for (i = 0; i < io_tlb_nareas; i++)
+		seq_printf(m, "%u: used %lu contended %lu\n", i,
+			   READ_ONCE(io_tlb_areas[i].used),
+			   READ_ONCE(io_tlb_areas[i].contended));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(io_tlb_areas);
+
 static int __init swiotlb_create_debugfs(void)
 {
 	struct dentry *root;
 
 	root = debugfs_create_dir("swiotlb", NULL);
 	debugfs_create_ulong("io_tlb_nslabs", 0400, root, &io_tlb_nslabs);
-	debugfs_create_ulong("io_tlb_used", 0400, root, &io_tlb_used);
+	debugfs_create_u32("io_tlb_nareas", 0400, root, &io_tlb_nareas);
+	debugfs_create_file_unsafe("io_tlb_used", 0400, root, NULL,
+				   &fops_io_tlb_used);
+	debugfs_create_file_unsafe("io_tlb_contended", 0400, root, NULL,
+				   &fops_io_tlb_contended);
+	debugfs_create_file("io_tlb_areas", 0400, root, NULL,
+			    &io_tlb_areas_fops);
 	return 0;
 }
 
@@ -10,7 +10,8 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 #define MODULE_NAME "842_compress"
 
-#include <linux/hashtable.h>
+#include <linux/hash.h>
+#include <linux/once.h>
 
 #include "842.h"
 #include "842_debugfs.h"
@@ -64,156 +65,141 @@ static u8 comp_ops[OPS_MAX][5] = { /* params size in bits */
 	{ D8, N0, N0, N0, 0x00 }, /* 64 */
 };
 
-struct sw842_hlist_node8 {
-	struct hlist_node node;
-	u64 data;
-	u8 index;
-};
-
-struct sw842_hlist_node4 {
-	struct hlist_node node;
-	u32 data;
-	u16 index;
-};
+/* which of the 4 and 2 byte indexes of an 8 byte block were found */
+#define MATCH_I4(n)		BIT(n)
+#define MATCH_I2(n)		BIT(2 + (n))
+#define MATCH_I8		BIT(6)
+#define MATCH_MAX		(1 << 6)
 
-struct sw842_hlist_node2 {
-	struct hlist_node node;
-	u16 data;
-	u8 index;
-};
+/* first (i.e. shortest) template usable for each set of MATCH_I4/I2 bits */
+static u8 comp_ops_match[MATCH_MAX];
 
 #define INDEX_NOT_FOUND		(-1)
-#define INDEX_NOT_CHECKED	(-2)
 
+/*
+ * Each hash table maps the data of a 2, 4 or 8 byte block to the index it
+ * was last seen at, plus one, so that a zeroed table is empty.  A table
+ * slot only holds the most recent of the blocks hashing to it, and the
+ * ring of data last seen at each index tells if that index still holds
+ * the data.
+ */
 struct sw842_param {
 	u8 *in;
 	u8 *instart;
 	u64 ilen;
 	u8 *out;
 	u64 olen;
-	u8 bit;
+	u64 bits;
+	u8 nbits;
 	u64 data8[1];
 	u32 data4[2];
 	u16 data2[4];
 	int index8[1];
 	int index4[2];
 	int index2[4];
-	DECLARE_HASHTABLE(htable8, SW842_HASHTABLE8_BITS);
-	DECLARE_HASHTABLE(htable4, SW842_HASHTABLE4_BITS);
-	DECLARE_HASHTABLE(htable2, SW842_HASHTABLE2_BITS);
-	struct sw842_hlist_node8 node8[1 << I8_BITS];
-	struct sw842_hlist_node4 node4[1 << I4_BITS];
-	struct sw842_hlist_node2 node2[1 << I2_BITS];
+	u16 htable8[1 << SW842_HASHTABLE8_BITS];
+	u16 htable4[1 << SW842_HASHTABLE4_BITS];
+	u16 htable2[1 << SW842_HASHTABLE2_BITS];
+	u64 ring8[1 << I8_BITS];
+	u32 ring4[1 << I4_BITS];
+	u16 ring2[1 << I2_BITS];
 };
 
 #define get_input_data(p, o, b)						\
 	be##b##_to_cpu(get_unaligned((__be##b *)((p)->in + (o))))
 
-#define init_hashtable_nodes(p, b)	do {			\
-	int _i;							\
-	hash_init((p)->htable##b);				\
-	for (_i = 0; _i < ARRAY_SIZE((p)->node##b); _i++) {	\
-		(p)->node##b[_i].index = _i;			\
-		(p)->node##b[_i].data = 0;			\
-		INIT_HLIST_NODE(&(p)->node##b[_i].node);	\
-	}							\
-} while (0)
+#define hash_data8(d)	hash_64(d, SW842_HASHTABLE8_BITS)
+#define hash_data4(d)	hash_32(d, SW842_HASHTABLE4_BITS)
+#define hash_data2(d)	hash_32(d, SW842_HASHTABLE2_BITS)
 
 #define find_index(p, b, n)	({					\
-	struct sw842_hlist_node##b *_n;					\
-	p->index##b[n] = INDEX_NOT_FOUND;				\
-	hash_for_each_possible(p->htable##b, _n, node, p->data##b[n]) {	\
-		if (p->data##b[n] == _n->data) {			\
-			p->index##b[n] = _n->index;			\
-			break;						\
-		}							\
-	}								\
-	p->index##b[n] >= 0;						\
+	u16 _i = (p)->htable##b[hash_data##b((p)->data##b[n])];	\
+	(p)->index##b[n] = INDEX_NOT_FOUND;				\
+	if (_i && (p)->ring##b[_i - 1] == (p)->data##b[n])		\
+		(p)->index##b[n] = _i - 1;				\
+	(p)->index##b[n] >= 0;						\
 })
 
-#define check_index(p, b, n)			\
-	((p)->index##b[n] == INDEX_NOT_CHECKED	\
-	 ? find_index(p, b, n)			\
-	 : (p)->index##b[n] >= 0)
-
 #define replace_hash(p, b, i, d)	do {				\
-	struct sw842_hlist_node##b *_n = &(p)->node##b[(i)+(d)];	\
-	hash_del(&_n->node);						\
-	_n->data = (p)->data##b[d];					\
+	(p)->ring##b[(i)+(d)] = (p)->data##b[d];			\
+	(p)->htable##b[hash_data##b((p)->data##b[d])] = (i)+(d)+1;	\
 	pr_debug("add hash index%x %x pos %x data %lx\n", b,		\
-		 (unsigned int)_n->index,				\
+		 (unsigned int)((i)+(d)),				\
 		 (unsigned int)((p)->in - (p)->instart),		\
-		 (unsigned long)_n->data);				\
-	hash_add((p)->htable##b, &_n->node, _n->data);			\
+		 (unsigned long)(p)->data##b[d]);			\
 } while (0)
 
-static u8 bmask[8] = { 0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc, 0xfe };
+/*
+ * Output bits are gathered in p->bits, and written out in whole bytes
+ * once there are 32 or more of them.  Only the low p->nbits bits are
+ * pending; anything above them is shifted out before it is written.
+ */
+static int flush_bits(struct sw842_param *p)
+{
+	u8 n = p->nbits / 8, i;
 
-static int add_bits(struct sw842_param *p, u64 d, u8 n);
+	if (!n)
+		return 0;
 
-static int __split_add_bits(struct sw842_param *p, u64 d, u8 n, u8 s)
-{
-	int ret;
+	if (likely(p->olen >= 8)) {
+		/* the bytes past the n written ones are rewritten later */
+		put_unaligned(cpu_to_be64(p->bits << (64 - p->nbits)),
+			      (__be64 *)p->out);
+	} else {
+		if (n > p->olen)
+			return -ENOSPC;
+		for (i = 0; i < n; i++)
+			p->out[i] = p->bits >> (p->nbits - 8 * (i + 1));
+	}
 
-	if (n <= s)
-		return -EINVAL;
+	p->out += n;
+	p->olen -= n;
+	p->nbits -= n * 8;
 
-	ret = add_bits(p, d >> s, n - s);
-	if (ret)
-		return ret;
-	return add_bits(p, d & GENMASK_ULL(s - 1, 0), s);
+	return 0;
 }
 
 static int add_bits(struct sw842_param *p, u64 d, u8 n)
 {
-	int b = p->bit, bits = b + n, s = round_up(bits, 8) - bits;
-	u64 o;
-	u8 *out = p->out;
+	int ret;
 
 	pr_debug("add %u bits %lx\n", (unsigned char)n, (unsigned long)d);
 
 	if (n > 64)
 		return -EINVAL;
 
-	/* split this up if writing to > 8 bytes (i.e. n == 64 && p->bit > 0),
-	 * or if we're at the end of the output buffer and would write past end
-	 */
-	if (bits > 64)
-		return __split_add_bits(p, d, n, 32);
-	else if (p->olen < 8 && bits > 32 && bits <= 56)
-		return __split_add_bits(p, d, n, 16);
-	else if (p->olen < 4 && bits > 16 && bits <= 24)
-		return __split_add_bits(p, d, n, 8);
-
-	if (DIV_ROUND_UP(bits, 8) > p->olen)
-		return -ENOSPC;
+	/* p->nbits is below 32 here, so 32 more bits always fit */
+	if (n > 32) {
+		ret = add_bits(p, d >> 32, n - 32);
+		if (ret)
+			return ret;
+		d &= GENMASK_ULL(31, 0);
+		n = 32;
+	}
+
+	p->bits = p->bits << n | d;
+	p->nbits += n;
+
+	if (p->nbits >= 32)
+		return flush_bits(p);
+
+	return 0;
+}
+
+/* write out all pending bits, padding the last byte with zeros */
+static int end_bits(struct sw842_param *p)
+{
+	int ret = flush_bits(p);
 
-	o = *out & bmask[b];
-	d <<= s;
-
-	if (bits <= 8)
-		*out = o | d;
-	else if (bits <= 16)
-		put_unaligned(cpu_to_be16(o << 8 | d), (__be16 *)out);
-	else if (bits <= 24)
-		put_unaligned(cpu_to_be32(o << 24 | d << 8), (__be32 *)out);
-	else if (bits <= 32)
-		put_unaligned(cpu_to_be32(o << 24 | d), (__be32 *)out);
-	else if (bits <= 40)
-		put_unaligned(cpu_to_be64(o << 56 | d << 24), (__be64 *)out);
-	else if (bits <= 48)
-		put_unaligned(cpu_to_be64(o << 56 | d << 16), (__be64 *)out);
-	else if (bits <= 56)
-		put_unaligned(cpu_to_be64(o << 56 | d << 8), (__be64 *)out);
-	else
-		put_unaligned(cpu_to_be64(o << 56 | d), (__be64 *)out);
-
-	p->bit += n;
-
-	if (p->bit > 7) {
-		p->out += p->bit / 8;
-		p->olen -= p->bit / 8;
-		p->bit %= 8;
+	if (ret)
+		return ret;
+
+	if (p->nbits) {
+		if (!p->olen)
+			return -ENOSPC;
+		*p->out++ = p->bits << (8 - p->nbits);
+		p->olen--;
+		p->nbits = 0;
 	}
 
 	return 0;
@@ -250,7 +236,7 @@ static int add_template(struct sw842_param *p, u8 c)
 			break;
 		case OP_AMOUNT_4:
 			if (b == 2 && t[i] & OP_ACTION_DATA)
-				ret = add_bits(p, get_input_data(p, 2, 32), 32);
+				ret = add_bits(p, (u32)(p->data8[0] >> 16), 32);
 			else if (b != 0 && b != 4)
 				inv = true;
 			else if (t[i] & OP_ACTION_INDEX)
@@ -377,43 +363,58 @@ static int add_end_template(struct sw842_param *p)
 	return 0;
 }
 
-static bool check_template(struct sw842_param *p, u8 c)
+/* the index lookups an 8 byte block needs to use template @c */
+static u8 template_match(u8 c)
 {
 	u8 *t = comp_ops[c];
-	int i, match, b = 0;
-
-	if (c >= OPS_MAX)
-		return false;
+	int i, b = 0;
+	u8 match = 0;
 
 	for (i = 0; i < 4; i++) {
 		if (t[i] & OP_ACTION_INDEX) {
 			if (t[i] & OP_AMOUNT_2)
-				match = check_index(p, 2, b >> 1);
+				match |= MATCH_I2(b >> 1);
 			else if (t[i] & OP_AMOUNT_4)
-				match = check_index(p, 4, b >> 2);
+				match |= MATCH_I4(b >> 2);
 			else if (t[i] & OP_AMOUNT_8)
-				match = check_index(p, 8, 0);
-			else
-				return false;
-			if (!match)
-				return false;
+				match |= MATCH_I8;
 		}
 
 		b += t[i] & OP_AMOUNT;
 	}
 
-	return true;
+	return match;
 }
 
+static void init_comp_ops_match(void)
+{
+	u8 m, c;
+
+	for (m = 0; m < MATCH_MAX; m++) {
+		/* check up to OPS_MAX - 1; last op is our fallback */
+		for (c = 0; c < OPS_MAX - 1; c++) {
+			if (!(template_match(c) & ~m))
+				break;
+		}
+		comp_ops_match[m] = c;
+	}
+}
+
+/*
+ * A single unaligned load gets the block; its 4 and 2 byte parts are
+ * taken from that.
+ */
 static void get_next_data(struct sw842_param *p)
 {
-	p->data8[0] = get_input_data(p, 0, 64);
-	p->data4[0] = get_input_data(p, 0, 32);
-	p->data4[1] = get_input_data(p, 4, 32);
-	p->data2[0] = get_input_data(p, 0, 16);
-	p->data2[1] = get_input_data(p, 2, 16);
-	p->data2[2] = get_input_data(p, 4, 16);
-	p->data2[3] = get_input_data(p, 6, 16);
+	u64 d = get_input_data(p, 0, 64);
+
+	p->data8[0] = d;
+	p->data4[0] = d >> 32;
+	p->data4[1] = d;
+	p->data2[0] = d >> 48;
+	p->data2[1] = d >> 32;
+	p->data2[2] = d >> 16;
+	p->data2[3] = d;
 }
 
 /* update the hashtable entries.
@@ -441,27 +442,26 @@ static void update_hashtables(struct sw842_param *p)
  */
 static int process_next(struct sw842_param *p)
 {
-	int ret, i;
-
-	p->index8[0] = INDEX_NOT_CHECKED;
-	p->index4[0] = INDEX_NOT_CHECKED;
-	p->index4[1] = INDEX_NOT_CHECKED;
-	p->index2[0] = INDEX_NOT_CHECKED;
-	p->index2[1] = INDEX_NOT_CHECKED;
-	p->index2[2] = INDEX_NOT_CHECKED;
-	p->index2[3] = INDEX_NOT_CHECKED;
-
-	/* check up to OPS_MAX - 1; last op is our fallback */
-	for (i = 0; i < OPS_MAX - 1; i++) {
-		if (check_template(p, i))
-			break;
-	}
-
-	ret = add_template(p, i);
-	if (ret)
-		return ret;
-
-	return 0;
+	u8 match = 0;
+
+	/* nothing beats a single 8 byte index */
+	if (find_index(p, 8, 0))
+		return add_template(p, 0);
+
+	if (find_index(p, 4, 0))
+		match |= MATCH_I4(0);
+	if (find_index(p, 4, 1))
+		match |= MATCH_I4(1);
+	if (find_index(p, 2, 0))
+		match |= MATCH_I2(0);
+	if (find_index(p, 2, 1))
+		match |= MATCH_I2(1);
+	if (find_index(p, 2, 2))
+		match |= MATCH_I2(2);
+	if (find_index(p, 2, 3))
+		match |= MATCH_I2(3);
+
+	return add_template(p, comp_ops_match[match]);
 }
 
 /**
@@ -485,16 +485,19 @@ int sw842_compress(const u8 *in, unsigned int ilen,
 
 	BUILD_BUG_ON(sizeof(*p) > SW842_MEM_COMPRESS);
 
-	init_hashtable_nodes(p, 8);
-	init_hashtable_nodes(p, 4);
-	init_hashtable_nodes(p, 2);
+	DO_ONCE(init_comp_ops_match);
+
+	memset(p->htable8, 0, sizeof(p->htable8));
+	memset(p->htable4, 0, sizeof(p->htable4));
+	memset(p->htable2, 0, sizeof(p->htable2));
 
 	p->in = (u8 *)in;
 	p->instart = p->in;
 	p->ilen = ilen;
 	p->out = out;
 	p->olen = *olen;
-	p->bit = 0;
+	p->bits = 0;
+	p->nbits = 0;
 
 	total = p->olen;
 
@@ -511,20 +514,15 @@ int sw842_compress(const u8 *in, unsigned int ilen,
 		goto skip_comp;
 
 	/* make initial 'last' different so we don't match the first time */
-	last = ~get_unaligned((u64 *)p->in);
+	last = ~get_input_data(p, 0, 64);
 
 	while (p->ilen > 7) {
-		next = get_unaligned((u64 *)p->in);
-
 		/* must get the next data, as we need to update the hashtable
 		 * entries with the new data every time
 		 */
 		get_next_data(p);
+		next = p->data8[0];
 
-		/* we don't care about endianness in last or next;
-		 * we're just comparing 8 bytes to another 8 bytes,
-		 * they're both the same endianness
-		 */
 		if (next == last) {
 			/* repeat count bits are 0-based, so we stop at +1 */
 			if (++repeat_count <= REPEAT_BITS_MAX)
@@ -532,6 +530,8 @@ int sw842_compress(const u8 *in, unsigned int ilen,
 		}
 		if (repeat_count) {
 			ret = add_repeat_template(p, repeat_count);
+			if (ret)
+				return ret;
 			repeat_count = 0;
 			if (next == last) /* reached max repeat bits */
 				goto repeat;
@@ -584,11 +584,9 @@ int sw842_compress(const u8 *in, unsigned int ilen,
 	if (ret)
 		return ret;
 
-	if (p->bit) {
-		p->out++;
-		p->olen--;
-		p->bit = 0;
-	}
+	ret = end_bits(p);
+	if (ret)
+		return ret;
 
 	/* pad compressed length to multiple of 8 */
 	pad = (8 - ((total - p->olen) % 8)) % 8;
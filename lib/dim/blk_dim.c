@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0 OR Linux-OpenIB
+/*
+ * Adaptive completion moderation for block devices.
+ */
+
+#include <linux/dim.h>
+
+/*
+ * Block DIM profiles:
+ *        The interrupt fires once .comps completions are pending. There
+ *        is no timer: .usec is left at zero, and the consumer bounds the
+ *        wait by the requests it has in flight.
+ */
+#define BLK_DIM_PROFILES { \
+	{.comps = 1,},  \
+	{.comps = 4,},  \
+	{.comps = 8,},  \
+	{.comps = 16,}, \
+	{.comps = 32,}, \
+	{.comps = 64,}  \
+}
+
+static const struct dim_cq_moder
+blk_profile[BLK_DIM_PARAMS_NUM_PROFILES] = BLK_DIM_PROFILES;
+
+struct dim_cq_moder blk_dim_get_moderation(int ix)
+{
+	struct dim_cq_moder cq_moder = blk_profile[ix];
+
+	cq_moder.cq_period_mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	return cq_moder;
+}
+EXPORT_SYMBOL(blk_dim_get_moderation);
+
+static int blk_dim_step(struct dim *dim)
+{
+	if (dim->tired == (BLK_DIM_PARAMS_NUM_PROFILES * 2))
+		return DIM_TOO_TIRED;
+
+	switch (dim->tune_state) {
+	case DIM_PARKING_ON_TOP:
+	case DIM_PARKING_TIRED:
+		break;
+	case DIM_GOING_RIGHT:
+		if (dim->profile_ix == (BLK_DIM_PARAMS_NUM_PROFILES - 1))
+			return DIM_ON_EDGE;
+		dim->profile_ix++;
+		dim->steps_right++;
+		break;
+	case DIM_GOING_LEFT:
+		if (dim->profile_ix == 0)
+			return DIM_ON_EDGE;
+		dim->profile_ix--;
+		dim->steps_left++;
+		break;
+	}
+
+	dim->tired++;
+	return DIM_STEPPED;
+}
+
+static void blk_dim_exit_parking(struct dim *dim)
+{
+	dim->tune_state = dim->profile_ix ? DIM_GOING_LEFT : DIM_GOING_RIGHT;
+	blk_dim_step(dim);
+}
+
+static int blk_dim_stats_compare(struct dim_stats *curr,
+				 struct dim_stats *prev)
+{
+	if (!prev->cpms)
+		return curr->cpms ? DIM_STATS_BETTER : DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->cpms, prev->cpms))
+		return (curr->cpms > prev->cpms) ? DIM_STATS_BETTER :
+						   DIM_STATS_WORSE;
+
+	/* same IOPS: the moderation must not cost latency */
+	if (IS_SIGNIFICANT_DIFF(curr->lat_avg, prev->lat_avg))
+		return (curr->lat_avg < prev->lat_avg) ? DIM_STATS_BETTER :
+							 DIM_STATS_WORSE;
+
+	if (IS_SIGNIFICANT_DIFF(curr->cpe_ratio, prev->cpe_ratio))
+		return (curr->cpe_ratio > prev->cpe_ratio) ? DIM_STATS_BETTER :
+							     DIM_STATS_WORSE;
+
+	return DIM_STATS_SAME;
+}
+
+static bool blk_dim_decision(struct dim_stats *curr_stats, struct dim *dim)
+{
+	int prev_state = dim->tune_state;
+	int prev_ix = dim->profile_ix;
+	int stats_res;
+	int step_res;
+
+	switch (dim->tune_state) {
+	case DIM_PARKING_ON_TOP:
+		stats_res = blk_dim_stats_compare(curr_stats,
+						  &dim->prev_stats);
+		if (stats_res != DIM_STATS_SAME)
+			blk_dim_exit_parking(dim);
+		break;
+
+	case DIM_PARKING_TIRED:
+		dim->tired--;
+		if (!dim->tired)
+			blk_dim_exit_parking(dim);
+		break;
+
+	case DIM_GOING_RIGHT:
+	case DIM_GOING_LEFT:
+		stats_res = blk_dim_stats_compare(curr_stats,
+						  &dim->prev_stats);
+		/*
+		 * Profiles batching more than the queue can supply behave the
+		 * same, so keep backing off across such a plateau instead of
+		 * settling on it.
+		 */
+		if (stats_res == DIM_STATS_WORSE ||
+		    (stats_res == DIM_STATS_SAME &&
+		     dim->tune_state == DIM_GOING_RIGHT))
+			dim_turn(dim);
+
+		if (dim_on_top(dim)) {
+			dim_park_on_top(dim);
+			break;
+		}
+
+		step_res = blk_dim_step(dim);
+		switch (step_res) {
+		case DIM_ON_EDGE:
+			dim_park_on_top(dim);
+			break;
+		case DIM_TOO_TIRED:
+			dim_park_tired(dim);
+			break;
+		}
+
+		break;
+	}
+
+	if (prev_state != DIM_PARKING_ON_TOP ||
+	    dim->tune_state != DIM_PARKING_ON_TOP)
+		dim->prev_stats = *curr_stats;
+
+	return dim->profile_ix != prev_ix;
+}
+
+void blk_dim(struct dim *dim, struct dim_sample end_sample)
+{
+	struct dim_stats curr_stats;
+	u16 nevents;
+
+	switch (dim->state) {
+	case DIM_MEASURE_IN_PROGRESS:
+		nevents = BIT_GAP(BITS_PER_TYPE(u16),
+				  end_sample.event_ctr,
+				  dim->start_sample.event_ctr);
+		if (nevents < DIM_NEVENTS)
+			break;
+		dim_calc_stats(&dim->start_sample, &end_sample, &curr_stats);
+		if (blk_dim_decision(&curr_stats, dim)) {
+			dim->state = DIM_APPLY_NEW_PROFILE;
+			schedule_work(&dim->work);
+			break;
+		}
+		/* fall through */
+	case DIM_START_MEASURE:
+		dim->start_sample = end_sample;
+		dim->state = DIM_MEASURE_IN_PROGRESS;
+		break;
+	case DIM_APPLY_NEW_PROFILE:
+		break;
+	}
+}
+EXPORT_SYMBOL(blk_dim);
@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit test for block DIM: replays synthetic completion traces and checks
+ * where the moderation settles.
+ */
+
+#include <kunit/test.h>
+#include <linux/dim.h>
+
+/*
+ * The trace model is a closed loop: @qd requests are kept in flight and
+ * each completion is resubmitted from the interrupt that reaps it. The
+ * device serves one request every @service_ns. The guest spends @irq_ns
+ * of CPU per interrupt and @req_ns per request, and resubmits @wake_ns
+ * after the device raised the interrupt.
+ */
+struct blk_dim_load {
+	u32 qd;
+	u32 service_ns;
+	u32 irq_ns;
+	u32 req_ns;
+	u32 wake_ns;
+};
+
+/*
+ * For the moderation currently applied: how many requests complete per
+ * interrupt, how long an interrupt period lasts and the completion latency.
+ */
+struct blk_dim_event {
+	u32 comps;
+	u32 period_ns;
+	u32 lat_us;
+};
+
+/*
+ * Completions per interrupt with event index callbacks, as armed by
+ * virtqueue_enable_cb_after(): the used event is set at most 3/4 of the
+ * requests in flight, and @comps - 1, entries ahead, and there is no timer.
+ */
+static u32 blk_dim_batch(const struct dim_cq_moder *moder, u32 inflight)
+{
+	u32 ahead = min_t(u32, inflight * 3 / 4, max_t(u16, moder->comps, 1) - 1);
+
+	return ahead + 1;
+}
+
+static void blk_dim_model(const struct blk_dim_load *load,
+			  const struct dim_cq_moder *moder,
+			  struct blk_dim_event *ev)
+{
+	u32 k = blk_dim_batch(moder, load->qd);
+	u32 busy = k * load->service_ns;
+	u32 left = (load->qd - k) * load->service_ns;
+	u32 cpu = load->irq_ns + k * load->req_ns;
+
+	/* the device idles if the rest of the queue drains before the refill */
+	if (load->wake_ns > left)
+		busy += load->wake_ns - left;
+
+	ev->comps = k;
+	ev->period_ns = max(busy, cpu);
+	/* Little's law: qd requests in flight at k per period */
+	ev->lat_us = div_u64((u64)load->qd * ev->period_ns, k * NSEC_PER_USEC);
+}
+
+/*
+ * A fast device with a deep queue, limited by the per interrupt cost of
+ * the guest: coalescing buys throughput.
+ */
+static const struct blk_dim_load blk_dim_cpu_bound = {
+	.qd = 128, .service_ns = 250, .irq_ns = 4000, .req_ns = 500,
+	.wake_ns = 5000,
+};
+
+/*
+ * Queue depth one: the event index can never be set past the only request
+ * in flight, so every profile means one interrupt per completion.
+ */
+static const struct blk_dim_load blk_dim_qd1 = {
+	.qd = 1, .service_ns = 20000, .irq_ns = 4000, .req_ns = 500,
+	.wake_ns = 5000,
+};
+
+/*
+ * A shallow queue on a device bound by its service time: batching more
+ * than half the queue lets it drain while the guest wakes up.
+ */
+static const struct blk_dim_load blk_dim_shallow = {
+	.qd = 8, .service_ns = 4000, .irq_ns = 1000, .req_ns = 200,
+	.wake_ns = 10000,
+};
+
+struct blk_dim_replay {
+	struct dim dim;
+	struct dim_sample sample;
+	u64 now_ns;
+	u16 events;
+	u32 comps;
+	u32 lat_us;
+};
+
+static void blk_dim_test_work(struct work_struct *work)
+{
+}
+
+static void blk_dim_replay_init(struct blk_dim_replay *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->dim.profile_ix = BLK_DIM_START_PROFILE;
+	INIT_WORK(&r->dim.work, blk_dim_test_work);
+}
+
+static void blk_dim_replay(struct blk_dim_replay *r,
+			   const struct blk_dim_load *load, unsigned int nevents)
+{
+	while (nevents--) {
+		struct dim_cq_moder moder =
+			blk_dim_get_moderation(r->dim.profile_ix);
+		struct blk_dim_event ev;
+
+		blk_dim_model(load, &moder, &ev);
+		r->now_ns += ev.period_ns;
+		r->events++;
+		r->comps += ev.comps;
+		r->lat_us += ev.comps * ev.lat_us;
+
+		blk_dim_update_sample(r->events, r->comps, r->lat_us,
+				      &r->sample);
+		r->sample.time = ns_to_ktime(r->now_ns);
+		blk_dim(&r->dim, r->sample);
+
+		/* what a consumer's work does once the profile is applied */
+		if (r->dim.state == DIM_APPLY_NEW_PROFILE)
+			r->dim.state = DIM_START_MEASURE;
+	}
+	cancel_work_sync(&r->dim.work);
+}
+
+static void blk_dim_test_profiles(struct kunit *test)
+{
+	struct dim_cq_moder prev = blk_dim_get_moderation(0);
+	int ix;
+
+	KUNIT_EXPECT_EQ(test, prev.comps, 1);
+
+	for (ix = 1; ix < BLK_DIM_PARAMS_NUM_PROFILES; ix++) {
+		struct dim_cq_moder moder = blk_dim_get_moderation(ix);
+
+		KUNIT_EXPECT_GT(test, moder.comps, prev.comps);
+		/* there is no timer to program */
+		KUNIT_EXPECT_EQ(test, moder.usec, 0);
+		prev = moder;
+	}
+}
+
+static void blk_dim_test_calc_stats(struct kunit *test)
+{
+	struct dim_sample start = {}, end = {};
+	struct dim_stats stats = {};
+
+	blk_dim_update_sample(0, 0, 0, &start);
+	start.time = ns_to_ktime(0);
+	blk_dim_update_sample(DIM_NEVENTS, 1000, 30000, &end);
+	end.time = ns_to_ktime(2 * NSEC_PER_MSEC);
+	dim_calc_stats(&start, &end, &stats);
+
+	KUNIT_EXPECT_EQ(test, stats.cpms, 500);
+	KUNIT_EXPECT_EQ(test, stats.lat_avg, 30);
+
+	/* the counters wrap */
+	blk_dim_update_sample(U16_MAX - 10, U32_MAX - 99, U32_MAX - 999, &start);
+	start.time = ns_to_ktime(0);
+	blk_dim_update_sample(DIM_NEVENTS - 11, 100, 1000, &end);
+	end.time = ns_to_ktime(2 * NSEC_PER_MSEC);
+	dim_calc_stats(&start, &end, &stats);
+
+	KUNIT_EXPECT_EQ(test, stats.lat_avg, 10);
+}
+
+static void blk_dim_test_cpu_bound(struct kunit *test)
+{
+	struct blk_dim_replay *r;
+
+	r = kunit_kzalloc(test, sizeof(*r), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, r);
+	blk_dim_replay_init(r);
+
+	blk_dim_replay(r, &blk_dim_cpu_bound, 100 * DIM_NEVENTS);
+	KUNIT_EXPECT_GE(test, r->dim.profile_ix,
+			BLK_DIM_PARAMS_NUM_PROFILES - 2);
+}
+
+/* whichever profile is picked, a lone request is not held back */
+static void blk_dim_test_qd1(struct kunit *test)
+{
+	struct blk_dim_replay *r;
+
+	r = kunit_kzalloc(test, sizeof(*r), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, r);
+	blk_dim_replay_init(r);
+
+	blk_dim_replay(r, &blk_dim_qd1, 100 * DIM_NEVENTS);
+	KUNIT_EXPECT_EQ(test, r->comps, (u32)r->events);
+	KUNIT_EXPECT_EQ(test, r->lat_us, r->comps * 25);
+}
+
+static void blk_dim_test_shallow(struct kunit *test)
+{
+	struct blk_dim_replay *r;
+
+	r = kunit_kzalloc(test, sizeof(*r), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, r);
+	blk_dim_replay_init(r);
+
+	blk_dim_replay(r, &blk_dim_shallow, 100 * DIM_NEVENTS);
+	KUNIT_EXPECT_LE(test, r->dim.profile_ix, 1);
+}
+
+/* a load change moves the moderation back down */
+static void blk_dim_test_load_change(struct kunit *test)
+{
+	struct blk_dim_replay *r;
+
+	r = kunit_kzalloc(test, sizeof(*r), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, r);
+	blk_dim_replay_init(r);
+
+	blk_dim_replay(r, &blk_dim_cpu_bound, 100 * DIM_NEVENTS);
+	KUNIT_EXPECT_GT(test, r->dim.profile_ix, 1);
+
+	blk_dim_replay(r, &blk_dim_shallow, 200 * DIM_NEVENTS);
+	KUNIT_EXPECT_LE(test, r->dim.profile_ix, 1);
+}
+
+static struct kunit_case blk_dim_test_cases[] = {
+	KUNIT_CASE(blk_dim_test_profiles),
+	KUNIT_CASE(blk_dim_test_calc_stats),
+	KUNIT_CASE(blk_dim_test_cpu_bound),
+	KUNIT_CASE(blk_dim_test_qd1),
+	KUNIT_CASE(blk_dim_test_shallow),
+	KUNIT_CASE(blk_dim_test_load_change),
+	{}
+};
+
+static struct kunit_suite blk_dim_test_suite = {
+	.name = "blk_dim",
+	.test_cases = blk_dim_test_cases,
+};
+
+kunit_test_suites(&blk_dim_test_suite);
+
+MODULE_LICENSE("GPL v2");
@@ -64,6 +64,7 @@ void dim_calc_stats(struct dim_sample *start, struct dim_sample *end,
 			     start->byte_ctr);
 	u32 ncomps = BIT_GAP(BITS_PER_TYPE(u32), end->comp_ctr,
 			     start->comp_ctr);
+	u32 nlat = BIT_GAP(BITS_PER_TYPE(u32), end->lat_ctr, start->lat_ctr);
 
 	if (!delta_us)
 		return;
@@ -78,6 +79,6 @@ void dim_calc_stats(struct dim_sample *start, struct dim_sample *end,
 			curr_stats->cpms * 100, curr_stats->epms);
 	else
 		curr_stats->cpe_ratio = 0;
-
+	curr_stats->lat_avg = ncomps ? nlat / ncomps : 0;
 }
 EXPORT_SYMBOL(dim_calc_stats);
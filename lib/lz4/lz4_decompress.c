@@ -50,6 +50,131 @@
 #define assert(condition) ((void)0)
 #endif
 
+static const unsigned int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
+static const int dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+/*
+ * Copy a match that starts in the external dictionary, and may run on into
+ * the current block. The caller has checked that the output has room.
+ */
+static FORCE_INLINE BYTE *LZ4_copyExtDictMatch(BYTE *op, const BYTE *match,
+	size_t length, const BYTE *lowPrefix, const BYTE *dictEnd)
+{
+	if (length <= (size_t)(lowPrefix - match)) {
+		/*
+		 * match fits entirely within external
+		 * dictionary : just copy
+		 */
+		memmove(op, dictEnd - (lowPrefix - match), length);
+		op += length;
+	} else {
+		/*
+		 * match stretches into both external
+		 * dictionary and current block
+		 */
+		size_t const copySize = (size_t)(lowPrefix - match);
+		size_t const restSize = length - copySize;
+
+		LZ4_memcpy(op, dictEnd - copySize, copySize);
+		op += copySize;
+		if (restSize > (size_t)(op - lowPrefix)) {
+			/* overlap copy */
+			BYTE * const endOfMatch = op + restSize;
+			const BYTE *copyFrom = lowPrefix;
+
+			while (op < endOfMatch)
+				*op++ = *copyFrom++;
+		} else {
+			LZ4_memcpy(op, lowPrefix, restSize);
+			op += restSize;
+		}
+	}
+
+	return op;
+}
+
+#if LZ4_FAST_DEC_LOOP
+/*
+ * The fast loop needs this much room left in the output buffer: enough for
+ * the longest short-form sequence plus the 32 byte overshoot of
+ * LZ4_wildCopy32().
+ */
+#define FASTLOOP_SAFE_DISTANCE 64
+
+/*
+ * customized variant of memcpy, which can overwrite up to 32 bytes beyond
+ * dstEnd. It copies two times 16 bytes, so that it stays correct for
+ * overlapping copies with an offset of 16 or more.
+ */
+static FORCE_INLINE void LZ4_wildCopy32(void *dstPtr,
+	const void *srcPtr, void *dstEnd)
+{
+	BYTE *d = (BYTE *)dstPtr;
+	const BYTE *s = (const BYTE *)srcPtr;
+	BYTE *const e = (BYTE *)dstEnd;
+
+	do {
+		LZ4_memcpy(d, s, 16);
+		LZ4_memcpy(d + 16, s + 16, 16);
+		d += 32;
+		s += 32;
+	} while (d < e);
+}
+
+/*
+ * Copy an overlapping match with an offset below 16, which may write up to
+ * 8 bytes beyond dstEnd. Offsets 1, 2 and 4 are expanded into an 8 byte
+ * pattern once; the others are spread to an offset of at least 8 first, so
+ * that the rest can be copied 8 bytes at a time.
+ */
+static FORCE_INLINE void LZ4_memcpy_using_offset(BYTE *dstPtr,
+	const BYTE *srcPtr, BYTE *dstEnd, const size_t offset)
+{
+	BYTE v[8];
+
+	assert(dstEnd >= dstPtr + MINMATCH);
+
+	switch (offset) {
+	case 1:
+		memset(v, *srcPtr, 8);
+		break;
+	case 2:
+		LZ4_memcpy(v, srcPtr, 2);
+		LZ4_memcpy(&v[2], srcPtr, 2);
+		LZ4_memcpy(&v[4], v, 4);
+		break;
+	case 4:
+		LZ4_memcpy(v, srcPtr, 4);
+		LZ4_memcpy(&v[4], srcPtr, 4);
+		break;
+	default:
+		if (offset < 8) {
+			/* offset 0 must not expose what dst held before */
+			LZ4_write32(dstPtr, 0);
+			dstPtr[0] = srcPtr[0];
+			dstPtr[1] = srcPtr[1];
+			dstPtr[2] = srcPtr[2];
+			dstPtr[3] = srcPtr[3];
+			srcPtr += inc32table[offset];
+			LZ4_memcpy(dstPtr + 4, srcPtr, 4);
+			srcPtr -= dec64table[offset];
+		} else {
+			LZ4_copy8(dstPtr, srcPtr);
+			srcPtr += 8;
+		}
+		dstPtr += 8;
+		if (dstPtr < dstEnd)
+			LZ4_wildCopy(dstPtr, srcPtr, dstEnd);
+		return;
+	}
+
+	do {
+		LZ4_memcpy(dstPtr, v, 8);
+		dstPtr += 8;
+	} while (dstPtr < dstEnd);
+}
+#endif
+
 /*
  * LZ4_decompress_generic() :
  * This generic decompression function covers all use cases.
@@ -88,8 +213,11 @@ static FORCE_INLINE int LZ4_decompress_generic(
 	BYTE *cpy;
 
 	const BYTE * const dictEnd = (const BYTE *)dictStart + dictSize;
-	static const unsigned int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
-	static const int dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+	unsigned int token;
+	size_t length;
+	const BYTE *match;
+	size_t offset;
 
 	const int safeDecode = (endOnInput == endOnInputSize);
 	const int checkOffset = ((safeDecode) && (dictSize < (int)(64 * KB)));
@@ -117,14 +245,163 @@ static FORCE_INLINE int LZ4_decompress_generic(
 	if ((endOnInput) && unlikely(srcSize == 0))
 		return -1;
 
-	/* Main Loop : decode sequences */
+#if LZ4_FAST_DEC_LOOP
+	if (oend - op < FASTLOOP_SAFE_DISTANCE)
+		goto safe_decode;
+
+	/*
+	 * Fast loop : decode sequences as long as at least
+	 * FASTLOOP_SAFE_DISTANCE bytes of output remain, so that literals
+	 * and matches can be copied 16 or 32 bytes at a time without
+	 * checking for the end of the output buffer. Sequences that get
+	 * too close to either end are finished by the main loop below.
+	 */
 	while (1) {
-		size_t length;
-		const BYTE *match;
-		size_t offset;
+		assert(oend - op >= FASTLOOP_SAFE_DISTANCE);
+
+		token = *ip++;
+		length = token >> ML_BITS;
+
+		/* decode literal length */
+		if (length == RUN_MASK) {
+			unsigned int s;
+
+			if (unlikely(endOnInput ? ip >= iend - RUN_MASK : 0)) {
+				/* overflow detection */
+				goto _output_error;
+			}
+			do {
+				s = *ip++;
+				length += s;
+			} while (likely(endOnInput
+				? ip < iend - RUN_MASK
+				: 1) & (s == 255));
+
+			if ((safeDecode)
+			    && unlikely((uptrval)(op) +
+					length < (uptrval)(op))) {
+				/* overflow detection */
+				goto _output_error;
+			}
+			if ((safeDecode)
+			    && unlikely((uptrval)(ip) +
+					length < (uptrval)(ip))) {
+				/* overflow detection */
+				goto _output_error;
+			}
+
+			/* copy literals */
+			cpy = op + length;
+			if (endOnInput) {
+				if ((cpy > oend - 32) || (ip + length > iend - 32))
+					goto safe_literal_copy;
+				LZ4_wildCopy32(op, ip, cpy);
+			} else {
+				/*
+				 * Without the input size, only the
+				 * 8 byte overread of LZ4_wildCopy() is
+				 * known to stay within the block.
+				 */
+				if (cpy > oend - WILDCOPYLENGTH)
+					goto safe_literal_copy;
+				LZ4_wildCopy(op, ip, cpy);
+			}
+			ip += length;
+			op = cpy;
+		} else {
+			cpy = op + length;
+			if (endOnInput) {
+				/*
+				 * At most 14 literals, the output is known
+				 * to have room; the input has to hold the
+				 * 16 byte copy, an offset and a token.
+				 */
+				if (ip > iend - (16 + 1))
+					goto safe_literal_copy;
+				LZ4_memcpy(op, ip, 16);
+			} else {
+				LZ4_copy8(op, ip);
+				if (length > 8)
+					LZ4_copy8(op + 8, ip + 8);
+			}
+			ip += length;
+			op = cpy;
+		}
+
+		/* get offset */
+		offset = LZ4_readLE16(ip);
+		ip += 2;
+		match = op - offset;
+
+		/* get matchlength */
+		length = token & ML_MASK;
 
+		if (length == ML_MASK) {
+			unsigned int s;
+
+			do {
+				s = *ip++;
+
+				if ((endOnInput) && (ip > iend - LASTLITERALS))
+					goto _output_error;
+
+				length += s;
+			} while (s == 255);
+
+			if ((safeDecode)
+				&& unlikely(
+					(uptrval)(op) + length < (uptrval)op)) {
+				/* overflow detection */
+				goto _output_error;
+			}
+		}
+
+		length += MINMATCH;
+
+		if ((checkOffset) && (unlikely(match + dictSize < lowPrefix))) {
+			/* Error : offset outside buffers */
+			goto _output_error;
+		}
+
+		if (op + length >= oend - FASTLOOP_SAFE_DISTANCE)
+			goto safe_match_copy;
+
+		if (length <= ML_MASK - 1 + MINMATCH &&
+		    (dict == withPrefix64k || match >= lowPrefix) &&
+		    offset >= 8) {
+			/* Short match that cannot overlap an 8 byte copy. */
+			LZ4_memcpy(op + 0, match + 0, 8);
+			LZ4_memcpy(op + 8, match + 8, 8);
+			LZ4_memcpy(op + 16, match + 16, 2);
+			op += length;
+			continue;
+		}
+
+		/* match starting within external dictionary */
+		if ((dict == usingExtDict) && (match < lowPrefix)) {
+			op = LZ4_copyExtDictMatch(op, match, length,
+						  lowPrefix, dictEnd);
+			continue;
+		}
+
+		/* copy match within block */
+		cpy = op + length;
+
+		if (unlikely(offset < 16))
+			LZ4_memcpy_using_offset(op, match, cpy, offset);
+		else
+			LZ4_wildCopy32(op, match, cpy);
+
+		op = cpy; /* wildcopy correction */
+	}
+
+safe_decode:
+#endif
+
+	/* Main Loop : decode sequences */
+	while (1) {
 		/* get literal length */
-		unsigned int const token = *ip++;
+		token = *ip++;
 		length = token>>ML_BITS;
 
 		/* ip < iend before the increment */
@@ -219,6 +496,9 @@ static FORCE_INLINE int LZ4_decompress_generic(
 
 		/* copy literals */
 		cpy = op + length;
+#if LZ4_FAST_DEC_LOOP
+safe_literal_copy:
+#endif
 		LZ4_STATIC_ASSERT(MFLIMIT >= WILDCOPYLENGTH);
 
 		if (((endOnInput) && ((cpy > oend - MFLIMIT)
@@ -299,18 +579,6 @@ static FORCE_INLINE int LZ4_decompress_generic(
 			goto _output_error;
 		}
 
-		/* costs ~1%; silence an msan warning when offset == 0 */
-		/*
-		 * note : when partialDecoding, there is no guarantee that
-		 * at least 4 bytes remain available in output buffer
-		 */
-		if (!partialDecoding) {
-			assert(oend > op);
-			assert(oend - op >= 4);
-
-			LZ4_write32(op, (U32)offset);
-		}
-
 		if (length == ML_MASK) {
 			unsigned int s;
 
@@ -333,6 +601,21 @@ static FORCE_INLINE int LZ4_decompress_generic(
 
 		length += MINMATCH;
 
+#if LZ4_FAST_DEC_LOOP
+safe_match_copy:
+#endif
+		/* costs ~1%; silence an msan warning when offset == 0 */
+		/*
+		 * note : when partialDecoding, there is no guarantee that
+		 * at least 4 bytes remain available in output buffer
+		 */
+		if (!partialDecoding) {
+			assert(oend > op);
+			assert(oend - op >= 4);
+
+			LZ4_write32(op, (U32)offset);
+		}
+
 		/* match starting within external dictionary */
 		if ((dict == usingExtDict) && (match < lowPrefix)) {
 			if (unlikely(op + length > oend - LASTLITERALS)) {
@@ -342,36 +625,8 @@ static FORCE_INLINE int LZ4_decompress_generic(
 				length = min(length, (size_t)(oend - op));
 			}
 
-			if (length <= (size_t)(lowPrefix - match)) {
-				/*
-				 * match fits entirely within external
-				 * dictionary : just copy
-				 */
-				memmove(op, dictEnd - (lowPrefix - match),
-					length);
-				op += length;
-			} else {
-				/*
-				 * match stretches into both external
-				 * dictionary and current block
-				 */
-				size_t const copySize = (size_t)(lowPrefix - match);
-				size_t const restSize = length - copySize;
-
-				LZ4_memcpy(op, dictEnd - copySize, copySize);
-				op += copySize;
-				if (restSize > (size_t)(op - lowPrefix)) {
-					/* overlap copy */
-					BYTE * const endOfMatch = op + restSize;
-					const BYTE *copyFrom = lowPrefix;
-
-					while (op < endOfMatch)
-						*op++ = *copyFrom++;
-				} else {
-					LZ4_memcpy(op, lowPrefix, restSize);
-					op += restSize;
-				}
-			}
+			op = LZ4_copyExtDictMatch(op, match, length,
+						  lowPrefix, dictEnd);
 			continue;
 		}
 
@@ -475,6 +730,23 @@ int LZ4_decompress_safe_partial(const char *src, char *dst,
 				      noDict, (BYTE *)dst, NULL, 0);
 }
 
+int LZ4_decompress_safe_page(const char *source, char *dest,
+	int compressedSize)
+{
+	/*
+	 * A separate instantiation, so that the output bounds the fast loop
+	 * checks against are compile-time constants.
+	 */
+	int ret = LZ4_decompress_generic(source, dest,
+					 compressedSize, PAGE_SIZE,
+					 endOnInputSize, decode_full_block,
+					 noDict, (BYTE *)dest, NULL, 0);
+
+	if (ret >= 0 && ret != PAGE_SIZE)
+		return -1;
+	return ret;
+}
+
 int LZ4_decompress_fast(const char *source, char *dest, int originalSize)
 {
 	return LZ4_decompress_generic(source, dest, 0, originalSize,
@@ -708,6 +980,7 @@ int LZ4_decompress_fast_usingDict(const char *source, char *dest,
 #ifndef STATIC
 EXPORT_SYMBOL(LZ4_decompress_safe);
 EXPORT_SYMBOL(LZ4_decompress_safe_partial);
+EXPORT_SYMBOL(LZ4_decompress_safe_page);
 EXPORT_SYMBOL(LZ4_decompress_fast);
 EXPORT_SYMBOL(LZ4_setStreamDecode);
 EXPORT_SYMBOL(LZ4_decompress_safe_continue);
@@ -67,6 +67,18 @@ typedef uintptr_t uptrval;
 #define LZ4_LITTLE_ENDIAN 0
 #endif
 
+/*
+ * The fast decoding loop trades bounds checks for wide, unaligned and
+ * overlapping copies, which only pays off where those are cheap. It is
+ * opt-in until it has been measured on the cores it is meant for.
+ */
+#if LZ4_ARCH64 && defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && \
+	defined(CONFIG_LZ4_FAST_DEC_LOOP)
+#define LZ4_FAST_DEC_LOOP 1
+#else
+#define LZ4_FAST_DEC_LOOP 0
+#endif
+
 /*-************************************
  *	Constants
  **************************************/
@@ -18,6 +18,9 @@
 #else
 #include <linux/module.h>
 #include <linux/gfp.h>
+#include <linux/percpu.h>
+#include <linux/sched/topology.h>
+#include <linux/workqueue.h>
 #if !RAID6_USE_EMPTY_ZERO_PAGE
 /* In .bss so it's zeroed */
 const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
@@ -142,8 +145,9 @@ static inline const struct raid6_recov_calls *raid6_choose_recov(void)
 	return best;
 }
 
-static inline const struct raid6_calls *raid6_choose_gen(
-	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks)
+static const struct raid6_calls * __init raid6_bench_gen(
+	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks,
+	unsigned long *genperf, unsigned long *xorperf)
 {
 	unsigned long perf, bestgenperf, bestxorperf, j0, j1;
 	int start = (disks>>1)-1, stop = disks-3;	/* work on the second half of the disks */
@@ -207,6 +211,120 @@ static inline const struct raid6_calls *raid6_choose_gen(
 		}
 	}
 
+	*genperf = bestgenperf;
+	*xorperf = bestxorperf;
+	return best;
+}
+
+#if defined(__KERNEL__) && defined(CONFIG_SMP)
+/*
+ * On systems whose CPUs differ in capacity (big.LITTLE), the routine that
+ * wins on the CPU running the benchmark is not necessarily the best one on
+ * the other kind of core: wider unrolls pay off on out-of-order cores but
+ * can lose on in-order ones. Benchmark once on a CPU of each capacity, and
+ * if the winners differ, dispatch on the CPU a call happens to run on.
+ */
+#define RAID6_MAX_CPU_CLASSES	4
+
+static DEFINE_PER_CPU_READ_MOSTLY(const struct raid6_calls *, raid6_cpu_calls);
+
+static void raid6_gen_syndrome_percpu(int disks, size_t bytes, void **ptrs)
+{
+	this_cpu_read(raid6_cpu_calls)->gen_syndrome(disks, bytes, ptrs);
+}
+
+static void raid6_xor_syndrome_percpu(int disks, int start, int stop,
+				      size_t bytes, void **ptrs)
+{
+	this_cpu_read(raid6_cpu_calls)->xor_syndrome(disks, start, stop,
+						     bytes, ptrs);
+}
+
+struct raid6_bench_work {
+	void *(*dptrs)[RAID6_TEST_DISKS];
+	int disks;
+	const struct raid6_calls *best;
+};
+
+static long __init raid6_bench_gen_work(void *data)
+{
+	struct raid6_bench_work *w = data;
+	unsigned long genperf, xorperf;
+
+	w->best = raid6_bench_gen(w->dptrs, w->disks, &genperf, &xorperf);
+	return 0;
+}
+
+static void __init raid6_choose_gen_per_class(
+	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks,
+	const struct raid6_calls *boot_best, int boot_cpu)
+{
+	unsigned long cap[RAID6_MAX_CPU_CLASSES];
+	const struct raid6_calls *best[RAID6_MAX_CPU_CLASSES];
+	bool mixed = false, have_xor = boot_best->xor_syndrome;
+	int nr = 1, i, cpu;
+
+	cap[0] = arch_scale_cpu_capacity(boot_cpu);
+	best[0] = boot_best;
+
+	for_each_online_cpu(cpu) {
+		struct raid6_bench_work w = { .dptrs = dptrs, .disks = disks };
+		unsigned long c = arch_scale_cpu_capacity(cpu);
+
+		for (i = 0; i < nr; i++)
+			if (cap[i] == c)
+				break;
+		if (i < nr || nr == RAID6_MAX_CPU_CLASSES)
+			continue;
+
+		pr_info("raid6: benchmarking on CPU%d (capacity %lu)\n",
+			cpu, c);
+		work_on_cpu_safe(cpu, raid6_bench_gen_work, &w);
+		if (!w.best)
+			continue;
+
+		cap[nr] = c;
+		best[nr] = w.best;
+		mixed |= w.best != boot_best;
+		have_xor &= !!w.best->xor_syndrome;
+		nr++;
+	}
+
+	if (!mixed)
+		return;
+
+	/* CPUs of a capacity that was not benchmarked use the boot choice */
+	for_each_possible_cpu(cpu) {
+		unsigned long c = arch_scale_cpu_capacity(cpu);
+
+		per_cpu(raid6_cpu_calls, cpu) = boot_best;
+		for (i = 0; i < nr; i++)
+			if (cap[i] == c)
+				per_cpu(raid6_cpu_calls, cpu) = best[i];
+	}
+
+	for (i = 0; i < nr; i++)
+		pr_info("raid6: using algorithm %s on CPUs of capacity %lu\n",
+			best[i]->name, cap[i]);
+	if (!have_xor && boot_best->xor_syndrome)
+		pr_info("raid6: xor() not available on all CPUs, rmw disabled\n");
+
+	raid6_call.gen_syndrome = raid6_gen_syndrome_percpu;
+	raid6_call.xor_syndrome = have_xor ? raid6_xor_syndrome_percpu : NULL;
+}
+#endif
+
+static inline const struct raid6_calls *raid6_choose_gen(
+	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks)
+{
+	unsigned long bestgenperf, bestxorperf;
+	const struct raid6_calls *best;
+#if defined(__KERNEL__) && defined(CONFIG_SMP)
+	int boot_cpu = raw_smp_processor_id();
+#endif
+
+	best = raid6_bench_gen(dptrs, disks, &bestgenperf, &bestxorperf);
+
 	if (best) {
 		if (IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK)) {
 			pr_info("raid6: using algorithm %s gen() %ld MB/s\n",
@@ -221,6 +339,10 @@ static inline const struct raid6_calls *raid6_choose_gen(
 			pr_info("raid6: skip pq benchmark and using algorithm %s\n",
 				best->name);
 		raid6_call = *best;
+#if defined(__KERNEL__) && defined(CONFIG_SMP)
+		if (IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK))
+			raid6_choose_gen_per_class(dptrs, disks, best, boot_cpu);
+#endif
 	} else
 		pr_err("raid6: Yikes!  No algorithm found!\n");
 
@@ -228,6 +350,53 @@ static inline const struct raid6_calls *raid6_choose_gen(
 }
 
 
+#ifndef __KERNEL__
+/*
+ * Report the throughput of every usable recovery routine, so that the
+ * test harness covers all variants. The kernel does not spend boot time
+ * on this: recovery routines are chosen by priority.
+ */
+static void raid6_bench_recov(void *(*const dptrs)[RAID6_TEST_DISKS],
+			      const int disks)
+{
+	const struct raid6_recov_calls *const *algo;
+	unsigned long perf, j0, j1;
+
+	raid6_call.gen_syndrome(disks, PAGE_SIZE, *dptrs);
+
+	for (algo = raid6_recov_algos; *algo; algo++) {
+		if ((*algo)->valid && !(*algo)->valid())
+			continue;
+
+		perf = 0;
+		j0 = jiffies;
+		while ((j1 = jiffies) == j0)
+			cpu_relax();
+		while (time_before(jiffies,
+				    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+			(*algo)->data2(disks, PAGE_SIZE, 0, 1, *dptrs);
+			perf++;
+		}
+		pr_info("raid6: %-8s 2data() %5ld MB/s\n", (*algo)->name,
+			(perf * HZ * (disks-2)) >>
+			(20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2));
+
+		perf = 0;
+		j0 = jiffies;
+		while ((j1 = jiffies) == j0)
+			cpu_relax();
+		while (time_before(jiffies,
+				    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+			(*algo)->datap(disks, PAGE_SIZE, 0, *dptrs);
+			perf++;
+		}
+		pr_info("raid6: %-8s datap() %5ld MB/s\n", (*algo)->name,
+			(perf * HZ * (disks-2)) >>
+			(20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2));
+	}
+}
+#endif
+
 /* Try to pick the best algorithm */
 /* This code uses the gfmul table as convenient data set to abuse */
 
@@ -267,6 +436,11 @@ int __init raid6_select_algo(void)
 	/* select raid recover functions */
 	rec_best = raid6_choose_recov();
 
+#ifndef __KERNEL__
+	if (gen_best)
+		raid6_bench_recov(&dptrs, disks);
+#endif
+
 	free_pages((unsigned long)disk_ptr, RAID6_TEST_DISKS_ORDER);
 
 	return gen_best && rec_best ? 0 : -EINVAL;
@@ -53,6 +53,11 @@ static inline unative_t PMUL(unative_t v, unative_t u)
 	return (unative_t)vmulq_p8((poly8x16_t)v, (poly8x16_t)u);
 }
 
+#ifndef CONFIG_ARM
+extern const uint8_t raid6_vgfmul[256][32];
+extern const uint8_t raid6_gfexp[256];
+#endif
+
 void raid6_neon$#_gen_syndrome_real(int disks, unsigned long bytes, void **ptrs)
 {
 	uint8_t **dptr = (uint8_t **)ptrs;
@@ -92,6 +97,11 @@ void raid6_neon$#_xor_syndrome_real(int disks, int start, int stop,
 
 	register unative_t wd$$, wq$$, wp$$, w1$$, w2$$;
 	const unative_t x1d = vdupq_n_u8(0x1d);
+#ifndef CONFIG_ARM
+	const unative_t x0f = vdupq_n_u8(0x0f);
+	const unative_t qm0 = vld1q_u8(raid6_vgfmul[raid6_gfexp[start]]);
+	const unative_t qm1 = vld1q_u8(raid6_vgfmul[raid6_gfexp[start]] + 16);
+#endif
 
 	z0 = stop;		/* P/Q right side optimization */
 	p = dptr[disks-2];	/* XOR parity */
@@ -112,6 +122,18 @@ void raid6_neon$#_xor_syndrome_real(int disks, int start, int stop,
 			w1$$ = veorq_u8(w1$$, w2$$);
 			wq$$ = veorq_u8(w1$$, wd$$);
 		}
+#ifndef CONFIG_ARM
+		/*
+		 * P/Q left side optimization: the untouched disks below
+		 * start only multiply Q by 2 each, so multiply it by
+		 * 2^start at once, with a nibble table lookup each way.
+		 */
+		if (start) {
+			w1$$ = vqtbl1q_u8(qm0, vandq_u8(wq$$, x0f));
+			w2$$ = vqtbl1q_u8(qm1, vshrq_n_u8(wq$$, 4));
+			wq$$ = veorq_u8(w1$$, w2$$);
+		}
+#else
 		/* P/Q left side optimization */
 		for ( z = start-1 ; z >= 3 ; z -= 4 ) {
 			w2$$ = vshrq_n_u8(wq$$, 4);
@@ -143,6 +165,7 @@ void raid6_neon$#_xor_syndrome_real(int disks, int start, int stop,
 			w2$$ = vandq_u8(w2$$, x1d);
 			wq$$ = veorq_u8(w1$$, w2$$);
 		}
+#endif
 		w1$$ = vld1q_u8(&q[d+NSIZE*$$]);
 		wq$$ = veorq_u8(wq$$, w1$$);
 
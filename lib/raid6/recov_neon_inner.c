@@ -24,6 +24,17 @@ static uint8x16_t vqtbl1q_u8(uint8x16_t a, uint8x16_t b)
 }
 #endif
 
+/*
+ * Multiply each byte of v by a constant, given as the products of the
+ * constant with the low (m0) and high (m1) nibble values.
+ */
+static inline uint8x16_t raid6_gfmul_neon(uint8x16_t v, uint8x16_t m0,
+					  uint8x16_t m1, uint8x16_t x0f)
+{
+	return veorq_u8(vqtbl1q_u8(m0, vandq_u8(v, x0f)),
+			vqtbl1q_u8(m1, vshrq_n_u8(v, 4)));
+}
+
 void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
 			      uint8_t *dq, const uint8_t *pbmul,
 			      const uint8_t *qmul)
@@ -44,8 +55,36 @@ void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
 	 *	*dp++ = db ^ px;
 	 *	p++; q++;
 	 * }
+	 *
+	 * Two independent 16 byte blocks per iteration keep the table
+	 * lookups of one block in flight while the other one is combined,
+	 * which matters most on in-order cores.
 	 */
 
+	for (; bytes >= 32; bytes -= 32) {
+		uint8x16_t px0, px1, qx0, qx1, db0, db1;
+
+		px0 = veorq_u8(vld1q_u8(p), vld1q_u8(dp));
+		px1 = veorq_u8(vld1q_u8(p + 16), vld1q_u8(dp + 16));
+		qx0 = veorq_u8(vld1q_u8(q), vld1q_u8(dq));
+		qx1 = veorq_u8(vld1q_u8(q + 16), vld1q_u8(dq + 16));
+
+		qx0 = raid6_gfmul_neon(qx0, qm0, qm1, x0f);
+		qx1 = raid6_gfmul_neon(qx1, qm0, qm1, x0f);
+		db0 = veorq_u8(raid6_gfmul_neon(px0, pm0, pm1, x0f), qx0);
+		db1 = veorq_u8(raid6_gfmul_neon(px1, pm0, pm1, x0f), qx1);
+
+		vst1q_u8(dq, db0);
+		vst1q_u8(dq + 16, db1);
+		vst1q_u8(dp, veorq_u8(db0, px0));
+		vst1q_u8(dp + 16, veorq_u8(db1, px1));
+
+		p += 32;
+		q += 32;
+		dp += 32;
+		dq += 32;
+	}
+
 	while (bytes) {
 		uint8x16_t vx, vy, px, qx, db;
 
@@ -88,6 +127,25 @@ void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
 	 * }
 	 */
 
+	for (; bytes >= 32; bytes -= 32) {
+		uint8x16_t vx0, vx1;
+
+		vx0 = veorq_u8(vld1q_u8(q), vld1q_u8(dq));
+		vx1 = veorq_u8(vld1q_u8(q + 16), vld1q_u8(dq + 16));
+
+		vx0 = raid6_gfmul_neon(vx0, qm0, qm1, x0f);
+		vx1 = raid6_gfmul_neon(vx1, qm0, qm1, x0f);
+
+		vst1q_u8(dq, vx0);
+		vst1q_u8(dq + 16, vx1);
+		vst1q_u8(p, veorq_u8(vx0, vld1q_u8(p)));
+		vst1q_u8(p + 16, veorq_u8(vx1, vld1q_u8(p + 16)));
+
+		p += 32;
+		q += 32;
+		dq += 32;
+	}
+
 	while (bytes) {
 		uint8x16_t vx, vy;
 
@@ -0,0 +1,508 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Test and throughput benchmark for the page compressors used by zram
+ * and zswap: 842, LZ4 and zstd.
+ *
+ * Page sized blocks are taken from the kernel's own text and read-only
+ * data, and from a few synthetic patterns, and compressed one page at a
+ * time. Every block is compressed and decompressed with each backend and
+ * checked against the original; the compression ratio and the throughput
+ * of both directions are reported. The LZ4 decoders themselves are
+ * covered by test_lz4.
+ *
+ * "zstd-attach" and "zstd-copy" compress with a digested dictionary and
+ * decompress with the matching ZSTD_DDict. The first is built at a fast
+ * level, so its CDict is attached to the context and searched in place; the
+ * second at a lazy level, so its tables are copied. The dictionary carries
+ * repcodes other than the defaults, which both paths must hand on to the
+ * frame for the decoder to agree with them.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/module.h>
+#include <linux/prandom.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sw842.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+#include <asm/sections.h>
+#include <asm/unaligned.h>
+
+static unsigned int nr_pages = 256;
+module_param(nr_pages, uint, 0444);
+MODULE_PARM_DESC(nr_pages, "Pages per data set (default: 256)");
+
+static unsigned int iters = 16;
+module_param(iters, uint, 0444);
+MODULE_PARM_DESC(iters, "Passes over each data set (default: 16)");
+
+static int zstd_level = 1;
+module_param(zstd_level, int, 0444);
+MODULE_PARM_DESC(zstd_level, "zstd compression level (default: 1)");
+
+/* 842 adds a 5 bit template to every 8 bytes of incompressible data */
+#define TEST_COMPRESS_CBOUND	(2 * PAGE_SIZE)
+
+/*
+ * The dictionary is small enough that a page and the dictionary fit in the
+ * window of the <= 16 KB parameter table, where levels 1-3 attach a CDict
+ * and level 4 copies it.
+ */
+#define TEST_COMPRESS_DICT_CONTENT	(8 * 1024)
+#define TEST_COMPRESS_ATTACH_LEVEL	1
+#define TEST_COMPRESS_COPY_LEVEL	4
+
+/*
+ * Magic number, dictionary ID and entropy tables of a zstd dictionary
+ * trained on executable code: every literal has a Huffman code and every
+ * offset code up to 17 has a non-zero probability, so any content up to
+ * 16 KB may follow. The repcodes and the content are appended at load time.
+ */
+static const u8 test_compress_dict_tables[] = {
+	0x37, 0xa4, 0x30, 0xec, 0x5d, 0xc1, 0x1b, 0x26, 0x4b, 0x10, 0x40, 0x2c,
+	0xa9, 0x03, 0xff, 0xbb, 0x45, 0xa1, 0xe2, 0xcf, 0x0f, 0xc7, 0x11, 0xdf,
+	0x61, 0xf5, 0xc7, 0x8f, 0x99, 0x8f, 0x44, 0x7c, 0x87, 0xb8, 0x5d, 0x7e,
+	0x19, 0x43, 0xca, 0x07, 0x5e, 0x4f, 0x1a, 0x7b, 0x5d, 0xdc, 0xac, 0x62,
+	0x70, 0x28, 0x18, 0xbd, 0xbb, 0x38, 0xe7, 0xc8, 0x02, 0x70, 0x49, 0x0d,
+	0x36, 0xaa, 0x16, 0x9d, 0x23, 0x56, 0x7e, 0x91, 0x98, 0xf6, 0x68, 0x1e,
+	0xd7, 0x37, 0xdb, 0x48, 0x88, 0x84, 0x21, 0x1f, 0x9b, 0x27, 0x3b, 0x05,
+	0xe3, 0x03, 0x00, 0x14, 0x14, 0x8c, 0x08, 0x05, 0xb3, 0xe9, 0xb2, 0xbb,
+	0x00, 0x04, 0x00, 0x96, 0xd5, 0x4e, 0x2a, 0x74, 0x71, 0x9c, 0xc3, 0x48,
+	0x96, 0x31, 0x84, 0x00, 0x62, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe4, 0x25, 0xcc, 0x94,
+	0xcb, 0x27, 0x43, 0x81, 0x38, 0xd0, 0x82, 0x1c, 0x86, 0x29, 0xc8, 0x14,
+	0x62, 0x88, 0x44, 0x00, 0x00, 0x00, 0x00,
+};
+
+/* not the 1, 4, 8 a frame without a dictionary starts from */
+static const u32 test_compress_dict_reps[] = { 3, 12, 64 };
+
+#define TEST_COMPRESS_DICT_SIZE	(sizeof(test_compress_dict_tables) + \
+				 sizeof(test_compress_dict_reps) + \
+				 TEST_COMPRESS_DICT_CONTENT)
+
+struct test_compress_ctx {
+	void *sw842_wmem;
+	void *lz4_wrkmem;
+	ZSTD_parameters zstd_params;
+	ZSTD_CCtx *zstd_cctx;
+	ZSTD_DCtx *zstd_dctx;
+	void *zstd_cwork;
+	void *zstd_dwork;
+	u8 *zstd_dict;
+	ZSTD_CDict *zstd_cdict_attach;
+	ZSTD_CDict *zstd_cdict_copy;
+	ZSTD_DDict *zstd_ddict;
+	void *zstd_cdict_attach_work;
+	void *zstd_cdict_copy_work;
+	void *zstd_ddict_work;
+};
+
+static int sw842_test_compress(struct test_compress_ctx *ctx, const u8 *src,
+			       u8 *dst, unsigned int *dlen)
+{
+	return sw842_compress(src, PAGE_SIZE, dst, dlen, ctx->sw842_wmem);
+}
+
+static int sw842_test_decompress(struct test_compress_ctx *ctx, const u8 *src,
+				 unsigned int slen, u8 *dst)
+{
+	unsigned int dlen = PAGE_SIZE;
+	int ret;
+
+	ret = sw842_decompress(src, slen, dst, &dlen);
+	if (ret)
+		return ret;
+	return dlen == PAGE_SIZE ? 0 : -EINVAL;
+}
+
+static int lz4_test_compress(struct test_compress_ctx *ctx, const u8 *src,
+			     u8 *dst, unsigned int *dlen)
+{
+	int ret;
+
+	ret = LZ4_compress_default(src, dst, PAGE_SIZE, *dlen, ctx->lz4_wrkmem);
+	if (ret <= 0)
+		return -EINVAL;
+	*dlen = ret;
+	return 0;
+}
+
+static int lz4_test_decompress(struct test_compress_ctx *ctx, const u8 *src,
+			       unsigned int slen, u8 *dst)
+{
+	return LZ4_decompress_safe(src, dst, slen, PAGE_SIZE) == PAGE_SIZE ?
+		0 : -EINVAL;
+}
+
+static int zstd_test_compress(struct test_compress_ctx *ctx, const u8 *src,
+			      u8 *dst, unsigned int *dlen)
+{
+	size_t ret;
+
+	ret = ZSTD_compressCCtx(ctx->zstd_cctx, dst, *dlen, src, PAGE_SIZE,
+				ctx->zstd_params);
+	if (ZSTD_isError(ret))
+		return -EINVAL;
+	*dlen = ret;
+	return 0;
+}
+
+static int zstd_test_decompress(struct test_compress_ctx *ctx, const u8 *src,
+				unsigned int slen, u8 *dst)
+{
+	size_t ret;
+
+	ret = ZSTD_decompressDCtx(ctx->zstd_dctx, dst, PAGE_SIZE, src, slen);
+	return !ZSTD_isError(ret) && ret == PAGE_SIZE ? 0 : -EINVAL;
+}
+
+static int zstd_test_compress_cdict(const ZSTD_CDict *cdict,
+				    struct test_compress_ctx *ctx,
+				    const u8 *src, u8 *dst, unsigned int *dlen)
+{
+	size_t ret;
+
+	ret = ZSTD_compress_usingCDict(ctx->zstd_cctx, dst, *dlen, src,
+				       PAGE_SIZE, cdict);
+	if (ZSTD_isError(ret))
+		return -EINVAL;
+	*dlen = ret;
+	return 0;
+}
+
+static int zstd_test_compress_attach(struct test_compress_ctx *ctx,
+				     const u8 *src, u8 *dst, unsigned int *dlen)
+{
+	return zstd_test_compress_cdict(ctx->zstd_cdict_attach, ctx, src, dst,
+					dlen);
+}
+
+static int zstd_test_compress_copy(struct test_compress_ctx *ctx,
+				   const u8 *src, u8 *dst, unsigned int *dlen)
+{
+	return zstd_test_compress_cdict(ctx->zstd_cdict_copy, ctx, src, dst,
+					dlen);
+}
+
+static int zstd_test_decompress_ddict(struct test_compress_ctx *ctx,
+				      const u8 *src, unsigned int slen, u8 *dst)
+{
+	size_t ret;
+
+	ret = ZSTD_decompress_usingDDict(ctx->zstd_dctx, dst, PAGE_SIZE, src,
+					 slen, ctx->zstd_ddict);
+	return !ZSTD_isError(ret) && ret == PAGE_SIZE ? 0 : -EINVAL;
+}
+
+static const struct {
+	const char *name;
+	int (*compress)(struct test_compress_ctx *ctx, const u8 *src,
+			u8 *dst, unsigned int *dlen);
+	int (*decompress)(struct test_compress_ctx *ctx, const u8 *src,
+			  unsigned int slen, u8 *dst);
+} test_compress_algs[] = {
+	{ "842", sw842_test_compress, sw842_test_decompress },
+	{ "lz4", lz4_test_compress, lz4_test_decompress },
+	{ "zstd", zstd_test_compress, zstd_test_decompress },
+	{ "zstd-attach", zstd_test_compress_attach, zstd_test_decompress_ddict },
+	{ "zstd-copy", zstd_test_compress_copy, zstd_test_decompress_ddict },
+};
+
+static void fill_section(void *page, unsigned int idx,
+			 const char *start, const char *end)
+{
+	unsigned long nr = (end - start) / PAGE_SIZE;
+
+	memcpy(page, start + (idx % nr) * PAGE_SIZE, PAGE_SIZE);
+}
+
+static void fill_text(void *page, unsigned int idx)
+{
+	fill_section(page, idx, _stext, _etext);
+}
+
+static void fill_rodata(void *page, unsigned int idx)
+{
+	fill_section(page, idx, __start_rodata, __end_rodata);
+}
+
+/* Mostly zero, with a few words set: sparse anonymous memory. */
+static void fill_sparse(void *page, unsigned int idx)
+{
+	u32 *p = page;
+	int i;
+
+	memset(page, 0, PAGE_SIZE);
+	for (i = 0; i < 16; i++)
+		p[prandom_u32_max(PAGE_SIZE / sizeof(u32))] = prandom_u32();
+}
+
+/* Short repeating patterns: overlapping matches with small offsets. */
+static void fill_pattern(void *page, unsigned int idx)
+{
+	u8 *p = page;
+	unsigned int i, period = 1 + idx % 15;
+
+	prandom_bytes(p, period);
+	for (i = period; i < PAGE_SIZE; i++)
+		p[i] = p[i - period];
+}
+
+/* A table of small integers: repeated 2 and 4 byte values. */
+static void fill_table(void *page, unsigned int idx)
+{
+	u32 *p = page;
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(u32); i++)
+		p[i] = prandom_u32_max(64) << (8 * (i & 3));
+}
+
+static void fill_random(void *page, unsigned int idx)
+{
+	prandom_bytes(page, PAGE_SIZE);
+}
+
+static const struct {
+	const char *name;
+	void (*fill)(void *page, unsigned int idx);
+} test_compress_sets[] = {
+	{ "text", fill_text },
+	{ "rodata", fill_rodata },
+	{ "sparse", fill_sparse },
+	{ "pattern", fill_pattern },
+	{ "table", fill_table },
+	{ "random", fill_random },
+};
+
+static u64 test_compress_rate(u64 t0, u64 t1)
+{
+	/* bytes/ns * 1000 == MB/s */
+	return div64_u64((u64)iters * nr_pages * PAGE_SIZE * 1000,
+			 max_t(u64, t1 - t0, 1));
+}
+
+static int __init test_compress_alg(struct test_compress_ctx *ctx,
+				    unsigned int set, unsigned int alg,
+				    char *data, char *cdata,
+				    unsigned int *clen, char *out)
+{
+	u64 t0, t1, crate, drate;
+	size_t total = 0;
+	unsigned int i, n;
+	int ret;
+
+	for (i = 0; i < nr_pages; i++) {
+		char *page = data + (size_t)i * PAGE_SIZE;
+		char *cpage = cdata + (size_t)i * TEST_COMPRESS_CBOUND;
+
+		clen[i] = TEST_COMPRESS_CBOUND;
+		ret = test_compress_algs[alg].compress(ctx, page, cpage,
+						       &clen[i]);
+		if (ret) {
+			pr_err("%s: %s failed to compress page %u (%d)\n",
+			       test_compress_sets[set].name,
+			       test_compress_algs[alg].name, i, ret);
+			return ret;
+		}
+		total += clen[i];
+
+		memset(out, 0xa5, PAGE_SIZE);
+		ret = test_compress_algs[alg].decompress(ctx, cpage, clen[i],
+							 out);
+		if (ret || memcmp(out, page, PAGE_SIZE)) {
+			pr_err("%s: %s failed to decompress page %u (%d)\n",
+			       test_compress_sets[set].name,
+			       test_compress_algs[alg].name, i, ret);
+			return -EINVAL;
+		}
+	}
+
+	t0 = ktime_get_ns();
+	for (n = 0; n < iters; n++) {
+		for (i = 0; i < nr_pages; i++) {
+			unsigned int len = TEST_COMPRESS_CBOUND;
+
+			test_compress_algs[alg].compress(ctx,
+					data + (size_t)i * PAGE_SIZE,
+					cdata + (size_t)i * TEST_COMPRESS_CBOUND,
+					&len);
+		}
+		cond_resched();
+	}
+	t1 = ktime_get_ns();
+	crate = test_compress_rate(t0, t1);
+
+	t0 = ktime_get_ns();
+	for (n = 0; n < iters; n++) {
+		for (i = 0; i < nr_pages; i++)
+			test_compress_algs[alg].decompress(ctx,
+					cdata + (size_t)i * TEST_COMPRESS_CBOUND,
+					clen[i], out);
+		cond_resched();
+	}
+	t1 = ktime_get_ns();
+	drate = test_compress_rate(t0, t1);
+
+	pr_info("%-8s %-8s %3llu%% of original: compress %llu MB/s, decompress %llu MB/s\n",
+		test_compress_sets[set].name, test_compress_algs[alg].name,
+		div64_u64((u64)total * 100, (u64)nr_pages * PAGE_SIZE),
+		crate, drate);
+
+	return 0;
+}
+
+static ZSTD_CDict * __init test_compress_init_cdict(struct test_compress_ctx *ctx,
+						    ZSTD_parameters params,
+						    void **work)
+{
+	size_t size = ZSTD_CDictWorkspaceBound(params.cParams);
+
+	*work = vmalloc(size);
+	if (!*work)
+		return NULL;
+	return ZSTD_initCDict(ctx->zstd_dict, TEST_COMPRESS_DICT_SIZE, params,
+			      *work, size);
+}
+
+static int __init test_compress_init_zstd_dict(struct test_compress_ctx *ctx,
+					       ZSTD_parameters attach,
+					       ZSTD_parameters copy)
+{
+	u8 *p;
+	int i;
+
+	ctx->zstd_dict = vmalloc(TEST_COMPRESS_DICT_SIZE);
+	if (!ctx->zstd_dict)
+		return -ENOMEM;
+
+	p = ctx->zstd_dict;
+	memcpy(p, test_compress_dict_tables, sizeof(test_compress_dict_tables));
+	p += sizeof(test_compress_dict_tables);
+	for (i = 0; i < ARRAY_SIZE(test_compress_dict_reps); i++, p += 4)
+		put_unaligned_le32(test_compress_dict_reps[i], p);
+	memcpy(p, __start_rodata, TEST_COMPRESS_DICT_CONTENT);
+
+	ctx->zstd_cdict_attach = test_compress_init_cdict(ctx, attach,
+						&ctx->zstd_cdict_attach_work);
+	ctx->zstd_cdict_copy = test_compress_init_cdict(ctx, copy,
+						&ctx->zstd_cdict_copy_work);
+	ctx->zstd_ddict_work = vmalloc(ZSTD_DDictWorkspaceBound());
+	if (ctx->zstd_ddict_work)
+		ctx->zstd_ddict = ZSTD_initDDict(ctx->zstd_dict,
+						 TEST_COMPRESS_DICT_SIZE,
+						 ctx->zstd_ddict_work,
+						 ZSTD_DDictWorkspaceBound());
+	if (!ctx->zstd_cdict_attach || !ctx->zstd_cdict_copy ||
+	    !ctx->zstd_ddict)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int __init test_compress_init_zstd(struct test_compress_ctx *ctx)
+{
+	ZSTD_parameters attach, copy;
+	size_t csize, dsize;
+	int ret;
+
+	ctx->zstd_params = ZSTD_getParams(zstd_level, PAGE_SIZE, 0);
+	attach = ZSTD_getParams(TEST_COMPRESS_ATTACH_LEVEL, PAGE_SIZE,
+				TEST_COMPRESS_DICT_SIZE);
+	copy = ZSTD_getParams(TEST_COMPRESS_COPY_LEVEL, PAGE_SIZE,
+			      TEST_COMPRESS_DICT_SIZE);
+
+	ret = test_compress_init_zstd_dict(ctx, attach, copy);
+	if (ret)
+		return ret;
+
+	/* the CCtx is reset to the parameters of each CDict in turn */
+	csize = max3(ZSTD_CCtxWorkspaceBound(ctx->zstd_params.cParams),
+		     ZSTD_CCtxWorkspaceBound(attach.cParams),
+		     ZSTD_CCtxWorkspaceBound(copy.cParams));
+	dsize = ZSTD_DCtxWorkspaceBound();
+
+	ctx->zstd_cwork = vmalloc(csize);
+	ctx->zstd_dwork = vmalloc(dsize);
+	if (!ctx->zstd_cwork || !ctx->zstd_dwork)
+		return -ENOMEM;
+
+	ctx->zstd_cctx = ZSTD_initCCtx(ctx->zstd_cwork, csize);
+	ctx->zstd_dctx = ZSTD_initDCtx(ctx->zstd_dwork, dsize);
+	if (!ctx->zstd_cctx || !ctx->zstd_dctx)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int __init test_compress_init(void)
+{
+	struct test_compress_ctx ctx = {};
+	char *data, *cdata, *out;
+	unsigned int *clen;
+	unsigned int set, alg, i;
+	int ret = -ENOMEM;
+
+	if (!nr_pages || !iters)
+		return -EINVAL;
+
+	data = vmalloc(array_size(nr_pages, PAGE_SIZE));
+	cdata = vmalloc(array_size(nr_pages, TEST_COMPRESS_CBOUND));
+	clen = kvmalloc_array(nr_pages, sizeof(*clen), GFP_KERNEL);
+	out = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	ctx.sw842_wmem = vmalloc(SW842_MEM_COMPRESS);
+	ctx.lz4_wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	if (!data || !cdata || !clen || !out || !ctx.sw842_wmem ||
+	    !ctx.lz4_wrkmem)
+		goto out_free;
+
+	ret = test_compress_init_zstd(&ctx);
+	if (ret)
+		goto out_free;
+
+	for (set = 0; set < ARRAY_SIZE(test_compress_sets); set++) {
+		for (i = 0; i < nr_pages; i++)
+			test_compress_sets[set].fill(data + (size_t)i * PAGE_SIZE,
+						     i);
+
+		for (alg = 0; alg < ARRAY_SIZE(test_compress_algs); alg++) {
+			ret = test_compress_alg(&ctx, set, alg, data, cdata,
+						clen, out);
+			if (ret)
+				goto out_free;
+		}
+	}
+
+out_free:
+	vfree(ctx.zstd_ddict_work);
+	vfree(ctx.zstd_cdict_copy_work);
+	vfree(ctx.zstd_cdict_attach_work);
+	vfree(ctx.zstd_dict);
+	vfree(ctx.zstd_dwork);
+	vfree(ctx.zstd_cwork);
+	vfree(ctx.lz4_wrkmem);
+	vfree(ctx.sw842_wmem);
+	kfree(out);
+	kvfree(clen);
+	vfree(cdata);
+	vfree(data);
+
+	return ret;
+}
+
+static void __exit test_compress_exit(void)
+{
+}
+
+module_init(test_compress_init);
+module_exit(test_compress_exit);
+
+MODULE_DESCRIPTION("842, LZ4 and zstd page compression test and benchmark");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Test and throughput benchmark for the LZ4 decompressor.
+ *
+ * Page sized blocks are taken from the kernel's own text and read-only
+ * data, and from a few synthetic patterns, and compressed one page at a
+ * time as zram does. Every block is then decompressed with
+ * LZ4_decompress_safe(), LZ4_decompress_safe_page() and
+ * LZ4_decompress_fast(), checked against the original, and timed.
+ * Run it on kernels built with and without CONFIG_LZ4_FAST_DEC_LOOP to
+ * compare the two decoding loops.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/module.h>
+#include <linux/prandom.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include <asm/sections.h>
+
+static unsigned int nr_pages = 256;
+module_param(nr_pages, uint, 0444);
+MODULE_PARM_DESC(nr_pages, "Pages per data set (default: 256)");
+
+static unsigned int iters = 64;
+module_param(iters, uint, 0444);
+MODULE_PARM_DESC(iters, "Decompression passes over each data set (default: 64)");
+
+#define LZ4_TEST_CBOUND	LZ4_COMPRESSBOUND(PAGE_SIZE)
+
+enum lz4_test_decoder {
+	LZ4_TEST_SAFE,
+	LZ4_TEST_PAGE,
+	LZ4_TEST_FAST,
+	LZ4_TEST_NR_DECODERS,
+};
+
+static const char * const lz4_test_decoder_names[] = {
+	[LZ4_TEST_SAFE] = "safe",
+	[LZ4_TEST_PAGE] = "page",
+	[LZ4_TEST_FAST] = "fast",
+};
+
+static void fill_section(void *page, unsigned int idx,
+			 const char *start, const char *end)
+{
+	unsigned long nr = (end - start) / PAGE_SIZE;
+
+	memcpy(page, start + (idx % nr) * PAGE_SIZE, PAGE_SIZE);
+}
+
+static void fill_text(void *page, unsigned int idx)
+{
+	fill_section(page, idx, _stext, _etext);
+}
+
+static void fill_rodata(void *page, unsigned int idx)
+{
+	fill_section(page, idx, __start_rodata, __end_rodata);
+}
+
+/* Mostly zero, with a few words set: sparse anonymous memory. */
+static void fill_sparse(void *page, unsigned int idx)
+{
+	u32 *p = page;
+	int i;
+
+	memset(page, 0, PAGE_SIZE);
+	for (i = 0; i < 16; i++)
+		p[prandom_u32_max(PAGE_SIZE / sizeof(u32))] = prandom_u32();
+}
+
+/* Short repeating patterns: overlapping matches with small offsets. */
+static void fill_pattern(void *page, unsigned int idx)
+{
+	u8 *p = page;
+	unsigned int i, period = 1 + idx % 15;
+
+	prandom_bytes(p, period);
+	for (i = period; i < PAGE_SIZE; i++)
+		p[i] = p[i - period];
+}
+
+static void fill_random(void *page, unsigned int idx)
+{
+	prandom_bytes(page, PAGE_SIZE);
+}
+
+static const struct {
+	const char *name;
+	void (*fill)(void *page, unsigned int idx);
+} lz4_test_sets[] = {
+	{ "text", fill_text },
+	{ "rodata", fill_rodata },
+	{ "sparse", fill_sparse },
+	{ "pattern", fill_pattern },
+	{ "random", fill_random },
+};
+
+static int lz4_test_decode(enum lz4_test_decoder dec, const char *src,
+			   int srclen, char *dst)
+{
+	switch (dec) {
+	case LZ4_TEST_SAFE:
+		return LZ4_decompress_safe(src, dst, srclen, PAGE_SIZE);
+	case LZ4_TEST_PAGE:
+		return LZ4_decompress_safe_page(src, dst, srclen);
+	case LZ4_TEST_FAST:
+		/* returns the number of input bytes read */
+		if (LZ4_decompress_fast(src, dst, PAGE_SIZE) != srclen)
+			return -1;
+		return PAGE_SIZE;
+	default:
+		return -1;
+	}
+}
+
+static int __init lz4_test_set(unsigned int set, char *data, char *cdata,
+			       int *clen, char *out, void *wrkmem)
+{
+	u64 rate[LZ4_TEST_NR_DECODERS];
+	size_t total = 0;
+	unsigned int i, n;
+	int dec;
+
+	for (i = 0; i < nr_pages; i++) {
+		char *page = data + (size_t)i * PAGE_SIZE;
+
+		lz4_test_sets[set].fill(page, i);
+		clen[i] = LZ4_compress_default(page,
+					       cdata + (size_t)i * LZ4_TEST_CBOUND,
+					       PAGE_SIZE, LZ4_TEST_CBOUND,
+					       wrkmem);
+		if (clen[i] <= 0) {
+			pr_err("%s: failed to compress page %u\n",
+			       lz4_test_sets[set].name, i);
+			return -EINVAL;
+		}
+		total += clen[i];
+	}
+
+	for (dec = 0; dec < LZ4_TEST_NR_DECODERS; dec++) {
+		for (i = 0; i < nr_pages; i++) {
+			int ret;
+
+			memset(out, 0xa5, PAGE_SIZE);
+			ret = lz4_test_decode(dec,
+					      cdata + (size_t)i * LZ4_TEST_CBOUND,
+					      clen[i], out);
+			if (ret != PAGE_SIZE ||
+			    memcmp(out, data + (size_t)i * PAGE_SIZE, PAGE_SIZE)) {
+				pr_err("%s: %s decoder failed on page %u (%d)\n",
+				       lz4_test_sets[set].name,
+				       lz4_test_decoder_names[dec], i, ret);
+				return -EINVAL;
+			}
+		}
+	}
+
+	for (dec = 0; dec < LZ4_TEST_NR_DECODERS; dec++) {
+		u64 t0, t1;
+
+		t0 = ktime_get_ns();
+		for (n = 0; n < iters; n++) {
+			for (i = 0; i < nr_pages; i++)
+				lz4_test_decode(dec,
+						cdata + (size_t)i * LZ4_TEST_CBOUND,
+						clen[i], out);
+			cond_resched();
+		}
+		t1 = ktime_get_ns();
+
+		/* bytes/ns * 1000 == MB/s */
+		rate[dec] = div64_u64((u64)iters * nr_pages * PAGE_SIZE * 1000,
+				      max_t(u64, t1 - t0, 1));
+	}
+
+	pr_info("%-8s %3llu%% of original: safe %llu MB/s, page %llu MB/s, fast %llu MB/s\n",
+		lz4_test_sets[set].name,
+		div64_u64((u64)total * 100, (u64)nr_pages * PAGE_SIZE),
+		rate[LZ4_TEST_SAFE], rate[LZ4_TEST_PAGE], rate[LZ4_TEST_FAST]);
+
+	return 0;
+}
+
+static int __init test_lz4_init(void)
+{
+	char *data, *cdata, *out;
+	void *wrkmem;
+	int *clen;
+	unsigned int set;
+	int ret = -ENOMEM;
+
+	if (!nr_pages || !iters)
+		return -EINVAL;
+
+	data = vmalloc(array_size(nr_pages, PAGE_SIZE));
+	cdata = vmalloc(array_size(nr_pages, LZ4_TEST_CBOUND));
+	clen = kvmalloc_array(nr_pages, sizeof(*clen), GFP_KERNEL);
+	out = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	if (!data || !cdata || !clen || !out || !wrkmem)
+		goto out_free;
+
+	for (set = 0; set < ARRAY_SIZE(lz4_test_sets); set++) {
+		ret = lz4_test_set(set, data, cdata, clen, out, wrkmem);
+		if (ret)
+			break;
+	}
+
+out_free:
+	vfree(wrkmem);
+	kfree(out);
+	kvfree(clen);
+	vfree(cdata);
+	vfree(data);
+
+	return ret;
+}
+
+static void __exit test_lz4_exit(void)
+{
+}
+
+module_init(test_lz4_init);
+module_exit(test_lz4_exit);
+
+MODULE_DESCRIPTION("LZ4 decompressor test and benchmark");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Parallel decoding of multi-Block .xz Streams
+ *
+ * The Blocks of a .xz Stream don't depend on each other. When the Block
+ * Headers store the Compressed Size, the Blocks can be located without
+ * decoding them, and then be decoded in single-call mode on several CPUs
+ * while the caller consumes their output in order.
+ */
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+
+#include "xz_private.h"
+#include "xz_stream.h"
+
+/* Upper bound on the number of Blocks being decoded at the same time */
+#define XZ_MT_JOBS_MAX 16
+
+struct xz_mt_block {
+	/* Block Header through the Check field */
+	const uint8_t *in;
+	size_t in_size;
+
+	/* Uncompressed Size from the Index */
+	size_t out_size;
+};
+
+struct xz_mt_job {
+	struct work_struct work;
+	struct completion done;
+	struct xz_dec *s;
+	uint8_t check_id;
+	const struct xz_mt_block *block;
+	uint8_t *out;
+	enum xz_ret ret;
+};
+
+/* Decode a variable-length integer which must end before in[size]. */
+static bool xz_mt_vli(const uint8_t *in, size_t *pos, size_t size,
+		      vli_type *vli)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	*vli = 0;
+
+	for (i = 0; i < VLI_BYTES_MAX && *pos < size; ++i) {
+		byte = in[(*pos)++];
+		*vli |= (vli_type)(byte & 0x7F) << (i * 7);
+
+		/* Don't allow non-minimal encodings. */
+		if ((byte & 0x80) == 0)
+			return byte != 0 || i == 0;
+	}
+
+	return false;
+}
+
+/*
+ * Walk the Block Headers to find the Index, and build the table of Blocks
+ * from the Index. The Index and the Stream Footer are validated here; the
+ * Blocks are validated by xz_dec_block_run(). Returns the number of
+ * Blocks, or zero if the Stream cannot be decoded in parallel.
+ */
+static size_t xz_mt_scan(const uint8_t *in, size_t in_size,
+			 uint8_t *check_id, struct xz_mt_block **blocks,
+			 size_t *out_max, size_t *in_used)
+{
+	struct xz_mt_block *b;
+	size_t check_size;
+	size_t pos, index_pos, block_pos;
+	size_t count = 0;
+	size_t i;
+	vli_type vli, unpadded, uncompressed;
+	uint32_t header_size;
+
+	if (in_size < 2 * STREAM_HEADER_SIZE
+			|| !memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE)
+			|| xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+				!= get_le32(in + HEADER_MAGIC_SIZE + 2)
+			|| in[HEADER_MAGIC_SIZE] != 0)
+		return 0;
+
+	*check_id = in[HEADER_MAGIC_SIZE + 1];
+	if (*check_id == XZ_CHECK_NONE)
+		check_size = 0;
+	else if (*check_id == XZ_CHECK_CRC32)
+		check_size = 4;
+	else
+		return 0;
+
+	/* Skip over the Blocks using the Compressed Size fields. */
+	pos = STREAM_HEADER_SIZE;
+	while (pos < in_size && in[pos] != 0) {
+		header_size = ((uint32_t)in[pos] + 1) * 4;
+		if (header_size > in_size - pos || !(in[pos + 1] & 0x40))
+			return 0;
+
+		i = 2;
+		if (!xz_mt_vli(in + pos, &i, header_size - 4, &vli)
+				|| vli > in_size - pos - header_size)
+			return 0;
+
+		pos += header_size + ALIGN((size_t)vli, 4);
+		if (pos > in_size || check_size > in_size - pos)
+			return 0;
+
+		pos += check_size;
+		++count;
+	}
+
+	/* Index Indicator and Number of Records */
+	if (count < 2 || pos >= in_size)
+		return 0;
+
+	index_pos = pos++;
+	if (!xz_mt_vli(in, &pos, in_size, &vli) || vli != count)
+		return 0;
+
+	b = kvmalloc_array(count, sizeof(*b), GFP_KERNEL);
+	if (b == NULL)
+		return 0;
+
+	*out_max = 0;
+	block_pos = STREAM_HEADER_SIZE;
+	for (i = 0; i < count; ++i) {
+		if (!xz_mt_vli(in, &pos, in_size, &unpadded)
+				|| !xz_mt_vli(in, &pos, in_size, &uncompressed)
+				|| unpadded < check_size + 5
+				|| unpadded > index_pos - block_pos
+				|| uncompressed > SIZE_MAX / 2)
+			goto error;
+
+		b[i].in = in + block_pos;
+		b[i].in_size = ALIGN((size_t)unpadded - check_size, 4)
+				+ check_size;
+		b[i].out_size = uncompressed;
+		*out_max = max(*out_max, b[i].out_size);
+
+		block_pos += b[i].in_size;
+		if (block_pos > index_pos)
+			goto error;
+	}
+
+	/* The Records must describe exactly the Blocks that were skipped. */
+	if (block_pos != index_pos)
+		goto error;
+
+	/* Index Padding, CRC32, and the Stream Footer */
+	while ((pos - index_pos) & 3) {
+		if (pos >= in_size || in[pos++] != 0)
+			goto error;
+	}
+
+	if (in_size - pos < 4 + STREAM_HEADER_SIZE
+			|| xz_crc32(in + index_pos, pos - index_pos, 0)
+				!= get_le32(in + pos))
+		goto error;
+
+	pos += 4;
+	if (xz_crc32(in + pos + 4, 6, 0) != get_le32(in + pos)
+			|| get_le32(in + pos + 4) != (pos - index_pos) / 4 - 1
+			|| in[pos + 8] != 0 || in[pos + 9] != *check_id
+			|| !memeq(in + pos + 10, FOOTER_MAGIC,
+				  FOOTER_MAGIC_SIZE))
+		goto error;
+
+	*in_used = pos + STREAM_HEADER_SIZE;
+	*blocks = b;
+	return count;
+
+error:
+	kvfree(b);
+	return 0;
+}
+
+static void xz_mt_work(struct work_struct *work)
+{
+	struct xz_mt_job *job = container_of(work, struct xz_mt_job, work);
+	struct xz_buf b = {
+		.in = job->block->in,
+		.in_pos = 0,
+		.in_size = job->block->in_size,
+		.out = job->out,
+		.out_pos = 0,
+		.out_size = job->block->out_size
+	};
+
+	job->ret = xz_dec_block_run(job->s, job->check_id, &b);
+	if (job->ret == XZ_STREAM_END && b.out_pos != b.out_size)
+		job->ret = XZ_DATA_ERROR;
+
+	complete(&job->done);
+}
+
+static void xz_mt_queue(struct xz_mt_job *job, const struct xz_mt_block *block)
+{
+	job->block = block;
+	job->out = vmalloc(max_t(size_t, block->out_size, 1));
+	reinit_completion(&job->done);
+
+	if (job->out == NULL) {
+		job->ret = XZ_MEM_ERROR;
+		complete(&job->done);
+		return;
+	}
+
+	queue_work(system_unbound_wq, &job->work);
+}
+
+XZ_EXTERN enum xz_ret xz_dec_mt_run(const uint8_t *in, size_t in_size,
+				    size_t *in_used,
+				    long (*flush)(void *, unsigned long))
+{
+	struct xz_mt_block *blocks;
+	struct xz_mt_job *jobs;
+	struct xz_mt_job *job;
+	enum xz_ret ret = XZ_STREAM_END;
+	size_t count, out_max, ram;
+	size_t queued, i;
+	uint32_t njobs;
+	uint8_t check_id;
+
+	if (num_online_cpus() < 2)
+		return XZ_OPTIONS_ERROR;
+
+	count = xz_mt_scan(in, in_size, &check_id, &blocks, &out_max, in_used);
+	if (count == 0)
+		return XZ_OPTIONS_ERROR;
+
+	/* Keep the uncompressed Blocks in flight within a quarter of RAM. */
+	ram = (totalram_pages() << PAGE_SHIFT) / 4;
+	njobs = min3(count, (size_t)num_online_cpus(), (size_t)XZ_MT_JOBS_MAX);
+	if (out_max > 0)
+		njobs = min_t(size_t, njobs, ram / out_max);
+
+	if (njobs < 2) {
+		kvfree(blocks);
+		return XZ_OPTIONS_ERROR;
+	}
+
+	jobs = kcalloc(njobs, sizeof(*jobs), GFP_KERNEL);
+	if (jobs == NULL) {
+		kvfree(blocks);
+		return XZ_OPTIONS_ERROR;
+	}
+
+	for (i = 0; i < njobs; ++i) {
+		job = &jobs[i];
+		INIT_WORK(&job->work, xz_mt_work);
+		init_completion(&job->done);
+		job->check_id = check_id;
+
+		/* The output buffer is the dictionary in single-call mode. */
+		job->s = xz_dec_init(XZ_SINGLE, 0);
+		if (job->s == NULL) {
+			ret = XZ_OPTIONS_ERROR;
+			goto out;
+		}
+	}
+
+	for (queued = 0; queued < njobs; ++queued)
+		xz_mt_queue(&jobs[queued], &blocks[queued]);
+
+	/*
+	 * Block i is decoded by job i % njobs. Once its output has been
+	 * flushed, the job moves on to Block i + njobs.
+	 */
+	for (i = 0; i < count; ++i) {
+		job = &jobs[i % njobs];
+		wait_for_completion(&job->done);
+
+		if (ret == XZ_STREAM_END) {
+			ret = job->ret;
+			if (ret == XZ_OPTIONS_ERROR)
+				ret = XZ_DATA_ERROR;
+		}
+
+		if (ret == XZ_STREAM_END && job->block->out_size > 0
+				&& flush(job->out, job->block->out_size)
+					!= job->block->out_size)
+			ret = XZ_BUF_ERROR;
+
+		vfree(job->out);
+		job->out = NULL;
+
+		/* After an error, only wait for the Blocks already queued. */
+		if (ret == XZ_STREAM_END && queued < count)
+			xz_mt_queue(job, &blocks[queued++]);
+		else if (queued < count)
+			count = queued;
+	}
+
+out:
+	for (i = 0; i < njobs; ++i)
+		xz_dec_end(jobs[i].s);
+
+	kfree(jobs);
+	kvfree(blocks);
+	return ret;
+}
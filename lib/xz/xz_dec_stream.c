@@ -783,6 +783,34 @@ XZ_EXTERN enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b)
 	return ret;
 }
 
+#ifdef XZ_DEC_MT
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, uint8_t check_id,
+				       struct xz_buf *b)
+{
+	enum xz_ret ret;
+
+	xz_dec_reset(s);
+	s->check_type = check_id;
+	s->sequence = SEQ_BLOCK_START;
+
+	ret = dec_main(s, b);
+
+	/*
+	 * The input ends right after the Check field, so a successfully
+	 * decoded Block leaves dec_main() waiting for the next one.
+	 */
+	if (ret == XZ_OK)
+		return s->sequence == SEQ_BLOCK_START && s->block.count == 1
+				? XZ_STREAM_END : XZ_DATA_ERROR;
+
+	/* Only Blocks are expected here, not the Index. */
+	if (ret == XZ_STREAM_END)
+		return XZ_DATA_ERROR;
+
+	return ret;
+}
+#endif
+
 XZ_EXTERN struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max)
 {
 	struct xz_dec *s = kmalloc(sizeof(*s), GFP_KERNEL);
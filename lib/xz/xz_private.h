@@ -37,6 +37,9 @@
 #		ifdef CONFIG_XZ_DEC_SPARC
 #			define XZ_DEC_SPARC
 #		endif
+#		ifdef CONFIG_XZ_DEC_MT
+#			define XZ_DEC_MT
+#		endif
 #		define memeq(a, b, size) (memcmp(a, b, size) == 0)
 #		define memzero(buf, size) memset(buf, 0, size)
 #	endif
@@ -157,4 +160,15 @@ XZ_EXTERN enum xz_ret xz_dec_bcj_run(struct xz_dec_bcj *s,
 #define xz_dec_bcj_end(s) kfree(s)
 #endif
 
+#ifdef XZ_DEC_MT
+/*
+ * Decode a single Block from b->in, which must hold exactly the Block
+ * Header, Compressed Data, Block Padding, and Check fields. check_id is
+ * the Check ID from the Stream Flags. Returns XZ_STREAM_END once the
+ * whole Block has been decoded and validated.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, uint8_t check_id,
+				       struct xz_buf *b);
+#endif
+
 #endif
@@ -75,6 +75,7 @@ struct ZSTD_CCtx_s {
 	ZSTD_customMem customMem;
 
 	seqStore_t seqStore; /* sequences storage ptrs */
+	const ZSTD_CCtx *dictCtx; /* attached dictionary, searched in place (see ZSTD_attachCDict()) */
 	U32 *hashTable;
 	U32 *hashTable3;
 	U32 *chainTable;
@@ -225,6 +226,7 @@ static size_t ZSTD_continueCCtx(ZSTD_CCtx *cctx, ZSTD_parameters params, U64 fra
 	cctx->stage = ZSTDcs_init;
 	cctx->dictID = 0;
 	cctx->loadedDictEnd = 0;
+	cctx->dictCtx = NULL;
 	{
 		int i;
 		for (i = 0; i < ZSTD_REP_NUM; i++)
@@ -325,6 +327,7 @@ static size_t ZSTD_resetCCtx_advanced(ZSTD_CCtx *zc, ZSTD_parameters params, U64
 		zc->stage = ZSTDcs_init;
 		zc->dictID = 0;
 		zc->loadedDictEnd = 0;
+		zc->dictCtx = NULL;
 
 		return 0;
 	}
@@ -376,6 +379,8 @@ size_t ZSTD_copyCCtx(ZSTD_CCtx *dstCCtx, const ZSTD_CCtx *srcCCtx, unsigned long
 	dstCCtx->lowLimit = srcCCtx->lowLimit;
 	dstCCtx->loadedDictEnd = srcCCtx->loadedDictEnd;
 	dstCCtx->dictID = srcCCtx->dictID;
+	dstCCtx->dictCtx = srcCCtx->dictCtx;
+	memcpy(dstCCtx->rep, srcCCtx->rep, sizeof(dstCCtx->rep)); /* a zstd dictionary provides its own repcodes */
 
 	/* copy entropy tables */
 	dstCCtx->flagStaticTables = srcCCtx->flagStaticTables;
@@ -1113,6 +1118,142 @@ static void ZSTD_compressBlock_fast(ZSTD_CCtx *ctx, const void *src, size_t srcS
 	}
 }
 
+/* ZSTD_compressBlock_fast_attachedDict_generic() :
+ * same as ZSTD_compressBlock_fast_generic(), but on a miss in the context's
+ * own table, also looks the position up in the read-only table of the attached
+ * dictionary. The dictionary is presumed to end right where the current
+ * prefix starts, which is where the decoder places it too. Repcodes are only
+ * followed inside the current prefix. */
+FORCE_INLINE
+void ZSTD_compressBlock_fast_attachedDict_generic(ZSTD_CCtx *cctx, const void *src, size_t srcSize, const U32 mls)
+{
+	const ZSTD_CCtx *const dictCtx = cctx->dictCtx;
+	U32 *const hashTable = cctx->hashTable;
+	const U32 *const dictHashTable = dictCtx->hashTable;
+	U32 const hBits = cctx->params.cParams.hashLog;
+	seqStore_t *seqStorePtr = &(cctx->seqStore);
+	const BYTE *const base = cctx->base;
+	const BYTE *const istart = (const BYTE *)src;
+	const BYTE *ip = istart;
+	const BYTE *anchor = istart;
+	const U32 prefixStartIndex = cctx->dictLimit;
+	const BYTE *const prefixStart = base + prefixStartIndex;
+	const BYTE *const dictBase = dictCtx->base;
+	const U32 dictStartIndex = dictCtx->dictLimit;
+	const BYTE *const dictStart = dictBase + dictStartIndex;
+	const BYTE *const dictEnd = dictCtx->nextSrc;
+	const U32 dictIndexDelta = prefixStartIndex - (U32)(dictEnd - dictBase);
+	const BYTE *const iend = istart + srcSize;
+	const BYTE *const ilimit = iend - HASH_READ_SIZE;
+	U32 offset_1 = cctx->rep[0], offset_2 = cctx->rep[1];
+	U32 offsetSaved = 0;
+
+	/* init */
+	{
+		U32 const maxRep = (U32)(ip - prefixStart);
+		if (offset_2 > maxRep)
+			offsetSaved = offset_2, offset_2 = 0;
+		if (offset_1 > maxRep)
+			offsetSaved = offset_1, offset_1 = 0;
+	}
+
+	/* Main Search Loop */
+	while (ip < ilimit) { /* < instead of <=, because repcode check at (ip+1) */
+		size_t mLength;
+		size_t const h = ZSTD_hashPtr(ip, hBits, mls);
+		U32 const curr = (U32)(ip - base);
+		U32 const matchIndex = hashTable[h];
+		const BYTE *match = base + matchIndex;
+		U32 offset;
+		hashTable[h] = curr; /* update hash table */
+
+		/* dictionary offsets end up in offset_1/2 : check they stay inside the prefix */
+		if ((offset_1 > 0) && (offset_1 <= (U32)(ip + 1 - prefixStart)) && (ZSTD_read32(ip + 1 - offset_1) == ZSTD_read32(ip + 1))) {
+			mLength = ZSTD_count(ip + 1 + 4, ip + 1 + 4 - offset_1, iend) + 4;
+			ip++;
+			ZSTD_storeSeq(seqStorePtr, ip - anchor, anchor, 0, mLength - MINMATCH);
+		} else if ((matchIndex > prefixStartIndex) && (ZSTD_read32(match) == ZSTD_read32(ip))) {
+			mLength = ZSTD_count(ip + 4, match + 4, iend) + 4;
+			offset = (U32)(ip - match);
+			while (((ip > anchor) & (match > prefixStart)) && (ip[-1] == match[-1])) {
+				ip--;
+				match--;
+				mLength++;
+			} /* catch up */
+			offset_2 = offset_1;
+			offset_1 = offset;
+
+			ZSTD_storeSeq(seqStorePtr, ip - anchor, anchor, offset + ZSTD_REP_MOVE, mLength - MINMATCH);
+		} else {
+			U32 const dictMatchIndex = dictHashTable[h];
+			const BYTE *dictMatch = dictBase + dictMatchIndex;
+			if ((dictMatchIndex <= dictStartIndex) || (ZSTD_read32(dictMatch) != ZSTD_read32(ip))) {
+				ip += ((ip - anchor) >> g_searchStrength) + 1;
+				continue;
+			}
+			mLength = ZSTD_count_2segments(ip + 4, dictMatch + 4, iend, dictEnd, prefixStart) + 4;
+			offset = curr - (dictMatchIndex + dictIndexDelta);
+			while (((ip > anchor) & (dictMatch > dictStart)) && (ip[-1] == dictMatch[-1])) {
+				ip--;
+				dictMatch--;
+				mLength++;
+			} /* catch up */
+			offset_2 = offset_1;
+			offset_1 = offset;
+
+			ZSTD_storeSeq(seqStorePtr, ip - anchor, anchor, offset + ZSTD_REP_MOVE, mLength - MINMATCH);
+		}
+
+		/* match found */
+		ip += mLength;
+		anchor = ip;
+
+		if (ip <= ilimit) {
+			/* Fill Table */
+			hashTable[ZSTD_hashPtr(base + curr + 2, hBits, mls)] = curr + 2; /* here because curr+2 could be > iend-8 */
+			hashTable[ZSTD_hashPtr(ip - 2, hBits, mls)] = (U32)(ip - 2 - base);
+			/* check immediate repcode */
+			while ((ip <= ilimit) && (offset_2 > 0) && (offset_2 <= (U32)(ip - prefixStart)) && (ZSTD_read32(ip) == ZSTD_read32(ip - offset_2))) {
+				/* store sequence */
+				size_t const rLength = ZSTD_count(ip + 4, ip + 4 - offset_2, iend) + 4;
+				{
+					U32 const tmpOff = offset_2;
+					offset_2 = offset_1;
+					offset_1 = tmpOff;
+				} /* swap offset_2 <=> offset_1 */
+				hashTable[ZSTD_hashPtr(ip, hBits, mls)] = (U32)(ip - base);
+				ZSTD_storeSeq(seqStorePtr, 0, anchor, 0, rLength - MINMATCH);
+				ip += rLength;
+				anchor = ip;
+				continue;
+			}
+		}
+	}
+
+	/* save reps for next block */
+	cctx->repToConfirm[0] = offset_1 ? offset_1 : offsetSaved;
+	cctx->repToConfirm[1] = offset_2 ? offset_2 : offsetSaved;
+
+	/* Last Literals */
+	{
+		size_t const lastLLSize = iend - anchor;
+		memcpy(seqStorePtr->lit, anchor, lastLLSize);
+		seqStorePtr->lit += lastLLSize;
+	}
+}
+
+static void ZSTD_compressBlock_fast_attachedDict(ZSTD_CCtx *ctx, const void *src, size_t srcSize)
+{
+	const U32 mls = ctx->params.cParams.searchLength;
+	switch (mls) {
+	default: /* includes case 3 */
+	case 4: ZSTD_compressBlock_fast_attachedDict_generic(ctx, src, srcSize, 4); return;
+	case 5: ZSTD_compressBlock_fast_attachedDict_generic(ctx, src, srcSize, 5); return;
+	case 6: ZSTD_compressBlock_fast_attachedDict_generic(ctx, src, srcSize, 6); return;
+	case 7: ZSTD_compressBlock_fast_attachedDict_generic(ctx, src, srcSize, 7); return;
+	}
+}
+
 static void ZSTD_compressBlock_fast_extDict_generic(ZSTD_CCtx *ctx, const void *src, size_t srcSize, const U32 mls)
 {
 	U32 *hashTable = ctx->hashTable;
@@ -1392,6 +1533,165 @@ static void ZSTD_compressBlock_doubleFast(ZSTD_CCtx *ctx, const void *src, size_
 	}
 }
 
+/* ZSTD_compressBlock_doubleFast_attachedDict_generic() :
+ * ZSTD_compressBlock_doubleFast_generic() searching the attached dictionary's
+ * long then short tables whenever the context's own tables miss. */
+FORCE_INLINE
+void ZSTD_compressBlock_doubleFast_attachedDict_generic(ZSTD_CCtx *cctx, const void *src, size_t srcSize, const U32 mls)
+{
+	const ZSTD_CCtx *const dictCtx = cctx->dictCtx;
+	U32 *const hashLong = cctx->hashTable;
+	const U32 hBitsL = cctx->params.cParams.hashLog;
+	U32 *const hashSmall = cctx->chainTable;
+	const U32 hBitsS = cctx->params.cParams.chainLog;
+	const U32 *const dictHashLong = dictCtx->hashTable;
+	const U32 *const dictHashSmall = dictCtx->chainTable;
+	seqStore_t *seqStorePtr = &(cctx->seqStore);
+	const BYTE *const base = cctx->base;
+	const BYTE *const istart = (const BYTE *)src;
+	const BYTE *ip = istart;
+	const BYTE *anchor = istart;
+	const U32 prefixStartIndex = cctx->dictLimit;
+	const BYTE *const prefixStart = base + prefixStartIndex;
+	const BYTE *const dictBase = dictCtx->base;
+	const U32 dictStartIndex = dictCtx->dictLimit;
+	const BYTE *const dictStart = dictBase + dictStartIndex;
+	const BYTE *const dictEnd = dictCtx->nextSrc;
+	const U32 dictIndexDelta = prefixStartIndex - (U32)(dictEnd - dictBase);
+	const BYTE *const iend = istart + srcSize;
+	const BYTE *const ilimit = iend - HASH_READ_SIZE;
+	U32 offset_1 = cctx->rep[0], offset_2 = cctx->rep[1];
+	U32 offsetSaved = 0;
+
+	/* init */
+	{
+		U32 const maxRep = (U32)(ip - prefixStart);
+		if (offset_2 > maxRep)
+			offsetSaved = offset_2, offset_2 = 0;
+		if (offset_1 > maxRep)
+			offsetSaved = offset_1, offset_1 = 0;
+	}
+
+	/* Main Search Loop */
+	while (ip < ilimit) { /* < instead of <=, because repcode check at (ip+1) */
+		size_t mLength;
+		size_t const h2 = ZSTD_hashPtr(ip, hBitsL, 8);
+		size_t const h = ZSTD_hashPtr(ip, hBitsS, mls);
+		U32 const curr = (U32)(ip - base);
+		U32 const matchIndexL = hashLong[h2];
+		U32 const matchIndexS = hashSmall[h];
+		U32 const dictMatchIndexL = dictHashLong[h2];
+		U32 const dictMatchIndexS = dictHashSmall[h];
+		const BYTE *matchLong = base + matchIndexL;
+		const BYTE *match = base + matchIndexS;
+		const BYTE *dictMatch;
+		hashLong[h2] = hashSmall[h] = curr; /* update hash tables */
+
+		/* dictionary offsets end up in offset_1/2 : check they stay inside the prefix */
+		if ((offset_1 > 0) && (offset_1 <= (U32)(ip + 1 - prefixStart)) && (ZSTD_read32(ip + 1 - offset_1) == ZSTD_read32(ip + 1))) {
+			mLength = ZSTD_count(ip + 1 + 4, ip + 1 + 4 - offset_1, iend) + 4;
+			ip++;
+			ZSTD_storeSeq(seqStorePtr, ip - anchor, anchor, 0, mLength - MINMATCH);
+		} else {
+			U32 offset;
+			if ((matchIndexL > prefixStartIndex) && (ZSTD_read64(matchLong) == ZSTD_read64(ip))) {
+				mLength = ZSTD_count(ip + 8, matchLong + 8, iend) + 8;
+				offset = (U32)(ip - matchLong);
+				while (((ip > anchor) & (matchLong > prefixStart)) && (ip[-1] == matchLong[-1])) {
+					ip--;
+					matchLong--;
+					mLength++;
+				} /* catch up */
+			} else if ((dictMatchIndexL > dictStartIndex) && (ZSTD_read64(dictBase + dictMatchIndexL) == ZSTD_read64(ip))) {
+				dictMatch = dictBase + dictMatchIndexL;
+				mLength = ZSTD_count_2segments(ip + 8, dictMatch + 8, iend, dictEnd, prefixStart) + 8;
+				offset = curr - (dictMatchIndexL + dictIndexDelta);
+				while (((ip > anchor) & (dictMatch > dictStart)) && (ip[-1] == dictMatch[-1])) {
+					ip--;
+					dictMatch--;
+					mLength++;
+				} /* catch up */
+			} else if ((matchIndexS > prefixStartIndex) && (ZSTD_read32(match) == ZSTD_read32(ip))) {
+				mLength = ZSTD_count(ip + 4, match + 4, iend) + 4;
+				offset = (U32)(ip - match);
+				while (((ip > anchor) & (match > prefixStart)) && (ip[-1] == match[-1])) {
+					ip--;
+					match--;
+					mLength++;
+				} /* catch up */
+			} else if ((dictMatchIndexS > dictStartIndex) && (ZSTD_read32(dictBase + dictMatchIndexS) == ZSTD_read32(ip))) {
+				dictMatch = dictBase + dictMatchIndexS;
+				mLength = ZSTD_count_2segments(ip + 4, dictMatch + 4, iend, dictEnd, prefixStart) + 4;
+				offset = curr - (dictMatchIndexS + dictIndexDelta);
+				while (((ip > anchor) & (dictMatch > dictStart)) && (ip[-1] == dictMatch[-1])) {
+					ip--;
+					dictMatch--;
+					mLength++;
+				} /* catch up */
+			} else {
+				ip += ((ip - anchor) >> g_searchStrength) + 1;
+				continue;
+			}
+
+			offset_2 = offset_1;
+			offset_1 = offset;
+
+			ZSTD_storeSeq(seqStorePtr, ip - anchor, anchor, offset + ZSTD_REP_MOVE, mLength - MINMATCH);
+		}
+
+		/* match found */
+		ip += mLength;
+		anchor = ip;
+
+		if (ip <= ilimit) {
+			/* Fill Table */
+			hashLong[ZSTD_hashPtr(base + curr + 2, hBitsL, 8)] = hashSmall[ZSTD_hashPtr(base + curr + 2, hBitsS, mls)] =
+			    curr + 2; /* here because curr+2 could be > iend-8 */
+			hashLong[ZSTD_hashPtr(ip - 2, hBitsL, 8)] = hashSmall[ZSTD_hashPtr(ip - 2, hBitsS, mls)] = (U32)(ip - 2 - base);
+
+			/* check immediate repcode */
+			while ((ip <= ilimit) && (offset_2 > 0) && (offset_2 <= (U32)(ip - prefixStart)) && (ZSTD_read32(ip) == ZSTD_read32(ip - offset_2))) {
+				/* store sequence */
+				size_t const rLength = ZSTD_count(ip + 4, ip + 4 - offset_2, iend) + 4;
+				{
+					U32 const tmpOff = offset_2;
+					offset_2 = offset_1;
+					offset_1 = tmpOff;
+				} /* swap offset_2 <=> offset_1 */
+				hashSmall[ZSTD_hashPtr(ip, hBitsS, mls)] = (U32)(ip - base);
+				hashLong[ZSTD_hashPtr(ip, hBitsL, 8)] = (U32)(ip - base);
+				ZSTD_storeSeq(seqStorePtr, 0, anchor, 0, rLength - MINMATCH);
+				ip += rLength;
+				anchor = ip;
+				continue;
+			}
+		}
+	}
+
+	/* save reps for next block */
+	cctx->repToConfirm[0] = offset_1 ? offset_1 : offsetSaved;
+	cctx->repToConfirm[1] = offset_2 ? offset_2 : offsetSaved;
+
+	/* Last Literals */
+	{
+		size_t const lastLLSize = iend - anchor;
+		memcpy(seqStorePtr->lit, anchor, lastLLSize);
+		seqStorePtr->lit += lastLLSize;
+	}
+}
+
+static void ZSTD_compressBlock_doubleFast_attachedDict(ZSTD_CCtx *ctx, const void *src, size_t srcSize)
+{
+	const U32 mls = ctx->params.cParams.searchLength;
+	switch (mls) {
+	default: /* includes case 3 */
+	case 4: ZSTD_compressBlock_doubleFast_attachedDict_generic(ctx, src, srcSize, 4); return;
+	case 5: ZSTD_compressBlock_doubleFast_attachedDict_generic(ctx, src, srcSize, 5); return;
+	case 6: ZSTD_compressBlock_doubleFast_attachedDict_generic(ctx, src, srcSize, 6); return;
+	case 7: ZSTD_compressBlock_doubleFast_attachedDict_generic(ctx, src, srcSize, 7); return;
+	}
+}
+
 static void ZSTD_compressBlock_doubleFast_extDict_generic(ZSTD_CCtx *ctx, const void *src, size_t srcSize, const U32 mls)
 {
 	U32 *const hashLong = ctx->hashTable;
@@ -2332,12 +2632,19 @@ static ZSTD_blockCompressor ZSTD_selectBlockCompressor(ZSTD_strategy strat, int
 
 static size_t ZSTD_compressBlock_internal(ZSTD_CCtx *zc, void *dst, size_t dstCapacity, const void *src, size_t srcSize)
 {
-	ZSTD_blockCompressor const blockCompressor = ZSTD_selectBlockCompressor(zc->params.cParams.strategy, zc->lowLimit < zc->dictLimit);
+	ZSTD_blockCompressor blockCompressor;
 	const BYTE *const base = zc->base;
 	const BYTE *const istart = (const BYTE *)src;
 	const U32 curr = (U32)(istart - base);
 	if (srcSize < MIN_CBLOCK_SIZE + ZSTD_blockHeaderSize + 1)
 		return 0; /* don't even attempt compression below a certain srcSize */
+	/* an attached dictionary can only be searched while the input is a single prefix that fits in the window */
+	if (zc->dictCtx && ((zc->lowLimit < zc->dictLimit) || (curr + srcSize - zc->dictLimit > ((U32)1 << zc->params.cParams.windowLog))))
+		zc->dictCtx = NULL;
+	if (zc->dictCtx)
+		blockCompressor = (zc->params.cParams.strategy == ZSTD_fast) ? ZSTD_compressBlock_fast_attachedDict : ZSTD_compressBlock_doubleFast_attachedDict;
+	else
+		blockCompressor = ZSTD_selectBlockCompressor(zc->params.cParams.strategy, zc->lowLimit < zc->dictLimit);
 	ZSTD_resetSeqStore(&(zc->seqStore));
 	if (curr > zc->nextToUpdate + 384)
 		zc->nextToUpdate = curr - MIN(192, (U32)(curr - zc->nextToUpdate - 384)); /* update tree not updated after finding very long rep matches */
@@ -2911,9 +3218,65 @@ size_t ZSTD_freeCDict(ZSTD_CDict *cdict)
 
 static ZSTD_parameters ZSTD_getParamsFromCDict(const ZSTD_CDict *cdict) { return ZSTD_getParamsFromCCtx(cdict->refContext); }
 
+/* Below this input size, copying the dictionary's match tables costs more
+ * than compressing, so the fast strategies search them in place instead. */
+#define ZSTD_ATTACH_DICT_CUTOFF (16 * 1024)
+
+/*! ZSTD_attachCDict() :
+ *  Start a frame referencing `cdict` without copying its match tables : the
+ *  block compressor searches them read-only through `cctx->dictCtx`.
+ *  The context's own tables are not cleared either when they have the right
+ *  geometry, ZSTD_continueCCtx() puts their stale entries out of reach. */
+static size_t ZSTD_attachCDict(ZSTD_CCtx *cctx, const ZSTD_CDict *cdict, unsigned long long pledgedSrcSize)
+{
+	const ZSTD_CCtx *const dictCtx = cdict->refContext;
+	ZSTD_parameters params = dictCtx->params;
+
+	params.fParams.contentSizeFlag = (pledgedSrcSize > 0);
+	CHECK_F(ZSTD_resetCCtx_advanced(cctx, params, pledgedSrcSize, ZSTDcrp_continue));
+
+	/* start indexes past the end of the dictionary, so that an offset into it
+	 * can never reach below index 0 once the input goes to extDict mode */
+	{
+		U32 const dictEnd = (U32)(dictCtx->nextSrc - dictCtx->base);
+		if ((U32)(cctx->nextSrc - cctx->base) < dictEnd) {
+			cctx->nextSrc = cctx->base + dictEnd;
+			cctx->lowLimit = dictEnd;
+			cctx->dictLimit = dictEnd;
+			cctx->nextToUpdate = dictEnd + 1;
+		}
+	}
+
+	cctx->dictCtx = dictCtx;
+	cctx->dictID = dictCtx->dictID;
+	memcpy(cctx->rep, dictCtx->rep, sizeof(cctx->rep));
+
+	/* entropy tables are small, copy them */
+	cctx->flagStaticTables = dictCtx->flagStaticTables;
+	cctx->flagStaticHufTable = dictCtx->flagStaticHufTable;
+	if (dictCtx->flagStaticTables) {
+		memcpy(cctx->litlengthCTable, dictCtx->litlengthCTable, sizeof(cctx->litlengthCTable));
+		memcpy(cctx->matchlengthCTable, dictCtx->matchlengthCTable, sizeof(cctx->matchlengthCTable));
+		memcpy(cctx->offcodeCTable, dictCtx->offcodeCTable, sizeof(cctx->offcodeCTable));
+	}
+	if (dictCtx->flagStaticHufTable)
+		memcpy(cctx->hufTable, dictCtx->hufTable, 256 * 4);
+
+	return 0;
+}
+
+static int ZSTD_shouldAttachCDict(const ZSTD_CDict *cdict, unsigned long long pledgedSrcSize)
+{
+	ZSTD_strategy const strategy = cdict->refContext->params.cParams.strategy;
+
+	return (strategy == ZSTD_fast || strategy == ZSTD_dfast) && pledgedSrcSize != 0 && pledgedSrcSize <= ZSTD_ATTACH_DICT_CUTOFF;
+}
+
 size_t ZSTD_compressBegin_usingCDict(ZSTD_CCtx *cctx, const ZSTD_CDict *cdict, unsigned long long pledgedSrcSize)
 {
-	if (cdict->dictContentSize)
+	if (cdict->dictContentSize && ZSTD_shouldAttachCDict(cdict, pledgedSrcSize))
+		CHECK_F(ZSTD_attachCDict(cctx, cdict, pledgedSrcSize))
+	else if (cdict->dictContentSize)
 		CHECK_F(ZSTD_copyCCtx(cctx, cdict->refContext, pledgedSrcSize))
 	else {
 		ZSTD_parameters params = cdict->refContext->params;
@@ -0,0 +1,63 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+# Runs dmatest memcpy, xor and pq threads on the CPU offload DMA engine,
+# once completing through callbacks and once by polling the cookie.
+
+ksft_skip=4
+params=/sys/module/dmatest/parameters
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "cpu_offload_dmatest: must be run as root [SKIP]"
+	exit $ksft_skip
+fi
+
+/sbin/modprobe -q cpu-offload
+dev=$(ls /sys/bus/platform/drivers/cpu-offload-dma 2>/dev/null |
+	grep '^cpu-offload-dma\.' | head -n 1)
+if [ -z "$dev" ]; then
+	echo "cpu_offload_dmatest: no cpu-offload-dma device [SKIP]"
+	exit $ksft_skip
+fi
+
+if ! /sbin/modprobe -q dmatest; then
+	echo "cpu_offload_dmatest: dmatest not available [SKIP]"
+	exit $ksft_skip
+fi
+
+run_dmatest()
+{
+	polled=$1
+	start=$(dmesg | wc -l)
+
+	echo 0 > $params/run
+	echo "$dev" > $params/device
+	echo 2 > $params/max_channels
+	echo 1 > $params/threads_per_chan
+	echo 500 > $params/iterations
+	echo 8 > $params/xor_sources
+	echo 8 > $params/pq_sources
+	echo 5000 > $params/timeout
+	echo "$polled" > $params/polled
+	echo "" > $params/channel
+	echo 1 > $params/run
+	cat $params/wait > /dev/null
+
+	summaries=$(dmesg | tail -n +$((start + 1)) | grep 'dmatest: .*summary')
+	if [ -z "$summaries" ]; then
+		echo "cpu_offload_dmatest: polled=$polled: no tests ran [FAIL]"
+		return 1
+	fi
+	echo "$summaries"
+	if echo "$summaries" | grep -qv ', 0 failures'; then
+		echo "cpu_offload_dmatest: polled=$polled [FAIL]"
+		return 1
+	fi
+	echo "cpu_offload_dmatest: polled=$polled: ok"
+}
+
+ret=0
+run_dmatest 0 || ret=1
+run_dmatest 1 || ret=1
+
+/sbin/modprobe -q -r dmatest
+exit $ret
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/fanotify.h>
+
+#include "../../kselftest_harness.h"
+
+/*
+ * Wait for the first record in a freshly set up ring and return the pid it
+ * reports, or a negative errno.
+ */
+static int ring_first_pid(int fan_fd, struct fanotify_ring *ring)
+{
+	struct fanotify_event_metadata *meta;
+	struct pollfd pfd = { .fd = fan_fd, .events = POLLIN };
+	int retries = 50;
+
+	while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+	       ring->head) {
+		if (!--retries)
+			return -ETIMEDOUT;
+		/* poll() also kicks the worker that fills the ring */
+		poll(&pfd, 1, 100);
+	}
+
+	meta = (struct fanotify_event_metadata *)ring->data;
+	if (meta->vers != FANOTIFY_METADATA_VERSION ||
+	    !(meta->mask & FAN_CREATE))
+		return -EINVAL;
+	return meta->pid;
+}
+
+/*
+ * Runs as pid 1 of a new pid namespace: set up a ring, have a child create
+ * a file in a watched directory and check that the ring reports the
+ * child's pid as seen from this namespace.  The ring is filled from a
+ * kworker, which lives in the initial pid namespace.
+ */
+static int ring_pidns_child(const char *dir)
+{
+	struct fanotify_ring_setup setup = { .size = FAN_RING_MIN_SIZE };
+	struct fanotify_ring *ring;
+	char path[PATH_MAX];
+	int fan_fd, fd, status, pid;
+	pid_t creator;
+
+	fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_FID, O_RDONLY);
+	if (fan_fd < 0)
+		return errno == EINVAL ? KSFT_SKIP : 1;
+	if (ioctl(fan_fd, FAN_IOC_SETUP_RING, &setup))
+		return errno == ENOTTY ? KSFT_SKIP : 2;
+	ring = mmap(NULL, setup.mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fan_fd, 0);
+	if (ring == MAP_FAILED)
+		return 3;
+	if (fanotify_mark(fan_fd, FAN_MARK_ADD, FAN_CREATE, AT_FDCWD, dir))
+		return 4;
+
+	snprintf(path, sizeof(path), "%s/file", dir);
+	creator = fork();
+	if (creator < 0)
+		return 5;
+	if (!creator) {
+		fd = open(path, O_CREAT | O_WRONLY, 0600);
+		_exit(fd < 0);
+	}
+	if (waitpid(creator, &status, 0) != creator || status)
+		return 6;
+	unlink(path);
+
+	/* creator has a different pid in the initial pid namespace */
+	pid = ring_first_pid(fan_fd, ring);
+	if (pid != creator) {
+		fprintf(stderr, "ring reported pid %d, expected %d\n", pid,
+			creator);
+		return 7;
+	}
+	return 0;
+}
+
+TEST(ring_reports_listener_pidns)
+{
+	char dir[] = "/tmp/fanotify_ring_XXXXXX";
+	int status;
+	pid_t pid;
+
+	if (geteuid())
+		SKIP(return, "fanotify needs CAP_SYS_ADMIN");
+	ASSERT_NE(NULL, mkdtemp(dir));
+	ASSERT_EQ(0, unshare(CLONE_NEWPID));
+
+	pid = fork();
+	ASSERT_GE(pid, 0);
+	if (!pid)
+		_exit(ring_pidns_child(dir));
+
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	rmdir(dir);
+	ASSERT_TRUE(WIFEXITED(status));
+	if (WEXITSTATUS(status) == KSFT_SKIP)
+		SKIP(return, "no fanotify event ring");
+	EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST_HARNESS_MAIN
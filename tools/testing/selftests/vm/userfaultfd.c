@@ -1147,6 +1147,224 @@ static int userfaultfd_events_test(void)
 	return stats.missing_faults != nr_pages;
 }
 
+static bool uffd_features_supported(__u64 features)
+{
+	struct uffdio_api uffdio_api = { .api = UFFD_API };
+	int fd;
+
+	fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0)
+		return false;
+	if (ioctl(fd, UFFDIO_API, &uffdio_api))
+		uffdio_api.features = 0;
+	close(fd);
+	return (uffdio_api.features & features) == features;
+}
+
+static void *ring_faulting_thread(void *arg)
+{
+	unsigned long nr;
+
+	/* fault in the first two pages, one after the other */
+	for (nr = 0; nr < 2; nr++) {
+		if (my_bcmp(area_dst + nr * page_size,
+			    area_src + nr * page_size, page_size)) {
+			fprintf(stderr, "ring: page %lu mismatch\n", nr);
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+/* wait until the kernel has published more than @tail messages */
+static void ring_wait_tail(struct uffd_ring *ring, __u32 tail)
+{
+	int retries = 10000;
+
+	while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == tail) {
+		if (!--retries) {
+			fprintf(stderr, "ring: no fault message\n");
+			exit(1);
+		}
+		usleep(1000);
+	}
+}
+
+static void ring_check_msg(struct uffd_ring *ring, __u32 idx,
+			   unsigned long nr)
+{
+	struct uffd_msg *msg = &ring->msgs[idx & (ring->nr_entries - 1)];
+	unsigned long addr = (unsigned long) area_dst + nr * page_size;
+
+	if (msg->event != UFFD_EVENT_PAGEFAULT ||
+	    (msg->arg.pagefault.address & ~(page_size - 1)) != addr) {
+		fprintf(stderr, "ring: bad message %u: event %u addr %llx\n",
+			idx, msg->event, msg->arg.pagefault.address);
+		exit(1);
+	}
+}
+
+static void ring_copy_vec(unsigned long nr, unsigned long count)
+{
+	struct uffdio_copy copies[count];
+	struct uffdio_vec uffdio_vec;
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		copies[i].dst = (unsigned long) area_dst + (nr + i) * page_size;
+		copies[i].src = (unsigned long) area_src + (nr + i) * page_size;
+		copies[i].len = page_size;
+		copies[i].mode = 0;
+		copies[i].copy = 0;
+	}
+	uffdio_vec.vec = (unsigned long) copies;
+	uffdio_vec.nr = count;
+	uffdio_vec.mode = 0;
+	uffdio_vec.done = 0;
+	if (ioctl(uffd, UFFDIO_COPY_VEC, &uffdio_vec) ||
+	    uffdio_vec.done != count) {
+		fprintf(stderr, "UFFDIO_COPY_VEC error %Ld\n", uffdio_vec.done);
+		exit(1);
+	}
+	for (i = 0; i < count; i++) {
+		if (copies[i].copy != page_size) {
+			fprintf(stderr, "UFFDIO_COPY_VEC unexpected copy %Ld\n",
+				copies[i].copy);
+			exit(1);
+		}
+	}
+}
+
+static void ring_zeropage_vec(unsigned long nr, unsigned long count)
+{
+	struct uffdio_zeropage zeropages[count];
+	struct uffdio_vec uffdio_vec;
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		zeropages[i].range.start = (unsigned long) area_dst +
+					   (nr + i) * page_size;
+		zeropages[i].range.len = page_size;
+		zeropages[i].mode = 0;
+		zeropages[i].zeropage = 0;
+	}
+	uffdio_vec.vec = (unsigned long) zeropages;
+	uffdio_vec.nr = count;
+	uffdio_vec.mode = 0;
+	uffdio_vec.done = 0;
+	if (ioctl(uffd, UFFDIO_ZEROPAGE_VEC, &uffdio_vec) ||
+	    uffdio_vec.done != count) {
+		fprintf(stderr, "UFFDIO_ZEROPAGE_VEC error %Ld\n",
+			uffdio_vec.done);
+		exit(1);
+	}
+	for (i = 0; i < count; i++) {
+		if (zeropages[i].zeropage != page_size ||
+		    my_bcmp(area_dst + (nr + i) * page_size, zeropage,
+			    page_size)) {
+			fprintf(stderr, "UFFDIO_ZEROPAGE_VEC bad page %lu\n",
+				nr + i);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Exercise UFFDIO_RING, UFFDIO_COPY_VEC and UFFDIO_ZEROPAGE_VEC.  The
+ * first fault is resolved while its message is still in the ring, before
+ * userland advanced head past it, and the second fault must still be
+ * delivered through the ring behind it.
+ */
+static int userfaultfd_ring_test(void)
+{
+	struct uffdio_register uffdio_register;
+	struct uffdio_ring uffdio_ring;
+	struct uffd_ring *ring;
+	pthread_t thread;
+
+	printf("testing fault ring: ");
+	fflush(stdout);
+
+	if (nr_pages < 4 ||
+	    !uffd_features_supported(UFFD_FEATURE_FAULT_RING)) {
+		printf("skipped.\n");
+		return 0;
+	}
+
+	if (uffd_test_ops->release_pages(area_dst))
+		return 1;
+
+	if (userfaultfd_open(UFFD_FEATURE_FAULT_RING) < 0)
+		return 1;
+
+	uffdio_ring.nr_entries = 4;
+	uffdio_ring.flags = 0;
+	if (ioctl(uffd, UFFDIO_RING, &uffdio_ring)) {
+		perror("UFFDIO_RING");
+		exit(1);
+	}
+	if (!ioctl(uffd, UFFDIO_RING, &uffdio_ring) || errno != EBUSY) {
+		fprintf(stderr, "second UFFDIO_RING did not fail\n");
+		exit(1);
+	}
+	ring = mmap(NULL, uffdio_ring.mmap_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, uffd, 0);
+	if (ring == MAP_FAILED) {
+		perror("mmap fault ring");
+		exit(1);
+	}
+	if (ring->nr_entries != uffdio_ring.nr_entries || ring->head ||
+	    ring->tail) {
+		fprintf(stderr, "fault ring not initialized\n");
+		exit(1);
+	}
+
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register)) {
+		fprintf(stderr, "register failure\n");
+		exit(1);
+	}
+	if (!(uffdio_register.ioctls & (1 << _UFFDIO_COPY_VEC))) {
+		fprintf(stderr, "unexpected missing UFFDIO_COPY_VEC\n");
+		exit(1);
+	}
+
+	/* resolve pages that never faulted, several per ioctl */
+	if (uffdio_register.ioctls & (1 << _UFFDIO_ZEROPAGE_VEC))
+		ring_zeropage_vec(2, 2);
+
+	if (pthread_create(&thread, &attr, ring_faulting_thread, NULL)) {
+		perror("ring_faulting_thread create");
+		exit(1);
+	}
+
+	ring_wait_tail(ring, 0);
+	ring_check_msg(ring, 0, 0);
+	/* resolve the fault but leave its message in the ring */
+	ring_copy_vec(0, 1);
+
+	ring_wait_tail(ring, 1);
+	ring_check_msg(ring, 1, 1);
+	__atomic_store_n(&ring->head, 2, __ATOMIC_RELEASE);
+	ring_copy_vec(1, 1);
+
+	if (pthread_join(thread, NULL))
+		return 1;
+
+	if (ring->tail != 2 || ring->overflow) {
+		fprintf(stderr, "ring: tail %u overflow %llu\n", ring->tail,
+			ring->overflow);
+		exit(1);
+	}
+
+	munmap(ring, uffdio_ring.mmap_size);
+	close(uffd);
+	printf("done.\n");
+	return 0;
+}
+
 static int userfaultfd_sig_test(void)
 {
 	struct uffdio_register uffdio_register;
@@ -1424,7 +1642,7 @@ static int userfaultfd_stress(void)
 
 	close(uffd);
 	return userfaultfd_zeropage_test() || userfaultfd_sig_test()
-		|| userfaultfd_events_test();
+		|| userfaultfd_events_test() || userfaultfd_ring_test();
 }
 
 /*